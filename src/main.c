@@ -26,12 +26,16 @@
 #include <utils/config.h>
 #include <utils/kill_others.h>
 #include <utils/net_utils.h>
+#include <utils/png_tuning.h>
 #include <utils/utils.h>
 
 #ifdef __linux__
 #include <pwd.h>
 #include <sys/wait.h>
 #include <utils/linux_status_icon.h>
+#if HEADLESS != 1
+#include <xscreenshot/screenshot_cache.h>
+#endif
 #elif defined(_WIN32)
 #include <res/win/resource.h>
 #include <shellapi.h>
@@ -59,6 +63,9 @@
 #define MAX_TEXT_LENGTH 4194304L     // 4 MiB
 #define MAX_FILE_SIZE 68719476736LL  // 64 GiB
 
+// time to wait for the owner of the clipboard to respond
+#define CLIPBOARD_TIMEOUT_MS 5000
+
 #define ERROR_LOG_FILE "server_err.log"
 
 config configuration;
@@ -215,9 +222,16 @@ static inline void _apply_default_conf(void) {
     if (configuration.max_file_size <= 0) configuration.max_file_size = MAX_FILE_SIZE;
     if (configuration.max_file_count <= 0) configuration.max_file_count = 0xFFFFFFFEUL;
     if (configuration.cut_sent_files < 0) configuration.cut_sent_files = 0;
+    if (configuration.file_sync < 0) configuration.file_sync = FILE_SYNC_NONE;
+    if (configuration.clipboard_timeout == 0) configuration.clipboard_timeout = CLIPBOARD_TIMEOUT_MS;  // not configured
+    if (configuration.serve_stale_text < 0) configuration.serve_stale_text = 0;
     if (configuration.client_selects_display < 0) configuration.client_selects_display = 0;
     if (configuration.display <= 0) configuration.display = 1;
 
+    if (configuration.png.level < 0) configuration.png.level = PNG_LEVEL_AUTO;
+    if (configuration.png.strategy < 0) configuration.png.strategy = 1;  // filtered
+    if (configuration.png.filter < 0) configuration.png.filter = PNG_FILTER_ADAPTIVE;
+
     if (configuration.min_proto_version < PROTOCOL_MIN) configuration.min_proto_version = PROTOCOL_MIN;
     if (configuration.min_proto_version > PROTOCOL_MAX) configuration.min_proto_version = PROTOCOL_MAX;
     if (configuration.max_proto_version < configuration.min_proto_version ||
@@ -523,6 +537,26 @@ static void start_servers(int8_t daemonize) {
     pid_t p_scan = 0;
 #ifdef WEB_ENABLED
     pid_t p_web = 0;
+#endif
+#if defined(__linux__) && (HEADLESS != 1)
+    pid_t p_damage = 0;
+    // only the server processes keep the write end. So the damage tracker sees the pipe closed when they all exit
+    int servers_pipe[2] = {-1, -1};
+    // the cache must be created before the servers so that all the processes share it
+    if ((configuration.method_enabled.get_image || configuration.method_enabled.get_screenshot) &&
+        init_screenshot_cache() == EXIT_SUCCESS && pipe(servers_pipe) == 0) {
+        fcntl(servers_pipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(servers_pipe[1], F_SETFD, FD_CLOEXEC);
+        fflush(stdout);
+        fflush(stderr);
+        p_damage = fork();
+        if (p_damage == 0) {
+            close(servers_pipe[1]);
+            track_damage(servers_pipe[0]);
+            exit(EXIT_SUCCESS);
+        }
+        close(servers_pipe[0]);
+    }
 #endif
     if (configuration.insecure_mode_enabled) {
         fflush(stdout);
@@ -554,6 +588,10 @@ static void start_servers(int8_t daemonize) {
             exit(status);
         }
     }
+#endif
+#if defined(__linux__) && (HEADLESS != 1)
+    // the servers hold the write end. The processes forked after this and this process do not keep it
+    if (servers_pipe[1] >= 0) close(servers_pipe[1]);
 #endif
     puts("Server Started");
     if (configuration.udp_server_enabled) {
@@ -595,6 +633,9 @@ static void start_servers(int8_t daemonize) {
         if (p_scan > 0) waitpid(p_scan, NULL, 0);
 #ifdef WEB_ENABLED
         if (p_web > 0) waitpid(p_web, NULL, 0);
+#endif
+#if defined(__linux__) && (HEADLESS != 1)
+        if (p_damage > 0) waitpid(p_damage, NULL, 0);
 #endif
     }
 }
@@ -747,6 +788,8 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    init_png_tuning();
+    init_text_snapshot();
     start_servers(daemonize);
     return 0;
 }
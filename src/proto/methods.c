@@ -27,21 +27,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <utils/dir_cache.h>
+#include <utils/eol.h>
+#include <utils/img_scale.h>
 #include <utils/net_utils.h>
+#include <utils/png_tuning.h>
 #include <utils/unistr_wrap.h>
 #include <utils/utils.h>
 
 // status codes
 #define STATUS_OK 1
 #define STATUS_NO_DATA 2
+#define STATUS_TIMEOUT 5  // from version 5 onwards
 
 #define FILE_BUF_SZ 65536L           // 64 KiB
+#define TEXT_PART_SZ 65536L          // 64 KiB
 #define MAX_IMAGE_SIZE 1073741824UL  // 1 GiB
+#define MAX_PARAMS_LEN 4096L         // 4 KiB
+#define DEFAULT_STREAM_FPS 5
+#define MAX_STREAM_FPS 30
 
 #define MIN(x, y) (x < y ? x : y)
 
-const char bad_path[] = {PATH_SEP, '.', '.', PATH_SEP, '\0'};  // /../
-
 /*
  * Send a data buffer to the peer.
  * Sends the length first and then the data buffer.
@@ -69,13 +76,17 @@ static int _get_files_common(int version, socket_t *socket, list2 *file_list, si
 
 /*
  * Common function to save files.
+ * file_name is relative to the root of the cache.
  */
-static int _save_file_common(int version, socket_t *socket, const char *file_name);
+static int _save_file_common(int version, socket_t *socket, dir_cache *cache, const char *file_name);
 
 /*
  * Common function to get image.
+ * The image format is sent before the image data from version 5 onwards.
+ * From version 4 onwards, the acknowledgement from the client is also read and the time taken to deliver the image is
+ * recorded to tune the PNG compression level.
  */
-static inline int _get_image_common(socket_t *socket, int mode, uint16_t disp);
+static inline int _get_image_common(socket_t *socket, int mode, img_options *opts, int version);
 
 /*
  * Check if the file name is valid.
@@ -85,21 +96,37 @@ static inline int _get_image_common(socket_t *socket, int mode, uint16_t disp);
  */
 static inline int _is_valid_fname(const char *fname, size_t name_length);
 
-static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len);
+/*
+ * Send a file or an empty directory of the copied files.
+ * file_size is the size of the file if it is already known, or -1 otherwise.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE otherwise.
+ */
+static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len,
+                                 int64_t file_size);
 
 #if PROTOCOL_MAX >= 4
+static inline int _read_ack(socket_t *socket);
+
 static inline int _send_ack(socket_t *socket);
 #endif
 
-int get_text_v1(socket_t *socket) {
+/*
+ * Get the status to send when there is no data to send, given the status of reading the clipboard.
+ */
+static inline char _no_data_status(int version, int read_status) {
+    return (version >= 5 && read_status == CLIPBOARD_TIMEOUT) ? STATUS_TIMEOUT : STATUS_NO_DATA;
+}
+
+static int _get_text_common(socket_t *socket, int version) {
     uint32_t length = 0;
     char *buf = NULL;
-    if (get_clipboard_text(&buf, &length) != EXIT_SUCCESS || length <= 0 ||
+    const int read_status = get_clipboard_text(&buf, &length);
+    if (read_status != EXIT_SUCCESS || length <= 0 ||
         length > configuration.max_text_length) {  // do not change the order
 #ifdef DEBUG_MODE
         printf("clipboard read text failed. len = %" PRIu32 "\n", length);
 #endif
-        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        write_sock(socket, &(char){_no_data_status(version, read_status)}, 1);
         if (buf) free(buf);
         close_socket_no_wait(socket);
         return EXIT_FAILURE;
@@ -111,7 +138,7 @@ int get_text_v1(socket_t *socket) {
         puts("");
     }
 #endif
-    int64_t new_len = convert_eol(&buf, 1);
+    int64_t new_len = convert_eol(&buf, length, 1);
     if (new_len <= 0 || !buf) {
         write_sock(socket, &(char){STATUS_NO_DATA}, 1);
         return EXIT_FAILURE;
@@ -128,6 +155,44 @@ int get_text_v1(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
+int get_text_v1(socket_t *socket) { return _get_text_common(socket, 1); }
+
+/*
+ * Read the text of length bytes into buf, which has space for length + 1 bytes. The text is checked for valid UTF-8
+ * and its line endings are converted to LF part by part as it is read. So invalid text is rejected without reading the
+ * rest.
+ * returns the length of the converted text, or -1 if reading failed or the text is not valid UTF-8.
+ */
+static int64_t _read_text(socket_t *socket, char *buf, size_t length) {
+    utf8_stream validator = {.pending_len = 0};
+    size_t received = 0;
+    size_t converted = 0;  // received bytes of which the line endings are converted
+    size_t text_len = 0;   // length of the converted text, which is kept at the start of buf
+    while (received < length) {
+        const size_t part_len = MIN((size_t)TEXT_PART_SZ, length - received);
+        if (read_sock(socket, buf + received, part_len) != EXIT_SUCCESS) return -1;
+        if (!utf8_check_part(&validator, (const uint8_t *)buf + received, part_len)) {
+#ifdef DEBUG_MODE
+            fputs("Invalid UTF-8\n", stderr);
+#endif
+            return -1;
+        }
+        received += part_len;
+        // a CR at the end is converted with the next part, which decides whether the CR is dropped
+        size_t end = received;
+        if (received < length && buf[received - 1] == '\r') end--;
+        text_len += eol_move_to_lf(buf + text_len, buf + converted, end - converted);
+        converted = end;
+    }
+    if (!utf8_check_end(&validator)) {
+#ifdef DEBUG_MODE
+        fputs("Invalid UTF-8\n", stderr);
+#endif
+        return -1;
+    }
+    return (int64_t)text_len;
+}
+
 static inline int _send_text_common(socket_t *socket, int version) {
     if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
     int64_t length;
@@ -146,7 +211,8 @@ static inline int _send_text_common(socket_t *socket, int version) {
     if (!data) {
         return EXIT_FAILURE;
     }
-    if (read_sock(socket, data, (uint64_t)length) != EXIT_SUCCESS) {
+    length = _read_text(socket, data, (size_t)length);
+    if (length < 0) {
 #ifdef DEBUG_MODE
         fputs("Read data failed\n", stderr);
 #endif
@@ -168,18 +234,10 @@ static inline int _send_text_common(socket_t *socket, int version) {
     close_socket_no_wait(socket);
 #endif
     data[length] = 0;
-
-    if (u8_check((uint8_t *)data, (size_t)length)) {
-#ifdef DEBUG_MODE
-        fputs("Invalid UTF-8\n", stderr);
-#endif
-        free(data);
-        return EXIT_FAILURE;
-    }
 #ifdef DEBUG_MODE
     if (length < 1024) puts(data);
 #endif
-    length = convert_eol(&data, 0);
+    length = convert_lf_eol(&data, (size_t)length);
     if (length <= 0 || !data) return EXIT_FAILURE;
     put_clipboard_text(data, (uint32_t)length);
     free(data);
@@ -188,13 +246,14 @@ static inline int _send_text_common(socket_t *socket, int version) {
 
 int send_text_v1(socket_t *socket) { return _send_text_common(socket, 1); }
 
-static int _transfer_regular_file(socket_t *socket, const char *file_path, const char *filename, size_t fname_len) {
+static int _transfer_regular_file(socket_t *socket, const char *file_path, const char *filename, size_t fname_len,
+                                  int64_t file_size) {
     FILE *fp = open_file(file_path, "rb");
     if (!fp) {
         error("Couldn't open some files");
         return EXIT_FAILURE;
     }
-    int64_t file_size = get_file_size(fp);
+    if (file_size < 0) file_size = get_file_size(fp);
     if (file_size < 0 || file_size > configuration.max_file_size) {
 #ifdef DEBUG_MODE
         printf("file size = %" PRIi64 "\n", file_size);
@@ -215,8 +274,14 @@ static int _transfer_regular_file(socket_t *socket, const char *file_path, const
 
     char data[FILE_BUF_SZ];
     while (file_size > 0) {
-        size_t read = fread(data, 1, FILE_BUF_SZ, fp);
-        if (read == 0) continue;
+        // never read past the size sent, even if the file grew after its size was found
+        size_t read = fread(data, 1, MIN((size_t)FILE_BUF_SZ, (size_t)file_size), fp);
+        if (read == 0) {
+            if (!(feof(fp) || ferror(fp))) continue;
+            error("File changed while sending");  // the file is shorter than the size sent
+            fclose(fp);
+            return EXIT_FAILURE;
+        }
         if (write_sock(socket, data, read) != EXIT_SUCCESS) {
             fclose(fp);
             return EXIT_FAILURE;
@@ -239,7 +304,8 @@ static int _transfer_directory(socket_t *socket, const char *filename, size_t fn
 }
 #endif
 
-static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len) {
+static int _transfer_single_file(int version, socket_t *socket, const char *file_path, size_t path_len,
+                                 int64_t file_size) {
     const char *tmp_fname;
     switch (version) {
 #if PROTOCOL_MIN <= 1
@@ -253,10 +319,11 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
             break;
         }
 #endif
-#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
         case 2:
         case 3:
-        case 4: {
+        case 4:
+        case 5: {
             tmp_fname = file_path + path_len;
             break;
         }
@@ -292,7 +359,7 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
         return _transfer_directory(socket, filename, fname_len - 1);
     }
 #endif
-    return _transfer_regular_file(socket, file_path, filename, fname_len);
+    return _transfer_regular_file(socket, file_path, filename, fname_len, file_size);
 }
 
 static int _get_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len) {
@@ -324,7 +391,7 @@ static int _get_files_common(int version, socket_t *socket, list2 *file_list, si
         printf("file name = %s\n", file_path);
 #endif
 
-        if (_transfer_single_file(version, socket, file_path, path_len) != EXIT_SUCCESS) {
+        if (_transfer_single_file(version, socket, file_path, path_len, -1) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
             puts("Transfer failed");
 #endif
@@ -336,7 +403,7 @@ static int _get_files_common(int version, socket_t *socket, list2 *file_list, si
     return EXIT_SUCCESS;
 }
 
-static int _save_file_common(int version, socket_t *socket, const char *file_name) {
+static int _save_file_common(int version, socket_t *socket, dir_cache *cache, const char *file_name) {
     int64_t file_size;
     if (read_size(socket, &file_size) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
@@ -348,9 +415,9 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
         return EXIT_FAILURE;
     }
 
-#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (3 <= PROTOCOL_MAX)
     if (file_size == -1 && version >= 3) {
-        return mkdirs(file_name);
+        return make_dirs_at(cache, file_name);
     }
 #else
     (void)version;
@@ -359,7 +426,7 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
         return EXIT_FAILURE;
     }
 
-    FILE *file = open_file(file_name, "wb");
+    FILE *file = create_file_at(cache, file_name);
     if (!file) {
         error("Couldn't create some files");
         return EXIT_FAILURE;
@@ -373,18 +440,22 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
             puts("recieve error");
 #endif
             fclose(file);
-            remove_file(file_name);
+            remove_file_at(cache, file_name);
             return EXIT_FAILURE;
         }
         if (fwrite(data, 1, read_len, file) < read_len) {
             fclose(file);
-            remove_file(file_name);
+            remove_file_at(cache, file_name);
             return EXIT_FAILURE;
         }
         file_size -= (int64_t)read_len;
     }
 
-    fclose(file);
+    if (close_file_at(cache, file) != EXIT_SUCCESS) {
+        error("Couldn't write some files");
+        remove_file_at(cache, file_name);
+        return EXIT_FAILURE;
+    }
 
 #ifdef DEBUG_MODE
     printf("file saved : %s\n", file_name);
@@ -393,7 +464,7 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
 }
 
 static inline int _is_valid_fname(const char *fname, size_t name_length) {
-    if (u8_check((const uint8_t *)fname, name_length)) {
+    if (!utf8_is_valid((const uint8_t *)fname, name_length)) {
 #ifdef DEBUG_MODE
         fputs("Invalid UTF-8\n", stderr);
 #endif
@@ -489,7 +560,12 @@ int send_file_v1(socket_t *socket) {
     // if file already exists, use a different file name
     if (_rename_if_exists(file_name, name_max_len) != EXIT_SUCCESS) return EXIT_FAILURE;
 
-    if (_save_file_common(1, socket, file_name) != EXIT_SUCCESS) return EXIT_FAILURE;
+    dir_cache *cache = open_dir_cache(".");
+    if (!cache) return EXIT_FAILURE;
+    int saved = _save_file_common(1, socket, cache, file_name);
+    if (saved == EXIT_SUCCESS) saved = sync_dir_cache(cache);
+    close_dir_cache(cache);
+    if (saved != EXIT_SUCCESS) return EXIT_FAILURE;
     close_socket_no_wait(socket);
 
     int status = EXIT_SUCCESS;
@@ -509,10 +585,10 @@ int send_file_v1(socket_t *socket) {
 }
 #endif
 
-static inline int _get_image_common(socket_t *socket, int mode, uint16_t disp) {
+static inline int _get_image_common(socket_t *socket, int mode, img_options *opts, int version) {
     uint32_t length = 0;
     char *buf = NULL;
-    if (get_image(&buf, &length, mode, disp) != EXIT_SUCCESS || length == 0 ||
+    if (get_image(&buf, &length, mode, opts) != EXIT_SUCCESS || length == 0 ||
         length > MAX_IMAGE_SIZE) {  // do not change the order
 #ifdef DEBUG_MODE
         printf("get image failed. len = %" PRIu32 "\n", length);
@@ -529,15 +605,37 @@ static inline int _get_image_common(socket_t *socket, int mode, uint16_t disp) {
         free(buf);
         return EXIT_FAILURE;
     }
+#if PROTOCOL_MAX >= 5
+    if (version >= 5 && write_sock(socket, (char *)&(opts->format), 1) != EXIT_SUCCESS) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+#endif
+    const uint64_t start = get_time_ns();
     if (_send_data(socket, (int64_t)length, buf) != EXIT_SUCCESS) {
         free(buf);
         return EXIT_FAILURE;
     }
     free(buf);
+#if PROTOCOL_MAX >= 4
+    if (version >= 4) {
+        if (_read_ack(socket) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        record_image_send(length, get_time_ns() - start);
+        close_socket_no_wait(socket);
+    }
+#else
+    (void)version;
+    (void)start;
+#endif
     return EXIT_SUCCESS;
 }
 
-int get_image_v1(socket_t *socket) { return _get_image_common(socket, IMG_ANY, 0); }
+int get_image_v1(socket_t *socket) {
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    return _get_image_common(socket, IMG_ANY, &opts, 1);
+}
 
 int info_v1(socket_t *socket) {
     if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
@@ -548,23 +646,8 @@ int info_v1(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
-#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
-/*
- * Make parent directories for path
- */
-static inline int _make_directories(const char *path) {
-    char *base_name = strrchr(path, PATH_SEP);
-    if (!base_name) return EXIT_FAILURE;
-    *base_name = 0;
-    if (mkdirs(path) != EXIT_SUCCESS) {
-        *base_name = PATH_SEP;
-        return EXIT_FAILURE;
-    }
-    *base_name = PATH_SEP;
-    return EXIT_SUCCESS;
-}
-
-static int save_file(int version, socket_t *socket, const char *dirname) {
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
+static int save_file(int version, socket_t *socket, dir_cache *cache) {
     int64_t fname_size;
     if (read_size(socket, &fname_size) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
@@ -607,23 +690,8 @@ static int save_file(int version, socket_t *socket, const char *dirname) {
     }
 #endif
 
-    char new_path[name_length + 20];
-    if (file_name[0] == PATH_SEP) {
-        if (snprintf_check(new_path, name_length + 20, "%s%s", dirname, file_name)) return EXIT_FAILURE;
-    } else {
-        if (snprintf_check(new_path, name_length + 20, "%s%c%s", dirname, PATH_SEP, file_name)) return EXIT_FAILURE;
-    }
-
-    // path must not contain /../ (go to parent dir)
-    if (strstr(new_path, bad_path)) return EXIT_FAILURE;
-
-    // make parent directories
-    if (_make_directories(new_path) != EXIT_SUCCESS) return EXIT_FAILURE;
-
-    // check if file exists
-    if (file_exists(new_path)) return EXIT_FAILURE;
-
-    return _save_file_common(version, socket, new_path);
+    // the file is created relative to the directory of the transfer. Paths with .. components are rejected by the cache
+    return _save_file_common(version, socket, cache, file_name);
 }
 
 static char *_check_and_rename(const char *filename, const char *dirname) {
@@ -717,14 +785,44 @@ static int _send_files_dirs(int version, socket_t *socket) {
     } while (file_exists(dirname));
 
     if (mkdirs(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+    dir_cache *cache = open_dir_cache(dirname);
+    if (!cache) {
+        remove_directory(dirname);
+        return EXIT_FAILURE;
+    }
 
     int status = EXIT_SUCCESS;
     for (int64_t file_num = 0; file_num < cnt; file_num++) {
-        if (save_file(version, socket, dirname) != EXIT_SUCCESS) {
+        if (save_file(version, socket, cache) != EXIT_SUCCESS) {
             status = EXIT_FAILURE;
             break;
         }
     }
+    // the files are on the storage before they are moved out of the temporary directory
+    if (status == EXIT_SUCCESS && sync_dir_cache(cache) != EXIT_SUCCESS) {
+        error("Couldn't sync received files");
+        status = EXIT_FAILURE;
+    }
+    close_dir_cache(cache);
+
+    list2 *files = status == EXIT_SUCCESS ? list_dir(dirname) : NULL;
+    if (!files) {
+        status = EXIT_FAILURE;
+    } else if (files->len == 0) {
+        status = EXIT_FAILURE;
+        remove_directory(dirname);
+    }
+    list2 *dest_files = NULL;
+    if (status == EXIT_SUCCESS) {
+        dest_files = clean_temp_dir(dirname, files);
+        if (!dest_files) status = EXIT_FAILURE;
+    }
+    if (files) free_list(files);
+    // the files are at their final names on the storage before the transfer is acknowledged
+    if (status == EXIT_SUCCESS && sync_directory(".") != EXIT_SUCCESS) {
+        error("Couldn't sync received files");
+        status = EXIT_FAILURE;
+    }
 
 #if PROTOCOL_MAX >= 4
     if (status == EXIT_SUCCESS && version >= 4) {
@@ -739,18 +837,6 @@ static int _send_files_dirs(int version, socket_t *socket) {
     close_socket_no_wait(socket);
 #endif
 
-    list2 *files = list_dir(dirname);
-    if (!files) {
-        status = EXIT_FAILURE;
-    } else if (files->len == 0) {
-        status = EXIT_FAILURE;
-        remove_directory(dirname);
-    }
-    list2 *dest_files = NULL;
-    if (status == EXIT_SUCCESS) {
-        dest_files = clean_temp_dir(dirname, files);
-    }
-    free_list(files);
     if (dest_files) {
         if (configuration.cut_sent_files && set_clipboard_cut_files(dest_files) != EXIT_SUCCESS) {
             status = EXIT_FAILURE;
@@ -772,22 +858,26 @@ int get_files_v2(socket_t *socket) {
 int send_files_v2(socket_t *socket) { return _send_files_dirs(2, socket); }
 #endif
 
-#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
-static inline int _get_screenshot_common(socket_t *socket) {
+#if (PROTOCOL_MIN <= 5) && (3 <= PROTOCOL_MAX)
+static inline int _get_screenshot_common(socket_t *socket, int version) {
     if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
     int64_t disp;
     if (read_size(socket, &disp) != EXIT_SUCCESS) return EXIT_FAILURE;
     if (disp <= 0 || disp > 65536L) disp = 0;
-    return _get_image_common(socket, IMG_SCRN_ONLY, (uint16_t)disp);
+    img_options opts = {.disp = (uint16_t)disp, .format_cnt = 0};
+    return _get_image_common(socket, IMG_SCRN_ONLY, &opts, version);
 }
 #endif
 
 #if (PROTOCOL_MIN <= 3) && (3 <= PROTOCOL_MAX)
-int get_copied_image_v3(socket_t *socket) { return _get_image_common(socket, IMG_COPIED_ONLY, 0); }
+int get_copied_image_v3(socket_t *socket) {
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    return _get_image_common(socket, IMG_COPIED_ONLY, &opts, 3);
+}
 
-int get_screenshot_v3(socket_t *socket) { return _get_screenshot_common(socket); }
+int get_screenshot_v3(socket_t *socket) { return _get_screenshot_common(socket, 3); }
 
 int get_files_v3(socket_t *socket) {
     dir_files copied_dir_files;
@@ -798,7 +888,7 @@ int get_files_v3(socket_t *socket) {
 int send_files_v3(socket_t *socket) { return _send_files_dirs(3, socket); }
 #endif
 
-#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (4 <= PROTOCOL_MAX)
 
 static inline int _read_ack(socket_t *socket) {
     char status;
@@ -825,8 +915,8 @@ static inline int _send_ack(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
-int get_text_v4(socket_t *socket) {
-    if (get_text_v1(socket) != EXIT_SUCCESS) {
+static int _get_text_with_ack(socket_t *socket, int version) {
+    if (_get_text_common(socket, version) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
     if (_read_ack(socket) != EXIT_SUCCESS) {
@@ -836,6 +926,8 @@ int get_text_v4(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
+int get_text_v4(socket_t *socket) { return _get_text_with_ack(socket, 4); }
+
 int send_text_v4(socket_t *socket) { return _send_text_common(socket, 4); }
 
 int get_files_v4(socket_t *socket) {
@@ -854,50 +946,28 @@ int get_files_v4(socket_t *socket) {
 int send_files_v4(socket_t *socket) { return _send_files_dirs(4, socket); }
 
 int get_image_v4(socket_t *socket) {
-    if (get_image_v1(socket) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    }
-    if (_read_ack(socket) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    }
-    close_socket_no_wait(socket);
-    return EXIT_SUCCESS;
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    return _get_image_common(socket, IMG_ANY, &opts, 4);
 }
 
 int get_copied_image_v4(socket_t *socket) {
-    if (_get_image_common(socket, IMG_COPIED_ONLY, 0) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    }
-    if (_read_ack(socket) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    }
-    close_socket_no_wait(socket);
-    return EXIT_SUCCESS;
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    return _get_image_common(socket, IMG_COPIED_ONLY, &opts, 4);
 }
 
-int get_screenshot_v4(socket_t *socket) {
-    if (_get_screenshot_common(socket) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    }
-    if (_read_ack(socket) != EXIT_SUCCESS) {
-        return EXIT_FAILURE;
-    }
-    close_socket_no_wait(socket);
-    return EXIT_SUCCESS;
-}
+int get_screenshot_v4(socket_t *socket) { return _get_screenshot_common(socket, 4); }
 
-static inline int _get_any_text(socket_t *socket) {
-    uint32_t length = 0;
-    char *buf = NULL;
-    if (get_clipboard_text(&buf, &length) != EXIT_SUCCESS || length <= 0 ||
-        length > configuration.max_text_length) {  // do not change the order
+/*
+ * Send the text in buf of length bytes as the copied data of Get Any. Frees buf.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _send_any_text(socket_t *socket, char *buf, uint32_t length) {
+    if (length <= 0 || length > configuration.max_text_length) {
         write_sock(socket, &(char){STATUS_NO_DATA}, 1);
-        if (buf) {
-            free(buf);
-        }
+        free(buf);
         return EXIT_FAILURE;
     }
-    int64_t new_len = convert_eol(&buf, 1);
+    int64_t new_len = convert_eol(&buf, length, 1);
     if (new_len <= 0 || !buf) {
         write_sock(socket, &(char){STATUS_NO_DATA}, 1);
         return EXIT_FAILURE;
@@ -918,6 +988,19 @@ static inline int _get_any_text(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
+static inline int _get_any_text(socket_t *socket) {
+    uint32_t length = 0;
+    char *buf = NULL;
+    if (get_clipboard_text(&buf, &length) != EXIT_SUCCESS) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        if (buf) {
+            free(buf);
+        }
+        return EXIT_FAILURE;
+    }
+    return _send_any_text(socket, buf, length);
+}
+
 static inline int _respond_any_files(socket_t *socket, list2 *file_list, size_t path_len) {
     uint32_t file_cnt = file_list->len;
     char **files = (char **)file_list->array;
@@ -933,7 +1016,7 @@ static inline int _respond_any_files(socket_t *socket, list2 *file_list, size_t
     }
     for (uint32_t i = 0; i < file_cnt; i++) {
         const char *file_path = files[i];
-        if (_transfer_single_file(4, socket, file_path, path_len) != EXIT_SUCCESS) {
+        if (_transfer_single_file(4, socket, file_path, path_len, -1) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
             puts("Transfer failed");
 #endif
@@ -964,7 +1047,8 @@ static inline int _get_any_files(socket_t *socket) {
 static inline int _get_any_image(socket_t *socket) {
     uint32_t length = 0;
     char *buf = NULL;
-    if (get_image(&buf, &length, IMG_COPIED_ONLY, 0) != EXIT_SUCCESS || length == 0 ||
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    if (get_image(&buf, &length, IMG_COPIED_ONLY, &opts) != EXIT_SUCCESS || length == 0 ||
         length > MAX_IMAGE_SIZE) {  // do not change the order
         write_sock(socket, &(char){STATUS_NO_DATA}, 1);
         if (buf) {
@@ -988,9 +1072,24 @@ static inline int _get_any_image(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
-int get_any_v4(socket_t *socket) {
-    int8_t copied_type = get_copied_type();
+static int _get_any_common(socket_t *socket, int version) {
+    // read the type and the data of the copied content together, instead of reading the clipboard for each of them
     int res;
+    if (prefetch_copied_data() == CLIPBOARD_TIMEOUT) {
+        // the clipboard owner is not responding. So do not wait for it again to get the type and the data. The last
+        // known text is sent instead if it is kept, as with Get Text
+        char *buf = NULL;
+        uint32_t length = 0;
+        if (get_stale_text(&buf, &length) != EXIT_SUCCESS) {
+            write_sock(socket, &(char){_no_data_status(version, CLIPBOARD_TIMEOUT)}, 1);
+            return EXIT_FAILURE;
+        }
+        res = _send_any_text(socket, buf, length);
+        if (res == EXIT_SUCCESS) res = _read_ack(socket);
+        close_socket_no_wait(socket);
+        return res;
+    }
+    int8_t copied_type = get_copied_type();
     switch (copied_type) {
         case COPIED_TYPE_TEXT: {
             res = _get_any_text(socket);
@@ -1008,10 +1107,12 @@ int get_any_v4(socket_t *socket) {
         }
 
         default: {
+            clear_prefetched_data();
             write_sock(socket, &(char){STATUS_NO_DATA}, 1);
             return EXIT_FAILURE;
         }
     }
+    clear_prefetched_data();
     if (res == EXIT_SUCCESS) {
         res = _read_ack(socket);
     }
@@ -1019,7 +1120,9 @@ int get_any_v4(socket_t *socket) {
     return res;
 }
 
-int info_v4(socket_t *socket) {
+int get_any_v4(socket_t *socket) { return _get_any_common(socket, 4); }
+
+static int _info_common(socket_t *socket, int version) {
     char payload[4097] = INFO_NAME;
     size_t rem = sizeof(payload) - sizeof(INFO_NAME);
     char *ptr = payload + sizeof(INFO_NAME) - 1;
@@ -1031,6 +1134,18 @@ int info_v4(socket_t *socket) {
             rem -= len;
         }
     }
+#if PROTOCOL_MAX >= 5
+    char formats[64];
+    if (version >= 5 && get_image_format_names(formats, sizeof(formats)) == EXIT_SUCCESS) {
+        if (!snprintf_check(ptr, rem, "\nimage_formats=%s", formats)) {
+            size_t len = strnlen(ptr, rem);
+            ptr += len;
+            rem -= len;
+        }
+    }
+#else
+    (void)version;
+#endif
     *ptr = '\0';
 
     if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
@@ -1044,4 +1159,388 @@ int info_v4(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 
+int info_v4(socket_t *socket) { return _info_common(socket, 4); }
+
+#endif
+
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+
+/*
+ * Read the parameters block of a request.
+ * Parameters are sent as the length followed by "name=value" lines separated by '\n'.
+ * returns the null-terminated parameters block in a newly allocated buffer, or NULL on failure.
+ */
+static char *_read_params(socket_t *socket) {
+    int64_t length;
+    if (read_size(socket, &length) != EXIT_SUCCESS) return NULL;
+    if (length < 0 || length > MAX_PARAMS_LEN) {
+#ifdef DEBUG_MODE
+        printf("Invalid params length %" PRIi64 "\n", length);
+#endif
+        return NULL;
+    }
+    char *params = malloc((size_t)length + 1);
+    if (!params) return NULL;
+    if (length > 0 && read_sock(socket, params, (uint64_t)length) != EXIT_SUCCESS) {
+        free(params);
+        return NULL;
+    }
+    params[length] = 0;
+    return params;
+}
+
+/*
+ * Get the next parameter from the parameters block *params_p and advance *params_p past it.
+ * Lines without a '=' are skipped.
+ * returns the name of the parameter and sets *value_p to its value, or returns NULL if there are no more parameters.
+ */
+static char *_next_param(char **params_p, char **value_p) {
+    char *line;
+    while ((line = strsep(params_p, "\n"))) {
+        char *value = strchr(line, '=');
+        if (!value) continue;
+        *value = 0;
+        *value_p = value + 1;
+        return line;
+    }
+    return NULL;
+}
+
+static void _set_image_formats(img_options *opts, char *names) {
+    const char *name;
+    while ((name = strsep(&names, ",")) && opts->format_cnt < MAX_IMG_FORMATS) {
+        uint8_t format = image_format_from_name(name);
+        if (format) opts->formats[opts->format_cnt++] = format;
+    }
+}
+
+static void _set_display_param(img_options *opts, const char *value) {
+    if (!strcmp(value, "all")) {
+        opts->disp = DISPLAY_ALL;
+        return;
+    }
+    long disp = strtol(value, NULL, 10);
+    opts->disp = (disp <= 0 || disp > 65535L) ? 0 : (uint16_t)disp;
+}
+
+/*
+ * Set the region parameter of opts given by its name.
+ * returns 1 if the value is valid or the name is not a region parameter, or 0 if the value is not valid.
+ */
+static int _set_region_param(img_options *opts, const char *name, const char *value) {
+    uint16_t *field;
+    if (!strcmp(name, "x")) {
+        field = &(opts->region_x);
+    } else if (!strcmp(name, "y")) {
+        field = &(opts->region_y);
+    } else if (!strcmp(name, "width")) {
+        field = &(opts->region_width);
+    } else if (!strcmp(name, "height")) {
+        field = &(opts->region_height);
+    } else {
+        return 1;
+    }
+    char *end;
+    const long num = strtol(value, &end, 10);
+    if (end == value || *end || num < 0 || num > 65535L) return 0;
+    *field = (uint16_t)num;
+    return 1;
+}
+
+/*
+ * Read the parameters of an image request into opts. Unknown parameters are ignored. Region parameters are read only
+ * if with_region is set. An empty region is set if any of them is not valid.
+ * Sets *chunked_p to 1 if the client requests the image in chunks, or 0 otherwise.
+ */
+static int _read_image_params(socket_t *socket, img_options *opts, int with_region, int *chunked_p) {
+    char *params = _read_params(socket);
+    if (!params) return EXIT_FAILURE;
+    char *rest = params;
+    char *value;
+    const char *name;
+    int region_valid = 1;
+    while ((name = _next_param(&rest, &value))) {
+        if (!strcmp(name, "display")) {
+            _set_display_param(opts, value);
+        } else if (!strcmp(name, "formats")) {
+            opts->format_cnt = 0;
+            _set_image_formats(opts, value);
+        } else if (!strcmp(name, "chunked")) {
+            *chunked_p = !strcmp(value, "1");
+        } else if (!set_scale_option(opts, name, value) && with_region) {
+            if (!_set_region_param(opts, name, value)) region_valid = 0;
+        }
+    }
+    free(params);
+    if (!region_valid) {
+        opts->region_width = 0;
+        opts->region_height = 0;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * State of data sent in chunks. The status, and the format if the data is an image, are sent before the first chunk.
+ */
+typedef struct _chunk_writer {
+    socket_t *socket;
+    const img_options *opts; /* options of the image, or NULL if the data is not an image */
+    uint64_t max_len;        /* maximum number of bytes that can be sent */
+    int8_t started;
+    uint64_t sent; /* number of bytes sent */
+} chunk_writer;
+
+/*
+ * Send a part of the data as a chunk. This is the data_write_fn of data sent in chunks.
+ */
+static int _send_chunk(void *arg, const char *data, size_t len) {
+    chunk_writer *writer = (chunk_writer *)arg;
+    if (len == 0) return EXIT_SUCCESS;
+    if (len > writer->max_len - writer->sent) return EXIT_FAILURE;
+    if (!writer->started) {
+        if (write_sock(writer->socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS ||
+            (writer->opts && write_sock(writer->socket, (const char *)&(writer->opts->format), 1) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+        writer->started = 1;
+    }
+    if (_send_data(writer->socket, (int64_t)len, data) != EXIT_SUCCESS) return EXIT_FAILURE;
+    writer->sent += len;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * End the data sent in chunks with the empty chunk and read the acknowledgement, given the status of sending the data.
+ * The status NO_DATA, or TIMEOUT if the clipboard owner did not respond in time, is sent instead if no chunk was sent.
+ * The connection is closed without the empty chunk if the data could not be sent completely.
+ */
+static int _end_chunks(const chunk_writer *writer, int status) {
+    socket_t *socket = writer->socket;
+    if (!writer->started) {
+        write_sock(socket, &(char){_no_data_status(5, status)}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_FAILURE;
+    }
+    if (status != EXIT_SUCCESS || send_size(socket, 0) != EXIT_SUCCESS || _read_ack(socket) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    close_socket_no_wait(socket);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Send the image in chunks terminated by an empty chunk. Screenshots and copied images are sent while they are encoded
+ * or read from the clipboard if possible, so that the size of the image need not be known before sending it. Other
+ * images are sent as a single chunk.
+ */
+static int _get_image_chunked(socket_t *socket, int mode, img_options *opts) {
+    chunk_writer writer = {.socket = socket, .opts = opts, .max_len = MAX_IMAGE_SIZE, .started = 0, .sent = 0};
+    opts->write = _send_chunk;
+    opts->write_arg = &writer;
+    uint32_t length = 0;
+    char *buf = NULL;
+    int status = get_image(&buf, &length, mode, opts);
+    if (status == EXIT_SUCCESS && !opts->written) {
+        status = (length > 0 && buf) ? _send_chunk(&writer, buf, length) : EXIT_FAILURE;
+    }
+    if (buf) free(buf);
+#ifdef DEBUG_MODE
+    if (!writer.started) puts("get image failed");
+#endif
+    return _end_chunks(&writer, status);
+}
+
+static int _get_image_v5_common(socket_t *socket, int mode, int with_region) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    int chunked = 0;
+    if (_read_image_params(socket, &opts, with_region, &chunked) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (with_region && (opts.region_width == 0 || opts.region_height == 0)) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_FAILURE;
+    }
+    if (chunked) return _get_image_chunked(socket, mode, &opts);
+    return _get_image_common(socket, mode, &opts, 5);
+}
+
+int get_text_chunked_v5(socket_t *socket) {
+    chunk_writer writer = {.socket = socket, .opts = NULL, .max_len = configuration.max_text_length};
+    const int status = stream_clipboard_text(_send_chunk, &writer);
+#ifdef DEBUG_MODE
+    printf("Sent text length = %" PRIu64 "\n", writer.sent);
+#endif
+    return _end_chunks(&writer, status);
+}
+
+int get_text_v5(socket_t *socket) { return _get_text_with_ack(socket, 5); }
+
+int get_image_v5(socket_t *socket) { return _get_image_v5_common(socket, IMG_ANY, 0); }
+
+int get_copied_image_v5(socket_t *socket) {
+    // copied images are sent as they are in the clipboard. So there are no parameters to read
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    return _get_image_common(socket, IMG_COPIED_ONLY, &opts, 5);
+}
+
+int get_screenshot_v5(socket_t *socket) { return _get_image_v5_common(socket, IMG_SCRN_ONLY, 0); }
+
+int get_screenshot_region_v5(socket_t *socket) { return _get_image_v5_common(socket, IMG_SCRN_ONLY, 1); }
+
+/*
+ * Read the parameters of a screen stream request into opts and *fps_p. Unknown parameters are ignored. The frame rate
+ * is limited to MAX_STREAM_FPS. An empty region is set if any of the region parameters is not valid.
+ */
+static int _read_stream_params(socket_t *socket, img_options *opts, uint32_t *fps_p) {
+    char *params = _read_params(socket);
+    if (!params) return EXIT_FAILURE;
+    char *rest = params;
+    char *value;
+    const char *name;
+    int region_valid = 1;
+    while ((name = _next_param(&rest, &value))) {
+        if (!strcmp(name, "display")) {
+            _set_display_param(opts, value);
+        } else if (!strcmp(name, "fps")) {
+            long fps = strtol(value, NULL, 10);
+            if (fps > 0) *fps_p = fps > MAX_STREAM_FPS ? MAX_STREAM_FPS : (uint32_t)fps;
+        } else if (!_set_region_param(opts, name, value)) {
+            region_valid = 0;
+        }
+    }
+    free(params);
+    if (!region_valid || (opts->region_width > 0) != (opts->region_height > 0)) {
+        opts->region_width = 0;
+        opts->region_height = 0;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Capture the next frame of the stream and send the tiles that changed since the previous frame.
+ * Sets the number of bytes sent to *size_p, and the time spent on sending them to *nanos_p. The time excludes waiting
+ * for the frame interval, capturing and encoding.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _send_frame(socket_t *socket, screen_stream *stream, size_t *size_p, uint64_t *nanos_p) {
+    frame_tile *tiles;
+    uint32_t tile_cnt;
+    if (next_screen_frame(stream, &tiles, &tile_cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
+    const uint64_t start = get_time_ns();
+    int status = send_size(socket, (int64_t)tile_cnt);
+    size_t size = 8;
+    for (uint32_t i = 0; i < tile_cnt && status == EXIT_SUCCESS; i++) {
+        if (send_size(socket, tiles[i].x) != EXIT_SUCCESS || send_size(socket, tiles[i].y) != EXIT_SUCCESS ||
+            _send_data(socket, (int64_t)tiles[i].len, tiles[i].data) != EXIT_SUCCESS) {
+            status = EXIT_FAILURE;
+        }
+        size += 24 + (size_t)tiles[i].len;
+    }
+    *nanos_p = get_time_ns() - start;
+    free_frame_tiles(tiles, tile_cnt);
+    *size_p = size;
+    return status;
+}
+
+int stream_screenshots_v5(socket_t *socket) {
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    img_options opts = {.disp = 0, .format_cnt = 0};
+    uint32_t fps = DEFAULT_STREAM_FPS;
+    int status = _read_stream_params(socket, &opts, &fps);
+    uint16_t width = 0;
+    uint16_t height = 0;
+    screen_stream *stream = status == EXIT_SUCCESS ? open_screen_stream(&opts, fps, &width, &height) : NULL;
+    if (!stream) {
+#ifdef DEBUG_MODE
+        puts("Open screen stream failed");
+#endif
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_FAILURE;
+    }
+    if (write_sock(socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS || send_size(socket, width) != EXIT_SUCCESS ||
+        send_size(socket, height) != EXIT_SUCCESS) {
+        close_screen_stream(stream);
+        return EXIT_FAILURE;
+    }
+
+    // the client acknowledges each frame with STATUS_OK to get the next frame, or any other status to stop the stream
+    char ack = STATUS_OK;
+    while (ack == STATUS_OK) {
+        size_t size;
+        uint64_t nanos;
+        if (_send_frame(socket, stream, &size, &nanos) != EXIT_SUCCESS || read_sock(socket, &ack, 1) != EXIT_SUCCESS) {
+            close_screen_stream(stream);
+            return EXIT_FAILURE;
+        }
+        if (size > 8) record_image_send(size, nanos);
+    }
+    close_screen_stream(stream);
+    close_socket_no_wait(socket);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * State of a Get Files response, of which the files are sent as the directory walk finds them.
+ */
+typedef struct _files_stream {
+    socket_t *socket;
+    uint32_t file_cnt; /* number of files sent so far */
+    int8_t responded;  /* whether writing the status of the response was attempted */
+} files_stream;
+
+static int _stream_file(void *arg, const char *path, size_t path_len, int64_t size) {
+    files_stream *stream = (files_stream *)arg;
+    if (stream->file_cnt >= configuration.max_file_count) {
+        error("Too many files to send");
+        return EXIT_FAILURE;
+    }
+    if (!stream->responded) {  // the response starts with the first file. The file count is not known yet
+        stream->responded = 1;
+        if (write_sock(stream->socket, &(char){STATUS_OK}, 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+        if (send_size(stream->socket, -1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+    stream->file_cnt++;
+#ifdef DEBUG_MODE
+    printf("file name = %s\n", path);
+#endif
+    return _transfer_single_file(5, stream->socket, path, path_len, size);
+}
+
+int get_files_v5(socket_t *socket) {
+    files_stream stream = {.socket = socket, .file_cnt = 0, .responded = 0};
+    int status = walk_copied_dirs_files(1, _stream_file, &stream);
+    if (!stream.responded) {
+        write_sock(socket, &(char){STATUS_NO_DATA}, 1);
+        close_socket_no_wait(socket);
+        return EXIT_FAILURE;
+    }
+    if (status != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        puts("Transfer failed");
+#endif
+        return EXIT_FAILURE;
+    }
+    // a file name length of 0 marks the end of the files
+    if (send_size(socket, 0) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if (_read_ack(socket) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    close_socket_no_wait(socket);
+    return EXIT_SUCCESS;
+}
+
+int get_any_v5(socket_t *socket) { return _get_any_common(socket, 5); }
+
+int info_v5(socket_t *socket) { return _info_common(socket, 5); }
+
 #endif
@@ -46,7 +46,7 @@ extern int get_screenshot_v3(socket_t *socket);
 #endif
 
 // Version 4 methods
-#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (4 <= PROTOCOL_MAX)
 extern int get_text_v4(socket_t *socket);
 extern int send_text_v4(socket_t *socket);
 extern int get_files_v4(socket_t *socket);
@@ -58,4 +58,18 @@ extern int get_any_v4(socket_t *socket);
 extern int info_v4(socket_t *socket);
 #endif
 
+// Version 5 methods
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+extern int get_text_v5(socket_t *socket);
+extern int get_text_chunked_v5(socket_t *socket);
+extern int get_files_v5(socket_t *socket);
+extern int get_image_v5(socket_t *socket);
+extern int get_copied_image_v5(socket_t *socket);
+extern int get_screenshot_v5(socket_t *socket);
+extern int get_screenshot_region_v5(socket_t *socket);
+extern int stream_screenshots_v5(socket_t *socket);
+extern int get_any_v5(socket_t *socket);
+extern int info_v5(socket_t *socket);
+#endif
+
 #endif  // PROTO_METHODS_H_
@@ -102,6 +102,12 @@ void server(socket_t *socket) {
             version_4(socket);
             break;
         }
+#endif
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+        case 5: {
+            version_5(socket);
+            break;
+        }
 #endif
         default:  // invalid or unknown version
             break;
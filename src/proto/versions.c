@@ -32,6 +32,9 @@
 #define METHOD_GET_IMAGE 5
 #define METHOD_GET_COPIED_IMAGE 6
 #define METHOD_GET_SCREENSHOT 7
+#define METHOD_GET_SCREENSHOT_REGION 8
+#define METHOD_STREAM_SCREENSHOTS 9
+#define METHOD_GET_TEXT_CHUNKED 10
 #define METHOD_GET_ANY 124
 #define METHOD_INFO 125
 
@@ -42,7 +45,8 @@
 static int check_method_enabled(socket_t *socket, int method) {
     char disabled = 0;
     switch (method) {
-        case METHOD_GET_TEXT: {
+        case METHOD_GET_TEXT:
+        case METHOD_GET_TEXT_CHUNKED: {
             if (!configuration.method_enabled.get_text) disabled = 1;
             break;
         }
@@ -66,7 +70,9 @@ static int check_method_enabled(socket_t *socket, int method) {
             if (!configuration.method_enabled.get_copied_image) disabled = 1;
             break;
         }
-        case METHOD_GET_SCREENSHOT: {
+        case METHOD_GET_SCREENSHOT:
+        case METHOD_GET_SCREENSHOT_REGION:
+        case METHOD_STREAM_SCREENSHOTS: {
             if (!configuration.method_enabled.get_screenshot) disabled = 1;
             break;
         }
@@ -276,3 +282,62 @@ int version_4(socket_t *socket) {
     return EXIT_SUCCESS;
 }
 #endif
+
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+
+int version_5(socket_t *socket) {
+    unsigned char method;
+    if (read_sock(socket, (char *)&method, 1) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    if (check_method_enabled(socket, method) != EXIT_SUCCESS) {
+        return EXIT_SUCCESS;
+    }
+
+    switch (method) {
+        case METHOD_GET_TEXT: {
+            return get_text_v5(socket);
+        }
+        case METHOD_SEND_TEXT: {
+            return send_text_v4(socket);
+        }
+        case METHOD_GET_FILE: {
+            return get_files_v5(socket);
+        }
+        case METHOD_SEND_FILE: {
+            return send_files_v4(socket);
+        }
+        case METHOD_GET_IMAGE: {
+            return get_image_v5(socket);
+        }
+        case METHOD_GET_COPIED_IMAGE: {
+            return get_copied_image_v5(socket);
+        }
+        case METHOD_GET_SCREENSHOT: {
+            return get_screenshot_v5(socket);
+        }
+        case METHOD_GET_SCREENSHOT_REGION: {
+            return get_screenshot_region_v5(socket);
+        }
+        case METHOD_STREAM_SCREENSHOTS: {
+            return stream_screenshots_v5(socket);
+        }
+        case METHOD_GET_TEXT_CHUNKED: {
+            return get_text_chunked_v5(socket);
+        }
+        case METHOD_GET_ANY: {
+            return get_any_v5(socket);
+        }
+        case METHOD_INFO: {
+            return info_v5(socket);
+        }
+        default: {  // unknown method
+            write_sock(socket, &(char){STATUS_UNKNOWN_METHOD}, 1);
+            close_socket_no_wait(socket);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+#endif
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <utils/config.h>
+#include <utils/img_scale.h>
 #include <utils/net_utils.h>
 #include <utils/utils.h>
 
@@ -40,10 +41,27 @@ extern char blob_page[];
 extern int blob_size_page;
 
 static int say(const char *, socket_t *);
+static void read_img_query(char *, img_options *);
 static void receiver_web(socket_t *);
 
 static int say(const char *msg, socket_t *sock) { return write_sock(sock, msg, strlen(msg)); }
 
+/*
+ * Set the scaling options of the image from the name=value pairs in the query string.
+ */
+static void read_img_query(char *query, img_options *opts) {
+    while (query && *query) {
+        char *next = strchr(query, '&');
+        if (next) *(next++) = '\0';
+        char *value = strchr(query, '=');
+        if (value) {
+            *(value++) = '\0';
+            set_scale_option(opts, query, value);
+        }
+        query = next;
+    }
+}
+
 static void receiver_web(socket_t *sock) {
     char method[8];
     int ind = 0;
@@ -66,6 +84,8 @@ static void receiver_web(socket_t *sock) {
 #ifdef DEBUG_MODE
     puts(path);
 #endif
+    char *query = strchr(path, '?');
+    if (query) *(query++) = '\0';
 
     if (!strcmp(method, "GET")) {
         char buf[128];
@@ -88,6 +108,12 @@ static void receiver_web(socket_t *sock) {
                 say("HTTP/1.0 500 Internal Server Error\r\n\r\n", sock);
                 return;
             }
+            int64_t new_len = convert_eol(&clip_buf, len, 1);
+            if (new_len <= 0 || !clip_buf) {
+                say("HTTP/1.0 500 Internal Server Error\r\n\r\n", sock);
+                return;
+            }
+            len = (uint32_t)new_len;
             if (say("HTTP/1.0 200 OK\r\n", sock) != EXIT_SUCCESS) return;
             if (say("Content-Type: text/plain; charset=utf-8\r\n", sock) != EXIT_SUCCESS) return;
             char tmp[64];
@@ -98,7 +124,9 @@ static void receiver_web(socket_t *sock) {
         } else if (!strcmp(path, "/img")) {
             uint32_t len = 0;
             char *clip_buf;
-            if (get_image(&clip_buf, &len, IMG_ANY, 0) != EXIT_SUCCESS || len <= 0) {
+            img_options opts = {.disp = 0, .format_cnt = 0};
+            read_img_query(query, &opts);
+            if (get_image(&clip_buf, &len, IMG_ANY, &opts) != EXIT_SUCCESS || len <= 0) {
                 say("HTTP/1.0 404 Not Found\r\n\r\n", sock);
                 return;
             }
@@ -64,7 +64,7 @@ static inline void trim(char *str) {
 static inline list2 *get_client_list(const char *filename) {
     FILE *f = fopen(filename, "r");
     if (!f) error_exit("Error: allowed client list file not found");
-    list2 *client_list = init_list(1);
+    list2 *client_list = init_str_list(1);
     if (!client_list) {
         exit(EXIT_FAILURE);
     }
@@ -81,7 +81,7 @@ static inline list2 *get_client_list(const char *filename) {
         len = strnlen(client, 512);  // string length may have been reduced after trim()
         if (len < 1) continue;
         if (client[0] == '#') continue;
-        append(client_list, strdup(client));
+        append_str(client_list, client, len);
     }
     fclose(f);
     if (has_error) {
@@ -248,6 +248,55 @@ static inline void set_uint16(const char *str, uint16_t *conf_ptr) {
     *conf_ptr = (uint16_t)value;
 }
 
+/*
+ * str must be a valid, non-empty, and null-terminated string
+ * conf_ptr must be a valid pointer to an 8-bit integer
+ * Sets the value pointed by conf_ptr to the index of str in the array names of cnt elements. Names are compared case
+ * insensitively. Exits with an error if str is not in names.
+ */
+static inline void set_name_index(const char *str, const char *const *names, int8_t cnt, int8_t *conf_ptr) {
+    for (int8_t i = 0; i < cnt; i++) {
+        if (!strcasecmp(names[i], str)) {
+            *conf_ptr = i;
+            return;
+        }
+    }
+    error_exit("Error: invalid config value");
+}
+
+/*
+ * str must be a valid, non-empty, and null-terminated string
+ * conf_ptr must be a valid pointer to an 8-bit integer
+ * Sets the value pointed by conf_ptr to the PNG compression level given as a digit 0-9 in str, or to PNG_LEVEL_AUTO if
+ * str is "auto". Exits with an error otherwise.
+ */
+static inline void set_png_level(const char *str, int8_t *conf_ptr) {
+    if (!strcasecmp("auto", str)) {
+        *conf_ptr = PNG_LEVEL_AUTO;
+    } else if ('0' <= str[0] && str[0] <= '9' && str[1] == '\0') {
+        *conf_ptr = (int8_t)(str[0] - '0');
+    } else {
+        error_exit("Error: invalid PNG compression level");
+    }
+}
+
+/*
+ * str must be a valid, non-empty, and null-terminated string
+ * conf_ptr must be a valid pointer to an unsigned int
+ * Sets the value pointed by conf_ptr to the timeout in milliseconds given in str, or to CLIPBOARD_TIMEOUT_NONE if str
+ * is "none". Exits with an error otherwise, including for a timeout of 0.
+ */
+static inline void set_clipboard_timeout(const char *str, uint32_t *conf_ptr) {
+    if (!strcasecmp("none", str)) {
+        *conf_ptr = CLIPBOARD_TIMEOUT_NONE;
+        return;
+    }
+    uint32_t timeout;
+    set_uint32(str, &timeout);
+    if (timeout == 0) error_exit("Error: clipboard_timeout must be positive or none");
+    *conf_ptr = timeout;
+}
+
 static inline int validate_name(const char *name) {
     for (unsigned i = 0; i <= 256; i++) {
         char c = name[i];
@@ -343,10 +392,28 @@ static void parse_line(char *line, config *cfg) {
         set_uint32(value, &(cfg->max_file_count));
     } else if (!strcmp("cut_sent_files", key)) {
         set_is_true(value, &(cfg->cut_sent_files));
+    } else if (!strcmp("file_sync", key)) {
+        // in the order of FILE_SYNC_* values
+        const char *const modes[] = {"none", "per-transfer", "per-file"};
+        set_name_index(value, modes, 3, &(cfg->file_sync));
+    } else if (!strcmp("clipboard_timeout", key)) {
+        set_clipboard_timeout(value, &(cfg->clipboard_timeout));
+    } else if (!strcmp("serve_stale_text", key)) {
+        set_is_true(value, &(cfg->serve_stale_text));
     } else if (!strcmp("client_selects_display", key)) {
         set_is_true(value, &(cfg->client_selects_display));
     } else if (!strcmp("display", key)) {
         set_uint16(value, &(cfg->display));
+    } else if (!strcmp("png_compression_level", key)) {
+        set_png_level(value, &(cfg->png.level));
+    } else if (!strcmp("png_compression_strategy", key)) {
+        // in the order of zlib strategy values
+        const char *const strategies[] = {"default", "filtered", "huffman", "rle", "fixed"};
+        set_name_index(value, strategies, 5, &(cfg->png.strategy));
+    } else if (!strcmp("png_filter", key)) {
+        // in the order of PNG filter types followed by PNG_FILTER_ADAPTIVE
+        const char *const filters[] = {"none", "sub", "up", "average", "paeth", "adaptive"};
+        set_name_index(value, filters, 6, &(cfg->png.filter));
     } else if (!strcmp("min_proto_version", key)) {
         set_uint16(value, &(cfg->min_proto_version));
     } else if (!strcmp("max_proto_version", key)) {
@@ -415,9 +482,16 @@ void parse_conf(config *cfg, const char *file_name) {
     cfg->max_file_size = 0;
     cfg->max_file_count = 0;
     cfg->cut_sent_files = -1;
+    cfg->file_sync = -1;
+    cfg->clipboard_timeout = 0;
+    cfg->serve_stale_text = -1;
     cfg->client_selects_display = -1;
     cfg->display = 0;
 
+    cfg->png.level = -1;
+    cfg->png.strategy = -1;
+    cfg->png.filter = -1;
+
     cfg->min_proto_version = 0;
     cfg->max_proto_version = 0;
 
@@ -24,6 +24,20 @@
 #include <utils/list_utils.h>
 #include <utils/net_utils.h>
 
+// png_compression_level value to select the level from the measured encoding speed and link bandwidth
+#define PNG_LEVEL_AUTO 10
+
+// png_filter value to select the filter of each row adaptively. Values 0 to 4 are PNG filter types
+#define PNG_FILTER_ADAPTIVE 5
+
+// clipboard_timeout value to wait for the clipboard owner without a time limit
+#define CLIPBOARD_TIMEOUT_NONE 0xFFFFFFFFUL
+
+// file_sync values, which select when received files are synced to the storage
+#define FILE_SYNC_NONE 0
+#define FILE_SYNC_TRANSFER 1
+#define FILE_SYNC_FILE 2
+
 typedef struct _data_buffer {
     int32_t len;
     char *data;
@@ -60,9 +74,18 @@ typedef struct _config {
     uint32_t max_file_count;
 
     int8_t cut_sent_files;
+    int8_t file_sync; /* one of FILE_SYNC_NONE, FILE_SYNC_TRANSFER, or FILE_SYNC_FILE */
+    uint32_t clipboard_timeout; /* milliseconds to wait for the clipboard owner, or CLIPBOARD_TIMEOUT_NONE */
+    int8_t serve_stale_text;
     int8_t client_selects_display;
     uint16_t display;
 
+    struct {
+        int8_t level;    /* zlib compression level 0-9 or PNG_LEVEL_AUTO */
+        int8_t strategy; /* zlib compression strategy */
+        int8_t filter;   /* PNG filter type or PNG_FILTER_ADAPTIVE */
+    } png;
+
     uint16_t min_proto_version;
     uint16_t max_proto_version;
 
@@ -0,0 +1,387 @@
+/*
+ * utils/dir_cache.c - create received files relative to cached directories
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE  // for sync_file_range() and syncfs()
+#endif
+
+#include <globals.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/config.h>
+#include <utils/dir_cache.h>
+#include <utils/utils.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_OPEN_DIRS 64  // directories deeper than this are opened only while they are used
+#elif defined(_WIN32)
+#include <io.h>
+#include <utils/list_utils.h>
+#endif
+
+/*
+ * Find the next component of the first end bytes of path, starting from *pos_p. Empty and . components are skipped.
+ * Sets *pos_p to the start of the component, and *len_p to its length, which is 0 if there are no more components.
+ * returns EXIT_FAILURE if the component is .., or EXIT_SUCCESS otherwise.
+ */
+static int _next_component(const char *path, size_t end, size_t *pos_p, size_t *len_p) {
+    size_t pos = *pos_p;
+    size_t len;
+    while (1) {
+        while (pos < end && path[pos] == PATH_SEP) pos++;
+        len = 0;
+        while (pos + len < end && path[pos + len] != PATH_SEP) len++;
+        if (len != 1 || path[pos] != '.') break;
+        pos++;
+    }
+    *pos_p = pos;
+    *len_p = len;
+    if (len == 2 && path[pos] == '.' && path[pos + 1] == '.') return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Get the name of the file at path, which is after the last PATH_SEP.
+ * returns the name, or NULL if the path is too long or the name is empty, . or ..
+ */
+static const char *_base_name(const char *path) {
+    if (strnlen(path, MAX_FILE_NAME_LEN + 1) > MAX_FILE_NAME_LEN) {
+        error("Too long file name.");
+        return NULL;
+    }
+    const char *base_name = strrchr(path, PATH_SEP);
+    base_name = base_name ? base_name + 1 : path;
+    if (!(base_name[0] && strcmp(base_name, ".") && strcmp(base_name, ".."))) return NULL;
+    return base_name;
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+
+/*
+ * Sync the file or directory of fd to the storage.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE otherwise.
+ */
+static int _sync_fd(int fd) {
+#ifdef __APPLE__
+    // fsync() on macOS does not flush the cache of the drive
+    if (!fcntl(fd, F_FULLFSYNC)) return EXIT_SUCCESS;
+#endif
+    return fsync(fd) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+struct _dir_cache {
+    int fds[MAX_OPEN_DIRS];           /* fds[0] is the root, and fds[i] is the directory at the first i components */
+    size_t ends[MAX_OPEN_DIRS];       /* ends[i] is the end of the i th component in path, and ends[0] is 0 */
+    uint32_t depth;                   /* number of open directories, including the root */
+    char path[MAX_FILE_NAME_LEN + 1]; /* components of the open directories, separated by PATH_SEP */
+};
+
+dir_cache *open_dir_cache(const char *root) {
+    dir_cache *cache = malloc(sizeof(dir_cache));
+    if (!cache) return NULL;
+    cache->fds[0] = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cache->fds[0] < 0) {
+#ifdef DEBUG_MODE
+        printf("Error opening directory %s\n", root);
+#endif
+        free(cache);
+        return NULL;
+    }
+    cache->ends[0] = 0;
+    cache->depth = 1;
+    return cache;
+}
+
+void close_dir_cache(dir_cache *cache) {
+    while (cache->depth > 0) {
+        close(cache->fds[--(cache->depth)]);
+    }
+    free(cache);
+}
+
+/*
+ * Open the directory at the first dir_len bytes of path, creating missing directories. The directories on the way are
+ * kept open in the cache in place of those of the previous path that are not on the way. Directories deeper than
+ * MAX_OPEN_DIRS are not kept, and *close_p is set to 1 if the returned directory must be closed by the caller.
+ * returns the file descriptor of the directory, or -1 on error.
+ */
+static int _open_dir(dir_cache *cache, const char *path, size_t dir_len, int *close_p) {
+    *close_p = 0;
+    size_t pos = 0;
+    size_t len;
+    // the open directories that are the same as the leading components of the path are used as they are
+    uint32_t level = 1;
+    while (level < cache->depth) {
+        if (_next_component(path, dir_len, &pos, &len) != EXIT_SUCCESS) return -1;
+        if (len == 0) break;
+        const size_t start = level == 1 ? 0 : cache->ends[level - 1] + 1;
+        if (cache->ends[level] - start != len || memcmp(cache->path + start, path + pos, len)) break;
+        pos += len;
+        level++;
+    }
+    while (cache->depth > level) {
+        close(cache->fds[--(cache->depth)]);
+    }
+
+    int fd = cache->fds[level - 1];
+    while (1) {
+        if (_next_component(path, dir_len, &pos, &len) != EXIT_SUCCESS) break;
+        if (len == 0) return fd;
+        char name[MAX_FILE_NAME_LEN + 1];  // the path is not longer than MAX_FILE_NAME_LEN
+        memcpy(name, path + pos, len);
+        name[len] = 0;
+        pos += len;
+        if (!mkdirat(fd, name, S_IRWXU | S_IRWXG)) {
+            // entries in the new directory are synced as they are created. Its own entry in the parent is synced here
+            if (configuration.file_sync == FILE_SYNC_FILE && _sync_fd(fd) != EXIT_SUCCESS) break;
+        } else if (errno != EEXIST) {
+#ifdef DEBUG_MODE
+            printf("Error creating directory %s\n", name);
+#endif
+            break;
+        }
+        // symbolic links are not followed. So an existing link is not used as a directory
+        const int sub_fd = openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (*close_p) close(fd);
+        if (sub_fd < 0) return -1;
+        fd = sub_fd;
+        if (*close_p || cache->depth >= MAX_OPEN_DIRS) {
+            *close_p = 1;
+            continue;
+        }
+        const uint32_t depth = cache->depth;
+        const size_t start = depth == 1 ? 0 : cache->ends[depth - 1] + 1;
+        if (start > 0) cache->path[start - 1] = PATH_SEP;
+        memcpy(cache->path + start, name, len);
+        cache->ends[depth] = start + len;
+        cache->fds[depth] = fd;
+        cache->depth++;
+    }
+    if (*close_p) close(fd);
+    return -1;
+}
+
+int make_dirs_at(dir_cache *cache, const char *path) {
+    const size_t len = strnlen(path, MAX_FILE_NAME_LEN + 1);
+    if (len > MAX_FILE_NAME_LEN) {
+        error("Too long file name.");
+        return EXIT_FAILURE;
+    }
+    int close_dir;
+    const int fd = _open_dir(cache, path, len, &close_dir);
+    if (fd < 0) return EXIT_FAILURE;
+    if (close_dir) close(fd);
+    return EXIT_SUCCESS;
+}
+
+FILE *create_file_at(dir_cache *cache, const char *path) {
+    const char *base_name = _base_name(path);
+    if (!base_name) return NULL;
+    int close_dir;
+    const int dir_fd = _open_dir(cache, path, (size_t)(base_name - path), &close_dir);
+    if (dir_fd < 0) return NULL;
+    // O_EXCL fails if anything exists at the path. So there is no need to check that separately
+    const int fd = openat(dir_fd, base_name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                          S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+    if (fd >= 0 && configuration.file_sync == FILE_SYNC_FILE) {
+        (void)_sync_fd(dir_fd);  // the entry of the new file. Its data is synced by close_file_at()
+    }
+    if (close_dir) close(dir_fd);
+    if (fd < 0) return NULL;
+    FILE *file = fdopen(fd, "wb");
+    if (!file) close(fd);
+    return file;
+}
+
+int close_file_at(dir_cache *cache, FILE *file) {
+    (void)cache;
+    int status = fflush(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (status == EXIT_SUCCESS) {
+        switch (configuration.file_sync) {
+            case FILE_SYNC_FILE: {
+                status = _sync_fd(fileno(file));
+                break;
+            }
+            case FILE_SYNC_TRANSFER: {
+#ifdef __linux__
+                // start writing the data now without waiting. So little is left to write by syncfs() in the end
+                (void)sync_file_range(fileno(file), 0, 0, SYNC_FILE_RANGE_WRITE);
+#else
+                // write the data to the drive without flushing the cache of the drive, which is flushed once in the end
+                if (fsync(fileno(file))) status = EXIT_FAILURE;
+#endif
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+    if (fclose(file)) status = EXIT_FAILURE;
+    return status;
+}
+
+int sync_dir_cache(dir_cache *cache) {
+    if (configuration.file_sync != FILE_SYNC_TRANSFER) return EXIT_SUCCESS;
+#ifdef __linux__
+    // one sync of the file system in place of syncing each file and directory
+    return syncfs(cache->fds[0]) ? EXIT_FAILURE : EXIT_SUCCESS;
+#else
+    // the files were written to the drive when they were closed. So the cache of the drive is flushed once for all
+    return _sync_fd(cache->fds[0]);
+#endif
+}
+
+int sync_directory(const char *path) {
+    if (configuration.file_sync == FILE_SYNC_NONE) return EXIT_SUCCESS;
+    const int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return EXIT_FAILURE;
+    const int status = _sync_fd(fd);
+    close(fd);
+    return status;
+}
+
+int remove_file_at(dir_cache *cache, const char *path) {
+    const char *base_name = _base_name(path);
+    if (!base_name) return EXIT_FAILURE;
+    int close_dir;
+    const int dir_fd = _open_dir(cache, path, (size_t)(base_name - path), &close_dir);
+    if (dir_fd < 0) return EXIT_FAILURE;
+    const int status = unlinkat(dir_fd, base_name, 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (close_dir) close(dir_fd);
+    return status;
+}
+
+#elif defined(_WIN32)
+
+struct _dir_cache {
+    char *root;
+    list2 *files; /* full paths of the files created, which are synced together in per-transfer mode */
+};
+
+dir_cache *open_dir_cache(const char *root) {
+    dir_cache *cache = malloc(sizeof(dir_cache));
+    if (!cache) return NULL;
+    cache->root = strdup(root);
+    cache->files = configuration.file_sync == FILE_SYNC_TRANSFER ? init_str_list(8) : NULL;
+    if (!cache->root || (configuration.file_sync == FILE_SYNC_TRANSFER && !cache->files)) {
+        if (cache->root) free(cache->root);
+        if (cache->files) free_list(cache->files);
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void close_dir_cache(dir_cache *cache) {
+    free(cache->root);
+    if (cache->files) free_list(cache->files);
+    free(cache);
+}
+
+/*
+ * Get the full path of the path relative to the root of the cache into buf, which has space for buf_sz bytes.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if the path has .. components or is too long.
+ */
+static int _full_path(const dir_cache *cache, const char *path, char *buf, size_t buf_sz) {
+    const size_t len = strnlen(path, MAX_FILE_NAME_LEN + 1);
+    if (len > MAX_FILE_NAME_LEN) {
+        error("Too long file name.");
+        return EXIT_FAILURE;
+    }
+    size_t pos = 0;
+    size_t comp_len;
+    do {
+        if (_next_component(path, len, &pos, &comp_len) != EXIT_SUCCESS) return EXIT_FAILURE;
+        pos += comp_len;
+    } while (comp_len);
+    if (snprintf_check(buf, buf_sz, "%s%c%s", cache->root, PATH_SEP, path)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+int make_dirs_at(dir_cache *cache, const char *path) {
+    char full_path[MAX_FILE_NAME_LEN + 20];
+    if (_full_path(cache, path, full_path, sizeof(full_path)) != EXIT_SUCCESS) return EXIT_FAILURE;
+    return mkdirs(full_path);
+}
+
+FILE *create_file_at(dir_cache *cache, const char *path) {
+    if (!_base_name(path)) return NULL;
+    char full_path[MAX_FILE_NAME_LEN + 20];
+    if (_full_path(cache, path, full_path, sizeof(full_path)) != EXIT_SUCCESS) return NULL;
+    char *base_name = strrchr(full_path, PATH_SEP);
+    *base_name = 0;
+    const int status = mkdirs(full_path);
+    *base_name = PATH_SEP;
+    if (status != EXIT_SUCCESS || file_exists(full_path)) return NULL;
+    FILE *file = open_file(full_path, "wb");
+    if (file && cache->files) {
+        const uint32_t file_cnt = cache->files->len;
+        append_str(cache->files, full_path, strnlen(full_path, sizeof(full_path)));
+        if (cache->files->len == file_cnt) {
+            fclose(file);
+            remove_file(full_path);
+            return NULL;
+        }
+    }
+    return file;
+}
+
+int close_file_at(dir_cache *cache, FILE *file) {
+    (void)cache;
+    int status = fflush(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (status == EXIT_SUCCESS && configuration.file_sync == FILE_SYNC_FILE && _commit(_fileno(file))) {
+        status = EXIT_FAILURE;
+    }
+    if (fclose(file)) status = EXIT_FAILURE;
+    return status;
+}
+
+int sync_dir_cache(dir_cache *cache) {
+    if (configuration.file_sync != FILE_SYNC_TRANSFER || !cache->files) return EXIT_SUCCESS;
+    // Windows cannot sync a whole volume without admin rights. So the files are flushed one after another at the end of
+    // the transfer, when the system has already written most of their data in the background
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < cache->files->len; i++) {
+        FILE *file = open_file(cache->files->array[i], "ab");
+        if (!file || _commit(_fileno(file))) status = EXIT_FAILURE;
+        if (file) fclose(file);
+    }
+    return status;
+}
+
+int sync_directory(const char *path) {
+    // directories cannot be opened for syncing on Windows. NTFS journals the changes of directory entries
+    (void)path;
+    return EXIT_SUCCESS;
+}
+
+int remove_file_at(dir_cache *cache, const char *path) {
+    char full_path[MAX_FILE_NAME_LEN + 20];
+    if (_full_path(cache, path, full_path, sizeof(full_path)) != EXIT_SUCCESS) return EXIT_FAILURE;
+    return remove_file(full_path) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
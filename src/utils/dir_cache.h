@@ -0,0 +1,84 @@
+/*
+ * utils/dir_cache.h - create received files relative to cached directories
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_DIR_CACHE_H_
+#define UTILS_DIR_CACHE_H_
+
+#include <stdio.h>
+
+/*
+ * Directories under a root directory, which are created or opened while files of a transfer are saved.
+ * On Linux and macOS, the directories from the root to the directory of the last file are kept open. So files in the
+ * same directory, or in nearby directories, are created relative to an open directory without looking up the whole
+ * path again.
+ */
+typedef struct _dir_cache dir_cache;
+
+/*
+ * Open a cache of directories under root, which is an existing directory.
+ * returns NULL on error.
+ */
+extern dir_cache *open_dir_cache(const char *root);
+
+/*
+ * Close the directories kept open by the cache and free it.
+ */
+extern void close_dir_cache(dir_cache *cache);
+
+/*
+ * Create the directory at path, which is relative to the root of the cache, and its missing parent directories.
+ * Components of the path are separated by PATH_SEP. Empty and . components are skipped. The path must not have ..
+ * components, and must not go through symbolic links.
+ * returns EXIT_SUCCESS if the directory exists or was created, or EXIT_FAILURE otherwise.
+ */
+extern int make_dirs_at(dir_cache *cache, const char *path);
+
+/*
+ * Create a new file at path, which is relative to the root of the cache, and open it for writing in binary mode.
+ * Missing parent directories are created as with make_dirs_at().
+ * returns the opened file, or NULL if the file already exists or on error.
+ */
+extern FILE *create_file_at(dir_cache *cache, const char *path);
+
+/*
+ * Close a file opened with create_file_at() after all of its data is written. Depending on the file_sync
+ * configuration, the data is synced to the storage, or writing it to the storage is started.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if the data could not be written.
+ */
+extern int close_file_at(dir_cache *cache, FILE *file);
+
+/*
+ * Sync all the files and directories created in the cache to the storage together, if file_sync is per-transfer.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE otherwise.
+ */
+extern int sync_dir_cache(dir_cache *cache);
+
+/*
+ * Sync the entries of the directory at path to the storage, such as the files renamed into it, unless file_sync is
+ * none. This does nothing on Windows.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE otherwise.
+ */
+extern int sync_directory(const char *path);
+
+/*
+ * Remove the file at path, which is relative to the root of the cache.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE otherwise.
+ */
+extern int remove_file_at(dir_cache *cache, const char *path);
+
+#endif  // UTILS_DIR_CACHE_H_
@@ -0,0 +1,383 @@
+/*
+ * utils/dir_walk.c - walk through directories with several threads
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <globals.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/dir_walk.h>
+#include <utils/utils.h>
+
+#define MAX_WALK_THREADS 8
+#define MAX_PENDING_ENTRIES 4096  // workers wait when this many found files are not visited yet
+#define MAX_KEPT_DIRS 128         // directories kept open for opening their subdirectories relative to them
+
+/*
+ * A directory that is read, which is kept open until all of its subdirectories are opened relative to it.
+ */
+typedef struct _open_dir {
+    DIR *d;
+    uint32_t refs; /* the thread reading it, and its subdirectories that are not opened yet */
+} open_dir;
+
+/*
+ * A directory to be read. path ends with the path separator.
+ */
+typedef struct _walk_dir {
+    char *path;
+    size_t len;
+    size_t name_off; /* offset of the name of the directory in path */
+    int depth;
+    open_dir *parent; /* parent directory, or NULL for the directories given to walk_dirs() */
+} walk_dir;
+
+/*
+ * A file found, which is not visited yet.
+ */
+typedef struct _walk_entry {
+    char *path;
+    int64_t size;
+} walk_entry;
+
+typedef struct _dir_walk {
+    pthread_mutex_t lock;
+    pthread_cond_t dirs_cond;    /* signalled when directories are added or the walk ends */
+    pthread_cond_t entries_cond; /* signalled when entries are added or the walk ends */
+    pthread_cond_t space_cond;   /* signalled when entries are visited or the walk is stopped */
+    list2 *dirs;                 /* stack of walk_dir * to be read by any of the threads */
+    walk_entry entries[MAX_PENDING_ENTRIES];
+    uint32_t entry_cnt;
+    uint32_t busy;      /* number of threads reading a directory, which may add more directories */
+    uint32_t kept_dirs; /* number of open_dir that are not closed. Threads update this without holding the lock */
+    int done;      /* all the directories are read */
+    int stop;      /* the walk was stopped. Threads may read this without holding the lock */
+    int max_depth;
+    int include_leaf_dirs;
+} dir_walk;
+
+static void _release_dir(dir_walk *walk, open_dir *od) {
+    if (!od || __atomic_sub_fetch(&(od->refs), 1, __ATOMIC_ACQ_REL) > 0) return;
+    (void)closedir(od->d);
+    free(od);
+    __atomic_sub_fetch(&(walk->kept_dirs), 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Add a directory to be read by any thread. Takes the ownership of path and of a reference to parent.
+ */
+static void _add_dir(dir_walk *walk, char *path, size_t len, size_t name_off, int depth, open_dir *parent) {
+    walk_dir *dir = malloc(sizeof(walk_dir));
+    if (!dir) {
+        free(path);
+        _release_dir(walk, parent);
+        return;
+    }
+    dir->path = path;
+    dir->len = len;
+    dir->name_off = name_off;
+    dir->depth = depth;
+    dir->parent = parent;
+    pthread_mutex_lock(&(walk->lock));
+    const uint32_t len_before = walk->dirs->len;
+    append(walk->dirs, dir);
+    if (walk->dirs->len == len_before) {  // append failed
+        free(path);
+        free(dir);
+        _release_dir(walk, parent);
+    } else {
+        pthread_cond_signal(&(walk->dirs_cond));
+    }
+    pthread_mutex_unlock(&(walk->lock));
+}
+
+/*
+ * Add a file found to be visited. Takes the ownership of path. Waits while too many entries are pending.
+ * returns EXIT_FAILURE if the walk is stopped, or EXIT_SUCCESS otherwise.
+ */
+static int _add_entry(dir_walk *walk, char *path, int64_t size) {
+    pthread_mutex_lock(&(walk->lock));
+    while (!walk->stop && walk->entry_cnt >= MAX_PENDING_ENTRIES) {
+        pthread_cond_wait(&(walk->space_cond), &(walk->lock));
+    }
+    if (walk->stop) {
+        pthread_mutex_unlock(&(walk->lock));
+        free(path);
+        return EXIT_FAILURE;
+    }
+    walk->entries[walk->entry_cnt++] = (walk_entry){.path = path, .size = size};
+    pthread_cond_signal(&(walk->entries_cond));
+    pthread_mutex_unlock(&(walk->lock));
+    return EXIT_SUCCESS;
+}
+
+static inline int _is_stopped(const dir_walk *walk) { return __atomic_load_n(&(walk->stop), __ATOMIC_RELAXED); }
+
+static inline char *_join_path(const walk_dir *dir, const char *name, size_t name_len, int is_dir) {
+    char *path = malloc(dir->len + name_len + 2);
+    if (!path) return NULL;
+    memcpy(path, dir->path, dir->len);
+    memcpy(path + dir->len, name, name_len);
+    size_t len = dir->len + name_len;
+    if (is_dir) path[len++] = PATH_SEP;
+    path[len] = 0;
+    return path;
+}
+
+/*
+ * Open a directory relative to its parent directory, so that the path is not looked up again from the root. A symbolic
+ * link that replaced the directory after its parent was read is not followed. The directories given to walk_dirs(),
+ * which may be links, and the directories of which the parent was not kept open are opened with their paths.
+ * returns the file descriptor, or -1 on error.
+ */
+static int _open_dir(dir_walk *walk, walk_dir *dir) {
+    if (dir->depth == 1) return open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!dir->parent) return open(dir->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    char *sep = dir->path + dir->len - 1;
+    *sep = 0;  // openat() needs the name without the path separator
+    const int fd =
+        openat(dirfd(dir->parent->d), dir->path + dir->name_off, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    *sep = PATH_SEP;
+    _release_dir(walk, dir->parent);
+    dir->parent = NULL;
+    return fd;
+}
+
+/*
+ * Read a directory, adding its subdirectories to be read and its files to be visited. Entries are checked with
+ * fstatat() relative to the directory, and only if their type is not known from the directory entry or their size is
+ * needed.
+ */
+static void _read_dir(dir_walk *walk, walk_dir *dir) {
+    if (dir->depth > walk->max_depth) {
+        _release_dir(walk, dir->parent);
+        dir->parent = NULL;
+        return;
+    }
+    int fd = _open_dir(walk, dir);
+    if (fd < 0) {
+#ifdef DEBUG_MODE
+        printf("Error opening directory %s\n", dir->path);
+#endif
+        return;
+    }
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return;
+    }
+    // each ancestor with subdirectories waiting to be opened stays open. So their number is limited in deep trees
+    open_dir *self = NULL;
+    if (__atomic_add_fetch(&(walk->kept_dirs), 1, __ATOMIC_RELAXED) <= MAX_KEPT_DIRS) {
+        self = malloc(sizeof(open_dir));
+    }
+    if (self) {
+        self->d = d;
+        self->refs = 1;
+    } else {
+        __atomic_sub_fetch(&(walk->kept_dirs), 1, __ATOMIC_RELAXED);
+    }
+    int is_empty = 1;
+    const struct dirent *ent;
+    while (!_is_stopped(walk) && (ent = readdir(d)) != NULL) {
+        const char *name = ent->d_name;
+        if (!(strcmp(name, ".") && strcmp(name, ".."))) continue;
+        is_empty = 0;
+        const size_t name_len = strnlen(name, sizeof(ent->d_name));
+        if (dir->len + name_len > MAX_FILE_NAME_LEN) {
+            error("Too long file name.");
+            break;
+        }
+        unsigned char type = ent->d_type;
+        int64_t size = -1;
+        if (type == DT_UNKNOWN || type == DT_REG) {  // directories are not stat'ed, but files are for their size
+            struct stat sb;
+            if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW)) continue;
+            if (S_ISDIR(sb.st_mode)) {
+                type = DT_DIR;
+            } else if (S_ISREG(sb.st_mode)) {
+                type = DT_REG;
+                size = (int64_t)sb.st_size;
+            } else {
+                continue;
+            }
+        }
+        if (type == DT_DIR) {
+            char *path = _join_path(dir, name, name_len, 1);
+            if (path) {
+                if (self) __atomic_add_fetch(&(self->refs), 1, __ATOMIC_RELAXED);
+                _add_dir(walk, path, dir->len + name_len + 1, dir->len, dir->depth + 1, self);
+            }
+        } else if (type == DT_REG) {
+            char *path = _join_path(dir, name, name_len, 0);
+            if (path && _add_entry(walk, path, size) != EXIT_SUCCESS) break;
+        }
+    }
+    if (self) {
+        _release_dir(walk, self);
+    } else {
+        (void)closedir(d);
+    }
+    if (walk->include_leaf_dirs && is_empty) {
+        char *path = strdup(dir->path);
+        if (path) _add_entry(walk, path, -1);
+    }
+}
+
+static void *_walk_worker(void *arg) {
+    dir_walk *walk = (dir_walk *)arg;
+    pthread_mutex_lock(&(walk->lock));
+    while (1) {
+        while (!walk->stop && walk->dirs->len == 0 && walk->busy > 0) {
+            pthread_cond_wait(&(walk->dirs_cond), &(walk->lock));
+        }
+        // stop if no directory is left and no thread is reading a directory, which could add more
+        if (walk->stop || walk->dirs->len == 0) break;
+        walk_dir *dir = (walk_dir *)walk->dirs->array[--(walk->dirs->len)];
+        walk->busy++;
+        pthread_mutex_unlock(&(walk->lock));
+        _read_dir(walk, dir);
+        free(dir->path);
+        free(dir);
+        pthread_mutex_lock(&(walk->lock));
+        walk->busy--;
+        if (walk->busy == 0 && walk->dirs->len == 0) {
+            walk->done = 1;
+            pthread_cond_broadcast(&(walk->dirs_cond));
+            pthread_cond_signal(&(walk->entries_cond));
+        }
+    }
+    pthread_mutex_unlock(&(walk->lock));
+    return NULL;
+}
+
+/*
+ * Visit the entries found by the worker threads until all of them are visited or visit_fn stops the walk.
+ */
+static int _visit_entries(dir_walk *walk, walk_visit_fn visit_fn, void *arg) {
+    int status = EXIT_SUCCESS;
+    pthread_mutex_lock(&(walk->lock));
+    while (1) {
+        while (walk->entry_cnt == 0 && !walk->done) {
+            pthread_cond_wait(&(walk->entries_cond), &(walk->lock));
+        }
+        if (walk->entry_cnt == 0) break;
+        walk_entry entry = walk->entries[--(walk->entry_cnt)];
+        pthread_cond_signal(&(walk->space_cond));
+        pthread_mutex_unlock(&(walk->lock));
+        status = visit_fn(arg, entry.path, entry.size);
+        free(entry.path);
+        pthread_mutex_lock(&(walk->lock));
+        if (status != EXIT_SUCCESS) {
+            __atomic_store_n(&(walk->stop), 1, __ATOMIC_RELAXED);
+            pthread_cond_broadcast(&(walk->dirs_cond));
+            pthread_cond_broadcast(&(walk->space_cond));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&(walk->lock));
+    return status;
+}
+
+static inline uint32_t _thread_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    // reading directories is mostly waiting for the file system. So more threads than processors are used when few
+    return cpus * 2 < MAX_WALK_THREADS ? (uint32_t)(cpus * 2) : MAX_WALK_THREADS;
+}
+
+static void _free_walk(dir_walk *walk) {
+    for (uint32_t i = 0; i < walk->entry_cnt; i++) {
+        free(walk->entries[i].path);
+    }
+    for (uint32_t i = 0; i < walk->dirs->len; i++) {
+        walk_dir *dir = (walk_dir *)walk->dirs->array[i];
+        free(dir->path);
+        _release_dir(walk, dir->parent);
+    }
+    free_list(walk->dirs);  // frees the walk_dir structures
+    pthread_cond_destroy(&(walk->space_cond));
+    pthread_cond_destroy(&(walk->entries_cond));
+    pthread_cond_destroy(&(walk->dirs_cond));
+    pthread_mutex_destroy(&(walk->lock));
+    free(walk);
+}
+
+int walk_dirs(const list2 *dirs, int max_depth, int include_leaf_dirs, walk_visit_fn visit_fn, void *arg) {
+    if (dirs->len == 0) return EXIT_SUCCESS;
+    dir_walk *walk = malloc(sizeof(dir_walk));
+    if (!walk) return EXIT_FAILURE;
+    walk->dirs = init_list(dirs->len * 2);
+    if (!walk->dirs) {
+        free(walk);
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&(walk->lock), NULL);
+    pthread_cond_init(&(walk->dirs_cond), NULL);
+    pthread_cond_init(&(walk->entries_cond), NULL);
+    pthread_cond_init(&(walk->space_cond), NULL);
+    walk->entry_cnt = 0;
+    walk->busy = 0;
+    walk->kept_dirs = 0;
+    walk->done = 0;
+    walk->stop = 0;
+    walk->max_depth = max_depth;
+    walk->include_leaf_dirs = include_leaf_dirs;
+
+    for (uint32_t i = 0; i < dirs->len; i++) {
+        const char *dir_path = (const char *)dirs->array[i];
+        size_t len = strnlen(dir_path, MAX_FILE_NAME_LEN + 1);
+        if (len == 0 || len > MAX_FILE_NAME_LEN) {
+            error("Too long file name.");
+            continue;
+        }
+        char *path = malloc(len + 2);
+        if (!path) continue;
+        memcpy(path, dir_path, len);
+        if (path[len - 1] != PATH_SEP) path[len++] = PATH_SEP;
+        path[len] = 0;
+        _add_dir(walk, path, len, 0, 1, NULL);
+    }
+    if (walk->dirs->len == 0) {
+        _free_walk(walk);
+        return EXIT_SUCCESS;
+    }
+
+    pthread_t threads[MAX_WALK_THREADS];
+    const uint32_t thread_cnt = _thread_count();
+    uint32_t started = 0;
+    while (started < thread_cnt && pthread_create(threads + started, NULL, _walk_worker, walk) == 0) started++;
+    int status;
+    if (started) {
+        status = _visit_entries(walk, visit_fn, arg);
+    } else {
+        error("Could not start directory walk");
+        status = EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    _free_walk(walk);
+    return status;
+}
@@ -0,0 +1,41 @@
+/*
+ * utils/dir_walk.h - walk through directories with several threads
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_DIR_WALK_H_
+#define UTILS_DIR_WALK_H_
+
+#include <stdint.h>
+#include <utils/list_utils.h>
+
+/*
+ * Called by walk_dirs() for each file found. path is the full path of the file, and paths of empty directories end
+ * with the path separator. size is the size of a regular file, or -1 for an empty directory.
+ * returns EXIT_SUCCESS to continue the walk, or EXIT_FAILURE to stop it.
+ */
+typedef int (*walk_visit_fn)(void *arg, const char *path, int64_t size);
+
+/*
+ * Walk through the directories in dirs, which is a list of directory paths, and their subdirectories up to max_depth
+ * levels. visit_fn is called with arg for each regular file, and for each empty directory if include_leaf_dirs is
+ * non-zero. The directories are read by several threads, but visit_fn is always called on the calling thread.
+ * Symbolic links and special files in the directories are skipped.
+ * returns EXIT_SUCCESS if the walk completed, or EXIT_FAILURE if visit_fn stopped the walk or the walk failed.
+ */
+extern int walk_dirs(const list2 *dirs, int max_depth, int include_leaf_dirs, walk_visit_fn visit_fn, void *arg);
+
+#endif  // UTILS_DIR_WALK_H_
@@ -0,0 +1,138 @@
+/*
+ * utils/eol.c - convert the line endings of text
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <utils/eol.h>
+
+// Line endings are searched for in blocks of VEC_LEN bytes with vector compares where they are available
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC_LEN 16
+
+/*
+ * Compare the VEC_LEN bytes at p with c. Bit i of the result is set if p[i] is c.
+ */
+static inline uint32_t _match(const char *p, char c) {
+    const __m128i block = _mm_loadu_si128((const __m128i *)(const void *)p);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+}
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEC_LEN 16
+
+/*
+ * Compare the VEC_LEN bytes at p with c. Bit i of the result is set if p[i] is c.
+ */
+static inline uint32_t _match(const char *p, char c) {
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t equal = vceqq_u8(vld1q_u8((const uint8_t *)p), vdupq_n_u8((uint8_t)c));
+    const uint8x16_t masked = vandq_u8(equal, vld1q_u8(bits));
+    // add the bits of each half of the block together, which leaves the mask of the lower half in the first byte
+    uint8x8_t sum = vpadd_u8(vget_low_u8(masked), vget_high_u8(masked));
+    sum = vpadd_u8(sum, sum);
+    sum = vpadd_u8(sum, sum);
+    return (uint32_t)vget_lane_u8(sum, 0) | ((uint32_t)vget_lane_u8(sum, 1) << 8);
+}
+#endif
+
+/*
+ * Find the first CR that is followed by a LF in str, starting from the index from.
+ * returns the index of the CR, or len if there is none.
+ */
+static inline size_t _find_crlf(const char *str, size_t from, size_t len) {
+#ifdef VEC_LEN
+    // the byte after each block is compared too. So the last byte is left to the loop below
+    for (; from + VEC_LEN < len; from += VEC_LEN) {
+        const uint32_t crlf = _match(str + from, '\r') & _match(str + from + 1, '\n');
+        if (crlf) return from + (size_t)__builtin_ctz(crlf);
+    }
+#endif
+    for (; from + 1 < len; from++) {
+        if (str[from] == '\r' && str[from + 1] == '\n') return from;
+    }
+    return len;
+}
+
+/*
+ * Find the last LF that is not preceded by a CR in the first end bytes of str.
+ * returns the index of the LF, or end if there is none.
+ */
+static inline size_t _find_last_bare_lf(const char *str, size_t end) {
+    size_t ind = end;
+#ifdef VEC_LEN
+    // the byte before each block is compared too. So the first byte is left to the loop below
+    for (; ind > VEC_LEN; ind -= VEC_LEN) {
+        const char *block = str + ind - VEC_LEN;
+        const uint32_t bare_lf = _match(block, '\n') & ~_match(block - 1, '\r');
+        if (bare_lf) return ind - VEC_LEN + (size_t)(31 - __builtin_clz(bare_lf));
+    }
+#endif
+    while (ind > 0) {
+        ind--;
+        if (str[ind] == '\n' && (ind == 0 || str[ind - 1] != '\r')) return ind;
+    }
+    return end;
+}
+
+size_t eol_move_to_lf(char *dst, const char *src, size_t len) {
+    // converting to LF shrinks the text. So the text between the dropped CRs is moved towards the start in bulk
+    size_t dst_len = 0;
+    size_t start = 0;  // start of the text that is not moved yet
+    size_t cr;
+    while ((cr = _find_crlf(src, start, len)) < len) {
+        if (dst + dst_len != src + start) memmove(dst + dst_len, src + start, cr - start);
+        dst_len += cr - start;
+        start = cr + 1;
+    }
+    if (dst + dst_len != src + start) memmove(dst + dst_len, src + start, len - start);
+    return dst_len + len - start;
+}
+
+size_t eol_to_lf(char *str, size_t len) { return eol_move_to_lf(str, str, len); }
+
+size_t eol_crlf_len(const char *str, size_t len) {
+    if (len == 0) return 0;
+    size_t bare_lf_cnt = (str[0] == '\n');
+    size_t ind = 1;
+#ifdef VEC_LEN
+    for (; ind + VEC_LEN <= len; ind += VEC_LEN) {
+        const uint32_t bare_lf = _match(str + ind, '\n') & ~_match(str + ind - 1, '\r');
+        bare_lf_cnt += (size_t)__builtin_popcount(bare_lf);
+    }
+#endif
+    for (; ind < len; ind++) {
+        if (str[ind] == '\n' && str[ind - 1] != '\r') bare_lf_cnt++;
+    }
+    return len + bare_lf_cnt;
+}
+
+void eol_to_crlf(char *str, size_t len, size_t new_len) {
+    // converting to CRLF expands the text. So the text is moved towards the end in bulk, starting from the end
+    size_t src_end = len;      // end of the text that is not moved yet
+    size_t dst_end = new_len;  // the difference from src_end is the number of LFs that still need a CR
+    while (dst_end > src_end) {
+        const size_t lf = _find_last_bare_lf(str, src_end);
+        if (lf == src_end) return;
+        const size_t run = src_end - lf;
+        memmove(str + dst_end - run, str + lf, run);
+        dst_end -= run;
+        str[--dst_end] = '\r';
+        src_end = lf;
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * utils/eol.h - convert the line endings of text
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_EOL_H_
+#define UTILS_EOL_H_
+
+#include <stddef.h>
+
+/*
+ * Convert the CRLF line endings in the len bytes of text in str to LF in place. CRs that are not followed by a LF are
+ * kept. Null bytes are treated as any other byte.
+ * returns the length of the converted text.
+ */
+extern size_t eol_to_lf(char *str, size_t len);
+
+/*
+ * Convert the CRLF line endings in the len bytes of text in src to LF as eol_to_lf() does, and write the converted text
+ * to dst. dst may overlap src only if it does not come after src.
+ * returns the length of the converted text.
+ */
+extern size_t eol_move_to_lf(char *dst, const char *src, size_t len);
+
+/*
+ * Get the length of the len bytes of text in str after converting its LF line endings to CRLF with eol_to_crlf().
+ */
+extern size_t eol_crlf_len(const char *str, size_t len);
+
+/*
+ * Convert the LF line endings, that are not preceded by a CR, in the len bytes of text in str to CRLF in place.
+ * new_len must be the length given by eol_crlf_len(), and str must have space for new_len bytes.
+ */
+extern void eol_to_crlf(char *str, size_t len, size_t new_len);
+
+#endif  // UTILS_EOL_H_
@@ -0,0 +1,408 @@
+/*
+ * utils/img_scale.c - downscale images for thumbnails
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <globals.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/img_scale.h>
+#include <utils/png_tuning.h>
+#include <utils/utils.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define MAX_SCALER_SIZE (1U << 24)
+#define MAX_DECODE_SIZE 1073741824UL  // 1 GiB
+// averages of blocks with fewer pixels are computed exactly with a multiplication by the reciprocal
+#define MAX_RECIP_COUNT 4096
+
+int get_scaled_size(const img_options *opts, uint32_t width, uint32_t height, uint32_t *width_p,
+                    uint32_t *height_p) {
+    *width_p = width;
+    *height_p = height;
+    if (width == 0 || height == 0) return 0;
+
+    // the scale factor is num / den. The smallest factor required by the options is selected
+    uint64_t num = 1;
+    uint64_t den = 1;
+    if (opts->scale > 0 && opts->scale < IMG_SCALE_UNIT) {
+        num = opts->scale;
+        den = IMG_SCALE_UNIT;
+    }
+    if (opts->max_width > 0 && (uint64_t)opts->max_width * den < num * width) {
+        num = opts->max_width;
+        den = width;
+    }
+    if (opts->max_height > 0 && (uint64_t)opts->max_height * den < num * height) {
+        num = opts->max_height;
+        den = height;
+    }
+    if (num >= den) return 0;
+
+    uint64_t scaled_width = (width * num + den / 2) / den;
+    uint64_t scaled_height = (height * num + den / 2) / den;
+    if (scaled_width == 0) scaled_width = 1;
+    if (scaled_height == 0) scaled_height = 1;
+    *width_p = (uint32_t)scaled_width;
+    *height_p = (uint32_t)scaled_height;
+    return *width_p < width || *height_p < height;
+}
+
+static uint16_t _parse_max_size(const char *value) {
+    const long size = strtol(value, NULL, 10);
+    return (size <= 0 || size > 65535L) ? 0 : (uint16_t)size;
+}
+
+int set_scale_option(img_options *opts, const char *name, const char *value) {
+    if (!strcmp(name, "max_width")) {
+        opts->max_width = _parse_max_size(value);
+    } else if (!strcmp(name, "max_height")) {
+        opts->max_height = _parse_max_size(value);
+    } else if (!strcmp(name, "scale")) {
+        const double scale = strtod(value, NULL);
+        // scale factors that are not less than 1 keep the original size
+        if (scale > 0 && scale < 1) {
+            const long thousandths = (long)(scale * IMG_SCALE_UNIT + 0.5);
+            opts->scale = thousandths < 1 ? 1 : (uint16_t)thousandths;
+        } else {
+            opts->scale = 0;
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int init_scaler(img_scaler *scaler, uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height,
+                uint32_t channels, unsigned char *dst, size_t dst_stride) {
+    if (dst_width == 0 || dst_height == 0 || dst_width > src_width || dst_height > src_height ||
+        src_width > MAX_SCALER_SIZE || src_height > MAX_SCALER_SIZE || channels == 0 || channels > 4) {
+        return EXIT_FAILURE;
+    }
+    scaler->acc = calloc((size_t)src_width * channels, sizeof(uint32_t));
+    scaler->col_ends = malloc(sizeof(uint32_t) * dst_width);
+    if (!scaler->acc || !scaler->col_ends) {
+        free_scaler(scaler);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t x = 0; x < dst_width; x++) {
+        scaler->col_ends[x] = (uint32_t)((uint64_t)(x + 1) * src_width / dst_width);
+    }
+    scaler->src_width = src_width;
+    scaler->src_height = src_height;
+    scaler->dst_width = dst_width;
+    scaler->dst_height = dst_height;
+    scaler->channels = channels;
+    scaler->src_row = 0;
+    scaler->dst_row = 0;
+    scaler->acc_rows = 0;
+    scaler->dst = dst;
+    scaler->dst_stride = dst_stride;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Add each byte of row to the corresponding element of acc.
+ */
+static void _accumulate(uint32_t *acc, const unsigned char *row, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        const __m128i bytes = _mm_loadu_si128((const __m128i *)(row + i));
+        const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i *sums = (__m128i *)(acc + i);
+        _mm_storeu_si128(sums, _mm_add_epi32(_mm_loadu_si128(sums), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(sums + 1, _mm_add_epi32(_mm_loadu_si128(sums + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(sums + 2, _mm_add_epi32(_mm_loadu_si128(sums + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(sums + 3, _mm_add_epi32(_mm_loadu_si128(sums + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint8x16_t bytes = vld1q_u8(row + i);
+        const uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+        const uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+        uint32_t *sums = acc + i;
+        vst1q_u32(sums, vaddw_u16(vld1q_u32(sums), vget_low_u16(lo)));
+        vst1q_u32(sums + 4, vaddw_u16(vld1q_u32(sums + 4), vget_high_u16(lo)));
+        vst1q_u32(sums + 8, vaddw_u16(vld1q_u32(sums + 8), vget_low_u16(hi)));
+        vst1q_u32(sums + 12, vaddw_u16(vld1q_u32(sums + 12), vget_high_u16(hi)));
+    }
+#endif
+    for (; i < len; i++) {
+        acc[i] += row[i];
+    }
+}
+
+/*
+ * Write the current row of the scaled image from the column sums of the source rows it covers.
+ */
+static void _write_row(const img_scaler *scaler) {
+    unsigned char *out = scaler->dst + (size_t)scaler->dst_row * scaler->dst_stride;
+    const uint32_t *acc = scaler->acc;
+    const uint32_t channels = scaler->channels;
+
+    // blocks of a row are one of two widths. So the reciprocals of their pixel counts are computed once per row
+    const uint32_t min_cols = scaler->src_width / scaler->dst_width;
+    uint64_t recips[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        const uint64_t cnt = (uint64_t)(min_cols + i) * scaler->acc_rows;
+        recips[i] = cnt < MAX_RECIP_COUNT ? ((1ULL << 32) + cnt - 1) / cnt : 0;
+    }
+
+    uint32_t col = 0;
+    for (uint32_t x = 0; x < scaler->dst_width; x++) {
+        const uint32_t end = scaler->col_ends[x];
+        const uint64_t cnt = (uint64_t)(end - col) * scaler->acc_rows;
+        const uint64_t recip = recips[end - col - min_cols];
+        for (uint32_t c = 0; c < channels; c++) {
+            uint64_t sum = 0;
+            for (uint32_t i = col; i < end; i++) {
+                sum += acc[(size_t)i * channels + c];
+            }
+            sum += cnt / 2;  // round to the nearest
+            *out++ = (unsigned char)(recip ? (sum * recip) >> 32 : sum / cnt);
+        }
+        col = end;
+    }
+}
+
+void scaler_add_row(img_scaler *scaler, const unsigned char *row) {
+    if (scaler->dst_row >= scaler->dst_height) return;
+    const size_t row_len = (size_t)scaler->src_width * scaler->channels;
+    _accumulate(scaler->acc, row, row_len);
+    scaler->acc_rows++;
+    scaler->src_row++;
+    const uint64_t row_end = (uint64_t)(scaler->dst_row + 1) * scaler->src_height / scaler->dst_height;
+    if (scaler->src_row < row_end) return;
+
+    _write_row(scaler);
+    memset(scaler->acc, 0, row_len * sizeof(uint32_t));
+    scaler->acc_rows = 0;
+    scaler->dst_row++;
+}
+
+void free_scaler(img_scaler *scaler) {
+    if (scaler->acc) free(scaler->acc);
+    if (scaler->col_ends) free(scaler->col_ends);
+    scaler->acc = NULL;
+    scaler->col_ends = NULL;
+}
+
+#if defined(__linux__) || defined(_WIN32)
+
+/*
+ * In-memory file to read png image
+ */
+typedef struct _mem_reader {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+} mem_reader;
+
+static void _png_mem_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+    mem_reader *p = (mem_reader *)png_get_io_ptr(png_ptr);
+    if (length > p->size - p->pos) png_error(png_ptr, "Read Error");
+    memcpy(data, p->data + p->pos, length);
+    p->pos += length;
+}
+
+/*
+ * Read the rows of the PNG image after its info and add them to the scaler. row_ptrs should be NULL unless the image is
+ * interlaced. For interlaced images, rows should have space for all rows, and row_ptrs should have space for pointers
+ * to them. Otherwise, rows should have space for a single row.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _read_scaled_rows(png_structp png_ptr, img_scaler *scaler, unsigned char *rows, png_bytep *row_ptrs,
+                             size_t row_bytes, uint32_t height) {
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        return EXIT_FAILURE;
+    }
+    if (row_ptrs) {
+        for (uint32_t y = 0; y < height; y++) {
+            row_ptrs[y] = rows + (size_t)y * row_bytes;
+        }
+        png_read_image(png_ptr, row_ptrs);
+        for (uint32_t y = 0; y < height; y++) {
+            scaler_add_row(scaler, row_ptrs[y]);
+        }
+    } else {
+        for (uint32_t y = 0; y < height; y++) {
+            png_read_row(png_ptr, rows, NULL);
+            scaler_add_row(scaler, rows);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Decode the PNG image and downscale it to the size given by the scaling options.
+ * If the image needs to be downscaled, allocates the pixels of the scaled image and sets the pointer to *pixels_p,
+ * which should be freed by the caller. The size and the number of channels of the scaled image are set to *width_p,
+ * *height_p, and *channels_p.
+ * returns 1 if the image is downscaled, 0 if it does not need to be downscaled, or -1 on failure.
+ */
+static int _decode_scaled(const char *buf, uint32_t len, const img_options *opts, unsigned char **pixels_p,
+                          uint32_t *width_p, uint32_t *height_p, uint32_t *channels_p) {
+    mem_reader reader = {.data = (const unsigned char *)buf, .size = len, .pos = 0};
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr) return -1;
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        png_destroy_read_struct(&png_ptr, NULL, NULL);
+        return -1;
+    }
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return -1;
+    }
+    png_set_read_fn(png_ptr, &reader, _png_mem_read_data);
+    png_read_info(png_ptr, info_ptr);
+    const uint32_t width = png_get_image_width(png_ptr, info_ptr);
+    const uint32_t height = png_get_image_height(png_ptr, info_ptr);
+    uint32_t dst_width;
+    uint32_t dst_height;
+    if (!get_scaled_size(opts, width, height, &dst_width, &dst_height)) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return 0;
+    }
+
+    // read all images as 8-bit RGB or RGBA
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    png_set_gray_to_rgb(png_ptr);
+    const int passes = png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+    const uint32_t channels = png_get_channels(png_ptr, info_ptr);
+    const size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
+
+    // interlaced images are read as a whole since each pass fills parts of all rows
+    const uint32_t buf_rows = passes > 1 ? height : 1;
+    if (row_bytes < (size_t)width * channels || (uint64_t)row_bytes * buf_rows > MAX_DECODE_SIZE) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return -1;
+    }
+    unsigned char *rows = malloc(row_bytes * buf_rows);
+    unsigned char *pixels = malloc((size_t)dst_width * channels * dst_height);
+    png_bytep *row_ptrs = passes > 1 ? malloc(sizeof(png_bytep) * height) : NULL;
+    img_scaler scaler = {.acc = NULL, .col_ends = NULL};
+    if (!rows || !pixels || (passes > 1 && !row_ptrs) ||
+        init_scaler(&scaler, width, height, dst_width, dst_height, channels, pixels, (size_t)dst_width * channels) !=
+            EXIT_SUCCESS) {
+        if (rows) free(rows);
+        if (pixels) free(pixels);
+        if (row_ptrs) free(row_ptrs);
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return -1;
+    }
+    const int status = _read_scaled_rows(png_ptr, &scaler, rows, row_ptrs, row_bytes, height);
+    if (row_ptrs) free(row_ptrs);
+    free_scaler(&scaler);
+    free(rows);
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    if (status != EXIT_SUCCESS) {
+        free(pixels);
+        return -1;
+    }
+
+    *pixels_p = pixels;
+    *width_p = dst_width;
+    *height_p = dst_height;
+    *channels_p = channels;
+    return 1;
+}
+
+/*
+ * Encode the 8-bit RGB or RGBA pixels as a PNG into a memory buffer.
+ * Allocates a memory buffer and sets the pointer to *buf_p. Sets the size of the buffer in bytes to *len_p.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _encode_png(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t channels, char **buf_p,
+                       size_t *len_p) {
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr) return EXIT_FAILURE;
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        png_destroy_write_struct(&png_ptr, NULL);
+        return EXIT_FAILURE;
+    }
+    struct mem_file fake_file = {.buffer = NULL, .capacity = 0, .size = 0};
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        if (fake_file.buffer) free(fake_file.buffer);
+        return EXIT_FAILURE;
+    }
+    png_set_write_fn(png_ptr, &fake_file, png_mem_write_data, NULL);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, channels == 4 ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    const int level = get_png_level();
+    png_set_compression_level(png_ptr, level);
+    png_set_compression_strategy(png_ptr, configuration.png.strategy);
+    if (configuration.png.filter == PNG_FILTER_ADAPTIVE) {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+    } else {
+        // PNG_FILTER_NONE ... PNG_FILTER_PAETH are consecutive bits in the order of the filter types
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE << configuration.png.filter);
+    }
+
+    const uint64_t start = get_time_ns();
+    const size_t stride = (size_t)width * channels;
+    png_write_info(png_ptr, info_ptr);
+    for (uint32_t y = 0; y < height; y++) {
+        png_write_row(png_ptr, pixels + stride * y);
+    }
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    record_png_encode(level, stride * height, fake_file.size, get_time_ns() - start);
+
+    *buf_p = fake_file.buffer;
+    *len_p = fake_file.size;
+    return EXIT_SUCCESS;
+}
+
+int downscale_png(char **buf_ptr, uint32_t *len_ptr, const img_options *opts) {
+    unsigned char *pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    const int status = _decode_scaled(*buf_ptr, *len_ptr, opts, &pixels, &width, &height, &channels);
+    if (status <= 0) return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    char *buf;
+    size_t len;
+    if (_encode_png(pixels, width, height, channels, &buf, &len) != EXIT_SUCCESS) {
+        free(pixels);
+        return EXIT_FAILURE;
+    }
+    free(pixels);
+    if (len >= 0xFFFFFFFFUL) {
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    free(*buf_ptr);
+    *buf_ptr = buf;
+    *len_ptr = (uint32_t)len;
+    return EXIT_SUCCESS;
+}
+
+#endif
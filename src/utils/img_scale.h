@@ -0,0 +1,91 @@
+/*
+ * utils/img_scale.h - downscale images for thumbnails
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_IMG_SCALE_H_
+#define UTILS_IMG_SCALE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/utils.h>
+
+/*
+ * Downscales an image row by row with a box filter. Each pixel of the scaled image is the average of the block of
+ * source pixels it covers.
+ */
+typedef struct _img_scaler {
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    uint32_t channels;  /* number of bytes in a pixel. Each byte is a channel */
+    uint32_t src_row;   /* number of source rows added so far */
+    uint32_t dst_row;   /* next row of the scaled image to be written */
+    uint32_t acc_rows;  /* number of source rows summed in acc */
+    uint32_t *acc;      /* sums of each channel of each source column over the rows of the current scaled row */
+    uint32_t *col_ends; /* source column after the last source column of each scaled column */
+    unsigned char *dst;
+    size_t dst_stride;
+} img_scaler;
+
+/*
+ * Find the size of an image of width x height pixels after applying the max_width, max_height, and scale options.
+ * The aspect ratio is kept, and images are never upscaled.
+ * Sets the scaled size to *width_p and *height_p.
+ * returns 1 if the image should be downscaled, or 0 otherwise.
+ */
+extern int get_scaled_size(const img_options *opts, uint32_t width, uint32_t height, uint32_t *width_p,
+                           uint32_t *height_p);
+
+/*
+ * Set the scaling option of opts given by its name from the value in its text form.
+ * returns 1 if name is a scaling option, or 0 otherwise.
+ */
+extern int set_scale_option(img_options *opts, const char *name, const char *value);
+
+/*
+ * Prepare a scaler to downscale an image of src_width x src_height pixels to dst_width x dst_height pixels, which
+ * should not be larger than the source. Rows of the scaled image are written to dst, which should have space for
+ * dst_height rows of dst_stride bytes.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int init_scaler(img_scaler *scaler, uint32_t src_width, uint32_t src_height, uint32_t dst_width,
+                       uint32_t dst_height, uint32_t channels, unsigned char *dst, size_t dst_stride);
+
+/*
+ * Add the next row of the source image. Rows should be added in order from the top. A row of the scaled image is
+ * written when all the source rows it covers are added.
+ */
+extern void scaler_add_row(img_scaler *scaler, const unsigned char *row);
+
+/*
+ * Free the memory used by the scaler. The scaled image is not freed.
+ */
+extern void free_scaler(img_scaler *scaler);
+
+#if defined(__linux__) || defined(_WIN32)
+/*
+ * Downscale the PNG image in *buf_ptr according to the scaling options in opts. The image is decoded, downscaled, and
+ * encoded again as an 8-bit RGB or RGBA PNG. *buf_ptr and *len_ptr are left unchanged if the image does not need to be
+ * downscaled.
+ * On success, the original buffer is freed and *buf_ptr and *len_ptr are set to the scaled image.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int downscale_png(char **buf_ptr, uint32_t *len_ptr, const img_options *opts);
+#endif
+
+#endif  // UTILS_IMG_SCALE_H_
@@ -1,6 +1,6 @@
 /*
  * utils/list_utils.c - platform independent implementation of 2d list
- * Copyright (C) 2022-2023 H. Thevindu J. Wijesekera
+ * Copyright (C) 2022-2026 H. Thevindu J. Wijesekera
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -18,9 +18,23 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <utils/list_utils.h>
 #include <utils/utils.h>
 
+#define STR_BLOCK_MIN 4096
+#define STR_BLOCK_MAX 1048576
+
+/*
+ * A block of memory holding strings of a list back to back. Blocks of a list are linked from the newest.
+ */
+struct _str_block {
+    str_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
 list2 *init_list(uint32_t len) {
     list2 *lst = (list2 *)malloc(sizeof(list2));
     if (!lst) return NULL;
@@ -32,12 +46,36 @@ list2 *init_list(uint32_t len) {
     lst->array = arr;
     lst->len = 0;
     lst->capacity = len;
+    lst->strs = NULL;
+    return lst;
+}
+
+list2 *init_str_list(uint32_t len) {
+    list2 *lst = init_list(len);
+    if (!lst) return NULL;
+    lst->strs = (str_block *)malloc(sizeof(str_block) + STR_BLOCK_MIN);
+    if (!lst->strs) {
+        free_list(lst);
+        return NULL;
+    }
+    lst->strs->next = NULL;
+    lst->strs->size = STR_BLOCK_MIN;
+    lst->strs->used = 0;
     return lst;
 }
 
 void free_list(list2 *lst) {
-    for (uint32_t i = 0; i < lst->len; i++) {
-        if (lst->array[i]) free(lst->array[i]);
+    if (lst->strs) {
+        str_block *block = lst->strs;
+        while (block) {
+            str_block *next = block->next;
+            free(block);
+            block = next;
+        }
+    } else {
+        for (uint32_t i = 0; i < lst->len; i++) {
+            if (lst->array[i]) free(lst->array[i]);
+        }
     }
     free(lst->array);
     free(lst);
@@ -61,3 +99,49 @@ void append(list2 *lst, void *elem) {
     lst->array[lst->len] = elem;
     lst->len++;
 }
+
+/*
+ * Get space for size bytes in the string blocks of the list, adding a new block if the newest one is full.
+ * returns NULL on error
+ */
+static char *_alloc_str(list2 *lst, size_t size) {
+    str_block *block = lst->strs;
+    if (block->size - block->used < size) {
+        // blocks get larger as the list grows. So a list of many strings has only a few blocks
+        size_t new_size = block->size < STR_BLOCK_MAX ? block->size * 2 : STR_BLOCK_MAX;
+        if (new_size < size) new_size = size;
+        block = (str_block *)malloc(sizeof(str_block) + new_size);
+        if (!block) return NULL;
+        block->next = lst->strs;
+        block->size = new_size;
+        block->used = 0;
+        lst->strs = block;
+    }
+    char *str = block->data + block->used;
+    block->used += size;
+    return str;
+}
+
+void append_str(list2 *lst, const char *str, size_t len) {
+    if (lst->len >= 0xFFFFFFFFUL) return;
+    char *copy = _alloc_str(lst, len + 1);
+    if (!copy) return;
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    append(lst, copy);
+}
+
+void append_strs(list2 *lst, const char *strs, size_t len, char sep) {
+    if (len == 0 || lst->len >= 0xFFFFFFFFUL) return;
+    char *copy = _alloc_str(lst, len + 1);
+    if (!copy) return;
+    memcpy(copy, strs, len);
+    copy[len] = 0;
+    char *str = copy;
+    for (char *end = memchr(str, sep, len); end; end = memchr(str, sep, len - (size_t)(str - copy))) {
+        *end = 0;
+        if (end > str) append(lst, str);
+        str = end + 1;
+    }
+    if (*str) append(lst, str);
+}
@@ -22,10 +22,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+typedef struct _str_block str_block;
+
 typedef struct _list {
     uint32_t len;
     uint32_t capacity;
     void **array;
+    str_block *strs; /* blocks holding the elements of a list from init_str_list(), or NULL for other lists */
 } list2;
 
 /*
@@ -35,7 +38,15 @@ typedef struct _list {
 extern list2 *init_list(uint32_t len);
 
 /*
- * Free the memory allocated to a list2 *lst
+ * Initialize a list2 of strings with initial capacity len.
+ * The strings are copied into a few large blocks owned by the list, which are freed together by free_list(). Elements
+ * must be added only with append_str() or append_strs().
+ * returns NULL on error
+ */
+extern list2 *init_str_list(uint32_t len);
+
+/*
+ * Free the memory allocated to a list2 *lst, including its elements
  */
 extern void free_list(list2 *lst);
 
@@ -45,4 +56,17 @@ extern void free_list(list2 *lst);
  */
 extern void append(list2 *lst, void *elem);
 
+/*
+ * Appends a null terminated copy of the first len bytes of str to the list lst, which is from init_str_list().
+ * Allocates more space if needed.
+ */
+extern void append_str(list2 *lst, const char *str, size_t len);
+
+/*
+ * Appends each of the strings in the first len bytes of strs, which are separated by sep, to the list lst, which is
+ * from init_str_list(). All of them are copied at once into contiguous memory. Empty strings are skipped.
+ * Allocates more space if needed.
+ */
+extern void append_strs(list2 *lst, const char *strs, size_t len, char sep);
+
 #endif  // UTILS_LIST_UTILS_H_
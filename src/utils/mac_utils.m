@@ -25,6 +25,7 @@
 #import <stddef.h>
 #import <stdint.h>
 #import <string.h>
+#import <utils/img_scale.h>
 #import <utils/utils.h>
 
 #ifdef USE_SCREEN_CAPTURE_KIT
@@ -240,23 +241,77 @@ static NSBitmapImageRep *get_screen_image(uint16_t disp) {
 
 #endif
 
-int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
+/*
+ * Crop the region given by opts from the screenshot.
+ * returns the cropped bitmap, or NULL if the region does not fit inside the screenshot.
+ */
+static NSBitmapImageRep *crop_bitmap(NSBitmapImageRep *bitmap, const img_options *opts) {
+    if (!region_fits(opts, (uint32_t)[bitmap pixelsWide], (uint32_t)[bitmap pixelsHigh])) return NULL;
+    CGImageRef cropped = CGImageCreateWithImageInRect(
+        [bitmap CGImage], CGRectMake(opts->region_x, opts->region_y, opts->region_width, opts->region_height));
+    if (!cropped) return NULL;
+    NSBitmapImageRep *region = [[NSBitmapImageRep alloc] initWithCGImage:cropped];
+    CGImageRelease(cropped);
+    return region;
+}
+
+/*
+ * Downscale the bitmap according to the scaling options in opts.
+ * returns the scaled bitmap, or the given bitmap if it does not need to be downscaled or scaling failed.
+ */
+static NSBitmapImageRep *downscale_bitmap(NSBitmapImageRep *bitmap, const img_options *opts) {
+    uint32_t width;
+    uint32_t height;
+    if (!get_scaled_size(opts, (uint32_t)[bitmap pixelsWide], (uint32_t)[bitmap pixelsHigh], &width, &height)) {
+        return bitmap;
+    }
+    NSBitmapImageRep *scaled = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
+                                                                        pixelsWide:(NSInteger)width
+                                                                        pixelsHigh:(NSInteger)height
+                                                                     bitsPerSample:8
+                                                                   samplesPerPixel:4
+                                                                          hasAlpha:YES
+                                                                          isPlanar:NO
+                                                                    colorSpaceName:NSDeviceRGBColorSpace
+                                                                       bytesPerRow:0
+                                                                      bitsPerPixel:0];
+    if (!scaled) return bitmap;
+    NSGraphicsContext *context = [NSGraphicsContext graphicsContextWithBitmapImageRep:scaled];
+    if (!context) return bitmap;
+    [NSGraphicsContext saveGraphicsState];
+    [NSGraphicsContext setCurrentContext:context];
+    [context setImageInterpolation:NSImageInterpolationHigh];
+    [bitmap drawInRect:NSMakeRect(0, 0, (CGFloat)width, (CGFloat)height)
+              fromRect:NSZeroRect
+             operation:NSCompositingOperationCopy
+              fraction:1.0
+        respectFlipped:NO
+                 hints:nil];
+    [NSGraphicsContext restoreGraphicsState];
+    return scaled;
+}
+
+int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, img_options *opts) {
     *len_ptr = 0;
     *buf_ptr = NULL;
+    opts->format = IMG_FORMAT_PNG;
     NSBitmapImageRep *bitmap = NULL;
     if (mode != IMG_SCRN_ONLY) {
         bitmap = get_copied_image();
     }
     if (mode != IMG_COPIED_ONLY && !bitmap) {
         // If configured to force use the display from conf, override the disp value
+        uint16_t disp = opts->disp;
         if (disp <= 0 || !configuration.client_selects_display) {
             disp = (uint16_t)configuration.display;
         }
         bitmap = get_screen_image(disp);
+        if (bitmap && opts->region_width > 0) bitmap = crop_bitmap(bitmap, opts);
     }
     if (!bitmap) {
         return EXIT_FAILURE;
     }
+    bitmap = downscale_bitmap(bitmap, opts);
     NSData *data = [bitmap representationUsingType:NSBitmapImageFileTypePNG properties:@{}];
     NSUInteger size = [data length];
     char *buf = malloc((size_t)size);
@@ -0,0 +1,115 @@
+/*
+ * utils/png_tuning.c - select the PNG compression level from measured speeds
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <globals.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <utils/config.h>
+#include <utils/png_tuning.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+#define LEVEL_CNT 10
+#define DEFAULT_LEVEL 6
+#define MIN_SAMPLE_SIZE 65536  // smaller images are dominated by latency and fixed costs
+#define EXPLORE_INTERVAL 8
+
+/*
+ * Moving averages of recent measurements. A value of 0 means that it is not measured yet.
+ */
+typedef struct _png_stats {
+    uint64_t encode_ns_per_kib[LEVEL_CNT];
+    uint64_t size_permille[LEVEL_CNT]; /* compressed size as a fraction of the raw size */
+    uint64_t send_ns_per_kib;
+    uint64_t encode_cnt;
+} png_stats;
+
+static png_stats local_stats;
+static png_stats *stats = &local_stats;
+
+void init_png_tuning(void) {
+#if defined(__linux__) || defined(__APPLE__)
+    // connections are served in forked processes. Keep the statistics in memory shared with all of them
+    void *shared = mmap(NULL, sizeof(png_stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared != MAP_FAILED) stats = (png_stats *)shared;
+#endif
+}
+
+static inline uint64_t _load(const uint64_t *ptr) { return __atomic_load_n(ptr, __ATOMIC_RELAXED); }
+
+/*
+ * Update the moving average with a new sample weighted by 1/4.
+ */
+static inline void _update_average(uint64_t *avg_p, uint64_t sample) {
+    if (sample == 0) sample = 1;
+    const uint64_t avg = _load(avg_p);
+    __atomic_store_n(avg_p, avg ? (avg * 3 + sample) / 4 : sample, __ATOMIC_RELAXED);
+}
+
+/*
+ * Estimated time to encode and send a KiB of raw image data at the given level.
+ * returns UINT64_MAX if the level is not measured yet.
+ */
+static inline uint64_t _estimated_cost(int level, uint64_t send_ns_per_kib) {
+    const uint64_t encode_ns = _load(&(stats->encode_ns_per_kib[level]));
+    const uint64_t size_permille = _load(&(stats->size_permille[level]));
+    if (!encode_ns || !size_permille) return UINT64_MAX;
+    return encode_ns + size_permille * send_ns_per_kib / 1000;
+}
+
+int get_png_level(void) {
+    if (configuration.png.level != PNG_LEVEL_AUTO) return configuration.png.level;
+    const uint64_t send_ns_per_kib = _load(&(stats->send_ns_per_kib));
+    if (!send_ns_per_kib) return DEFAULT_LEVEL;
+
+    int best = -1;
+    uint64_t best_cost = UINT64_MAX;
+    for (int level = 0; level < LEVEL_CNT; level++) {
+        const uint64_t cost = _estimated_cost(level, send_ns_per_kib);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = level;
+        }
+    }
+    if (best < 0) return DEFAULT_LEVEL;
+
+    // Measure the neighbouring levels of the best one if they are not measured yet, and re-measure one of them
+    // periodically so that the selection follows changes in the link and in the content of the screen.
+    const int lower = best - 1;
+    const int upper = best + 1;
+    if (lower >= 0 && !_load(&(stats->encode_ns_per_kib[lower]))) return lower;
+    if (upper < LEVEL_CNT && !_load(&(stats->encode_ns_per_kib[upper]))) return upper;
+    const uint64_t cnt = __atomic_fetch_add(&(stats->encode_cnt), 1, __ATOMIC_RELAXED);
+    if (cnt % EXPLORE_INTERVAL == EXPLORE_INTERVAL - 1) {
+        const int neighbour = (cnt / EXPLORE_INTERVAL) % 2 ? lower : upper;
+        if (0 <= neighbour && neighbour < LEVEL_CNT) return neighbour;
+    }
+    return best;
+}
+
+void record_png_encode(int level, size_t raw_size, size_t png_size, uint64_t nanos) {
+    if (level < 0 || level >= LEVEL_CNT || raw_size < MIN_SAMPLE_SIZE) return;
+    _update_average(&(stats->encode_ns_per_kib[level]), nanos / (raw_size / 1024));
+    _update_average(&(stats->size_permille[level]), (uint64_t)png_size * 1000 / raw_size);
+}
+
+void record_image_send(size_t size, uint64_t nanos) {
+    if (size < MIN_SAMPLE_SIZE) return;
+    _update_average(&(stats->send_ns_per_kib), nanos / (size / 1024));
+}
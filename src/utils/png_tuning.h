@@ -0,0 +1,50 @@
+/*
+ * utils/png_tuning.h - select the PNG compression level from measured speeds
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_PNG_TUNING_H_
+#define UTILS_PNG_TUNING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Prepare the statistics used to select the PNG compression level in auto mode.
+ * This must be called before creating the server processes so that all processes share the same statistics.
+ */
+extern void init_png_tuning(void);
+
+/*
+ * Get the zlib compression level to encode a PNG image with.
+ * If configuration.png.level is PNG_LEVEL_AUTO, the level that is expected to deliver the image to the client in the
+ * shortest time is selected from the encoding speeds and compression ratios of recent images and the observed link
+ * bandwidth. Otherwise, the configured level is returned.
+ */
+extern int get_png_level(void);
+
+/*
+ * Record that an image of raw_size bytes before compression was encoded into png_size bytes at the given level in nanos
+ * nanoseconds.
+ */
+extern void record_png_encode(int level, size_t raw_size, size_t png_size, uint64_t nanos);
+
+/*
+ * Record that an image of size bytes took nanos nanoseconds to reach the client.
+ */
+extern void record_image_send(size_t size, uint64_t nanos);
+
+#endif  // UTILS_PNG_TUNING_H_
@@ -0,0 +1,272 @@
+/*
+ * utils/unistr_wrap.c - validate UTF-8 text
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <utils/unistr_wrap.h>
+
+// AVX2 is not available on every x86 processor. So it is used only if the processor supports it
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define UTF8_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define UTF8_NEON
+#include <arm_neon.h>
+#endif
+
+// texts shorter than this are validated one character at a time
+#define MIN_VECTOR_LEN 64
+
+#if defined(UTF8_AVX2) || defined(UTF8_NEON)
+/*
+ * Errors of a pair of consecutive bytes, which are found by looking up the nibbles of the two bytes in the tables below
+ * and taking the common bits of the three results.
+ */
+#define TOO_SHORT (1 << 0)      /* a lead byte followed by a byte that is not a continuation byte */
+#define TOO_LONG (1 << 1)       /* an ASCII byte followed by a continuation byte */
+#define OVERLONG_3 (1 << 2)     /* 11100000 100_____ */
+#define TOO_LARGE (1 << 3)      /* a code point above U+10FFFF */
+#define SURROGATE (1 << 4)      /* 11101101 101_____ */
+#define OVERLONG_2 (1 << 5)     /* 1100000_ 10______ */
+#define TOO_LARGE_1000 (1 << 6) /* 11110101 1000____ and above */
+#define OVERLONG_4 (1 << 6)     /* 11110000 1000____ */
+#define TWO_CONTS (1 << 7)      /* two continuation bytes, which is valid only within a 3 or 4 byte sequence */
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t byte_1_high[16] = {TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                                        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, TOO_SHORT | OVERLONG_2, TOO_SHORT,
+                                        TOO_SHORT | OVERLONG_3 | SURROGATE,
+                                        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+static const uint8_t byte_1_low[16] = {CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+                                       CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+static const uint8_t byte_2_high[16] = {TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                                        TOO_SHORT,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT, TOO_SHORT,
+                                        TOO_SHORT, TOO_SHORT};
+
+/*
+ * Subtracting these from the last 32 bytes of a block leaves non-zero values only at lead bytes of sequences that do
+ * not end within the block.
+ */
+static const uint8_t max_value[32] = {255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+                                      255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+                                      255, 255, 255, 255, 255, 255, 255, 0xEF, 0xDF, 0xBF};
+#endif
+
+/*
+ * Get the length of the sequence started by the lead byte c. Bytes that can not start a sequence are treated as the
+ * start of sequences of 1 byte, which _check_seq() rejects.
+ */
+static inline size_t _seq_len(uint8_t c) {
+    if (c >= 0xF0) return 4;
+    if (c >= 0xE0) return 3;
+    if (c >= 0xC0) return 2;
+    return 1;
+}
+
+/*
+ * Check the sequence starting at seq, of which only avail bytes are available.
+ * returns the length of the sequence if the available bytes of it are valid, or 0 otherwise.
+ */
+static inline size_t _check_seq(const uint8_t *seq, size_t avail) {
+    const uint8_t c = seq[0];
+    if (c < 0x80) return 1;
+    // the allowed range of the second byte is narrower for some lead bytes to reject overlong forms, surrogates and
+    // code points above U+10FFFF
+    uint8_t min_2 = 0x80;
+    uint8_t max_2 = 0xBF;
+    if (c < 0xC2 || c > 0xF4) return 0;
+    if (c == 0xE0) min_2 = 0xA0;
+    if (c == 0xED) max_2 = 0x9F;
+    if (c == 0xF0) min_2 = 0x90;
+    if (c == 0xF4) max_2 = 0x8F;
+    const size_t seq_len = _seq_len(c);
+    if (avail > 1 && (seq[1] < min_2 || seq[1] > max_2)) return 0;
+    for (size_t i = 2; i < seq_len && i < avail; i++) {
+        if ((seq[i] & 0xC0) != 0x80) return 0;
+    }
+    return seq_len;
+}
+
+static int _is_valid_scalar(const uint8_t *str, size_t len) {
+    size_t ind = 0;
+    while (ind < len) {
+        if (ind + 8 <= len) {  // skip 8 ASCII bytes at once
+            uint64_t word;
+            memcpy(&word, str + ind, 8);
+            if (!(word & 0x8080808080808080ULL)) {
+                ind += 8;
+                continue;
+            }
+        }
+        const size_t seq_len = _check_seq(str + ind, len - ind);
+        if (!seq_len || seq_len > len - ind) return 0;
+        ind += seq_len;
+    }
+    return 1;
+}
+
+#ifdef UTF8_AVX2
+static inline __attribute__((target("avx2"))) __m256i _lookup_avx2(const uint8_t *table, __m256i nibbles) {
+    const __m256i tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *)table));
+    return _mm256_shuffle_epi8(tbl, nibbles);
+}
+
+static __attribute__((target("avx2"))) int _is_valid_avx2(const uint8_t *str, size_t len) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i high_bit = _mm256_set1_epi8((char)0x80);
+    const __m256i third_min = _mm256_set1_epi8((char)(0xE0 - 0x80));
+    const __m256i fourth_min = _mm256_set1_epi8((char)(0xF0 - 0x80));
+    const __m256i max = _mm256_loadu_si256((const __m256i *)(const void *)max_value);
+    __m256i prev = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    __m256i err = _mm256_setzero_si256();
+    for (size_t ind = 0; ind < len; ind += 32) {
+        __m256i input;
+        if (ind + 32 <= len) {
+            input = _mm256_loadu_si256((const __m256i *)(const void *)(str + ind));
+        } else {  // pad the last block with null bytes, which are valid
+            uint8_t last[32] = {0};
+            memcpy(last, str + ind, len - ind);
+            input = _mm256_loadu_si256((const __m256i *)(const void *)last);
+        }
+        if (!_mm256_movemask_epi8(input)) {  // ASCII only. So the previous block must not end within a sequence
+            err = _mm256_or_si256(err, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+            prev = input;
+            continue;
+        }
+        // the block shifted by 1, 2 and 3 bytes, taking the shifted-in bytes from the end of the previous block
+        const __m256i carried = _mm256_permute2x128_si256(prev, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+        const __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+        const __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+        const __m256i prev1_high = _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble);
+        const __m256i input_high = _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble);
+        __m256i special = _lookup_avx2(byte_1_high, prev1_high);
+        special = _mm256_and_si256(special, _lookup_avx2(byte_1_low, _mm256_and_si256(prev1, low_nibble)));
+        special = _mm256_and_si256(special, _lookup_avx2(byte_2_high, input_high));
+        // the third and fourth bytes of sequences must be continuation bytes, which the lookups flag as TWO_CONTS
+        const __m256i must_continue = _mm256_or_si256(_mm256_subs_epu8(prev2, third_min),
+                                                      _mm256_subs_epu8(prev3, fourth_min));
+        err = _mm256_or_si256(err, _mm256_xor_si256(_mm256_and_si256(must_continue, high_bit), special));
+        prev_incomplete = _mm256_subs_epu8(input, max);
+        prev = input;
+    }
+    err = _mm256_or_si256(err, prev_incomplete);
+    return _mm256_testz_si256(err, err);
+}
+#endif
+
+#ifdef UTF8_NEON
+static int _is_valid_neon(const uint8_t *str, size_t len) {
+    const uint8x16_t tbl_1_high = vld1q_u8(byte_1_high);
+    const uint8x16_t tbl_1_low = vld1q_u8(byte_1_low);
+    const uint8x16_t tbl_2_high = vld1q_u8(byte_2_high);
+    const uint8x16_t low_nibble = vdupq_n_u8(0x0F);
+    const uint8x16_t high_bit = vdupq_n_u8(0x80);
+    const uint8x16_t third_min = vdupq_n_u8(0xE0 - 0x80);
+    const uint8x16_t fourth_min = vdupq_n_u8(0xF0 - 0x80);
+    const uint8x16_t max = vld1q_u8(max_value + 16);
+    uint8x16_t prev = vdupq_n_u8(0);
+    uint8x16_t prev_incomplete = vdupq_n_u8(0);
+    uint8x16_t err = vdupq_n_u8(0);
+    for (size_t ind = 0; ind < len; ind += 16) {
+        uint8x16_t input;
+        if (ind + 16 <= len) {
+            input = vld1q_u8(str + ind);
+        } else {  // pad the last block with null bytes, which are valid
+            uint8_t last[16] = {0};
+            memcpy(last, str + ind, len - ind);
+            input = vld1q_u8(last);
+        }
+        if (vmaxvq_u8(input) < 0x80) {  // ASCII only. So the previous block must not end within a sequence
+            err = vorrq_u8(err, prev_incomplete);
+            prev_incomplete = vdupq_n_u8(0);
+            prev = input;
+            continue;
+        }
+        // the block shifted by 1, 2 and 3 bytes, taking the shifted-in bytes from the end of the previous block
+        const uint8x16_t prev1 = vextq_u8(prev, input, 15);
+        const uint8x16_t prev2 = vextq_u8(prev, input, 14);
+        const uint8x16_t prev3 = vextq_u8(prev, input, 13);
+        uint8x16_t special = vqtbl1q_u8(tbl_1_high, vshrq_n_u8(prev1, 4));
+        special = vandq_u8(special, vqtbl1q_u8(tbl_1_low, vandq_u8(prev1, low_nibble)));
+        special = vandq_u8(special, vqtbl1q_u8(tbl_2_high, vshrq_n_u8(input, 4)));
+        // the third and fourth bytes of sequences must be continuation bytes, which the lookups flag as TWO_CONTS
+        const uint8x16_t must_continue = vorrq_u8(vqsubq_u8(prev2, third_min), vqsubq_u8(prev3, fourth_min));
+        err = vorrq_u8(err, veorq_u8(vandq_u8(must_continue, high_bit), special));
+        prev_incomplete = vqsubq_u8(input, max);
+        prev = input;
+    }
+    err = vorrq_u8(err, prev_incomplete);
+    return vmaxvq_u8(err) == 0;
+}
+#endif
+
+int utf8_is_valid(const uint8_t *str, size_t len) {
+    if (len < MIN_VECTOR_LEN) return _is_valid_scalar(str, len);
+#if defined(UTF8_AVX2)
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    if (has_avx2) return _is_valid_avx2(str, len);
+    return _is_valid_scalar(str, len);
+#elif defined(UTF8_NEON)
+    return _is_valid_neon(str, len);
+#else
+    return _is_valid_scalar(str, len);
+#endif
+}
+
+int utf8_check_part(utf8_stream *stream, const uint8_t *part, size_t len) {
+    size_t ind = 0;
+    if (stream->pending_len) {  // complete the sequence that did not end within the previous part
+        const size_t seq_len = _seq_len(stream->pending[0]);
+        while (stream->pending_len < seq_len && ind < len) stream->pending[stream->pending_len++] = part[ind++];
+        if (!_check_seq(stream->pending, stream->pending_len)) return 0;
+        if (stream->pending_len < seq_len) return 1;
+        stream->pending_len = 0;
+    }
+    // find the last sequence of the part if it does not end within the part
+    size_t tail = len;
+    for (size_t back = 1; back <= 3 && back <= len - ind; back++) {
+        const uint8_t c = part[len - back];
+        if ((c & 0xC0) == 0x80) continue;  // continuation byte
+        if (_seq_len(c) > back) tail = len - back;
+        break;
+    }
+    if (!utf8_is_valid(part + ind, tail - ind)) return 0;
+    if (tail == len) return 1;
+    if (!_check_seq(part + tail, len - tail)) return 0;
+    memcpy(stream->pending, part + tail, len - tail);
+    stream->pending_len = (uint8_t)(len - tail);
+    return 1;
+}
+
+int utf8_check_end(const utf8_stream *stream) { return !stream->pending_len; }
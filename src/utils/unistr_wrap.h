@@ -27,4 +27,36 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Check whether the len bytes at str are valid UTF-8 as u8_check() does, but with vector instructions where they are
+ * available. Null bytes are valid.
+ * returns 1 if the text is valid UTF-8, or 0 otherwise.
+ */
+extern int utf8_is_valid(const uint8_t *str, size_t len);
+
+/*
+ * State of validating a text that is checked in parts with utf8_check_part(). Initialize all fields to 0 before
+ * checking the first part.
+ */
+typedef struct _utf8_stream {
+    uint8_t pending[4];  /* bytes of a sequence that did not end within the previous part */
+    uint8_t pending_len; /* number of bytes in pending */
+} utf8_stream;
+
+/*
+ * Check whether the len bytes at part, which follow the parts already checked with stream, are valid UTF-8. A sequence
+ * split across parts is checked as far as its bytes are available.
+ * returns 1 if the text is valid UTF-8 so far, or 0 otherwise.
+ */
+extern int utf8_check_part(utf8_stream *stream, const uint8_t *part, size_t len);
+
+/*
+ * Check whether the text checked in parts with stream does not end within a sequence. Call this after the last part.
+ * returns 1 if the text is complete, or 0 otherwise.
+ */
+extern int utf8_check_end(const utf8_stream *stream);
+
 #endif  // UTILS_UNISTR_WRAP_H_
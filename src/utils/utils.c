@@ -32,6 +32,8 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <utils/eol.h>
+#include <utils/img_scale.h>
 #include <utils/list_utils.h>
 #include <utils/utils.h>
 #ifdef __linux__
@@ -42,12 +44,14 @@
 #include <ftw.h>
 #else
 #include <X11/Xmu/Atoms.h>
+#include <sys/mman.h>
 #include <xclip/xclip.h>
 #include <xscreenshot/xscreenshot.h>
 #endif
 #endif
 #if defined(__linux__) || defined(__APPLE__)
 #include <time.h>
+#include <utils/dir_walk.h>
 #endif
 #ifdef _WIN32
 #include <direct.h>
@@ -61,6 +65,16 @@
 
 #define MAX_RECURSE_DEPTH 256
 
+// image formats that screenshots can be encoded in on this platform
+#if defined(__linux__) && (HEADLESS != 1)
+#define SCREENSHOT_FORMATS ((1U << IMG_FORMAT_PNG) | (1U << IMG_FORMAT_QOI))
+#else
+#define SCREENSHOT_FORMATS (1U << IMG_FORMAT_PNG)
+#endif
+
+// screenshots of up to this many pixels are encoded in PNG if the client accepts it
+#define SMALL_IMAGE_PIXELS 65536UL
+
 #if defined(__linux__) || defined(__APPLE__)
 
 #define TEMP_FILE "/tmp/clipshare-copied"
@@ -187,6 +201,22 @@ void *realloc_or_free(void *ptr, size_t size) {
     return tmp;
 }
 
+uint64_t get_time_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    const uint64_t ticks_per_sec = (uint64_t)freq.QuadPart;
+    const uint64_t ticks = (uint64_t)count.QuadPart;
+    return ticks / ticks_per_sec * 1000000000ULL + ticks % ticks_per_sec * 1000000000ULL / ticks_per_sec;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
 int file_exists(const char *file_name) {
     if (file_name[0] == 0) return 0;  // empty path
     int f_ok;
@@ -278,91 +308,299 @@ void png_mem_write_data(png_structp png_ptr, png_bytep data, png_size_t length)
 
 #endif
 
-#ifdef _WIN32
-/*
- * Allocate the required capacity for the string with EOL=CRLF including the terminating '\0'.
- * Assign the realloced string to *str_p and the length after conversion to *len_p without the terminating '\0'.
- * Returns 0 if all LF are preceded by CR (i.e. no conversion needed).
- * Returns 1 if conversion is needed and it will increase the length.
- * Returns -1 if realloc failed, and free() the *str_p.
- */
-static inline int _realloc_for_crlf(char **str_p, size_t *len_p) {
-    char *str = *str_p;
-    size_t increase = 0;
-    size_t ind;
-    for (ind = 0; str[ind]; ind++) {
-        if (str[ind] == '\n' && (ind == 0 || str[ind - 1] != '\r')) {
-            // needs increasing
-            increase++;
-        }
+static const struct {
+    uint8_t format;
+    const char *name;
+} image_formats[] = {{IMG_FORMAT_PNG, "png"}, {IMG_FORMAT_QOI, "qoi"}};
+
+uint8_t select_image_format(const img_options *opts, uint64_t pixel_cnt) {
+    int accepts_png = opts->format_cnt == 0;
+    for (uint8_t i = 0; i < opts->format_cnt; i++) {
+        if (opts->formats[i] == IMG_FORMAT_PNG) accepts_png = 1;
     }
-    if (!increase) {
-        *len_p = ind;
-        return 0;
+    if (accepts_png && pixel_cnt <= SMALL_IMAGE_PIXELS) return IMG_FORMAT_PNG;
+    for (uint8_t i = 0; i < opts->format_cnt; i++) {
+        const uint8_t format = opts->formats[i];
+        if (format < 32 && (SCREENSHOT_FORMATS & (1U << format))) return format;
     }
-    uint64_t req_len = (uint64_t)ind + increase;
-    if (req_len >= 0xFFFFFFFFUL) {
-        free(str);
-        error("realloc size too large");
-        return -1;
+    return IMG_FORMAT_PNG;
+}
+
+int region_fits(const img_options *opts, uint32_t width, uint32_t height) {
+    if (opts->region_width == 0 || opts->region_height == 0) return 0;
+    return (uint32_t)opts->region_x + opts->region_width <= width &&
+           (uint32_t)opts->region_y + opts->region_height <= height;
+}
+
+uint8_t image_format_from_name(const char *name) {
+    for (size_t i = 0; i < sizeof(image_formats) / sizeof(image_formats[0]); i++) {
+        if (!strcmp(name, image_formats[i].name)) return image_formats[i].format;
     }
-    *str_p = realloc_or_free(str, (size_t)req_len + 1);  // +1 for terminating '\0'
-    if (!*str_p) return -1;
-    *len_p = (size_t)req_len;
-    return 1;
-}
-
-static inline void _convert_to_crlf(char *str, size_t new_len) {
-    // converting to CRLF expands string. Therefore, start from the end to avoid overwriting
-    size_t new_ind = new_len - 1;
-    str[new_len] = 0;  // terminating '\0'
-    for (size_t cur_ind = strnlen(str, new_len + 1) - 1;; cur_ind--) {
-        char c = str[cur_ind];
-        str[new_ind--] = c;
-        if (c == '\n' && (cur_ind == 0 || str[cur_ind - 1] != '\r')) {
-            // add the missing \r before \n
-            str[new_ind--] = '\r';
-        }
-        if (cur_ind == 0) break;
+    return 0;
+}
+
+int get_image_format_names(char *buf, size_t size) {
+    if (size == 0) return EXIT_FAILURE;
+    buf[0] = '\0';
+    size_t len = 0;
+    for (size_t i = 0; i < sizeof(image_formats) / sizeof(image_formats[0]); i++) {
+        if (!(SCREENSHOT_FORMATS & (1U << image_formats[i].format))) continue;
+        if (snprintf_check(buf + len, size - len, "%s%s", len ? "," : "", image_formats[i].name)) return EXIT_FAILURE;
+        len += strnlen(buf + len, size - len);
     }
+    return EXIT_SUCCESS;
 }
-#endif
 
-static inline int64_t _convert_to_lf(char *str) {
-    // converting to CRLF shrinks string. Therefore, start from the begining to avoid overwriting
-    const char *old_ptr = str;
-    char *new_ptr = str;
-    char c;
-    while ((c = *old_ptr)) {
-        old_ptr++;
-        if (c != '\r' || *old_ptr != '\n') {
-            *new_ptr = c;
-            new_ptr++;
-        }
+void free_frame_tiles(frame_tile *tiles, uint32_t tile_cnt) {
+    if (!tiles) return;
+    for (uint32_t i = 0; i < tile_cnt; i++) {
+        if (tiles[i].data) free(tiles[i].data);
     }
-    *new_ptr = '\0';
-    return new_ptr - str;
+    free(tiles);
 }
 
-int64_t convert_eol(char **str_p, int force_lf) {
+#if !(defined(__linux__) && (HEADLESS != 1))
+// screen streams are implemented with the X server on Linux only
+screen_stream *open_screen_stream(const img_options *opts, uint32_t fps, uint16_t *width_p, uint16_t *height_p) {
+    (void)opts;
+    (void)fps;
+    (void)width_p;
+    (void)height_p;
+    return NULL;
+}
+
+int next_screen_frame(screen_stream *stream, frame_tile **tiles_p, uint32_t *tile_cnt_p) {
+    (void)stream;
+    *tiles_p = NULL;
+    *tile_cnt_p = 0;
+    return EXIT_FAILURE;
+}
+
+void close_screen_stream(screen_stream *stream) { (void)stream; }
+
+// the clipboard is read for each request on the other platforms
+int prefetch_copied_data(void) { return EXIT_SUCCESS; }
+
+void clear_prefetched_data(void) {}
+#endif
+
+int64_t convert_eol(char **str_p, size_t len, int force_lf) {
 #ifdef _WIN32
     if (!force_lf) {  // convert to CRLF
-        size_t new_len;
-        // realloc if available capacity is not enough
-        int status = _realloc_for_crlf(str_p, &new_len);
-        if (status == 0) {  // no conversion needed
-            return (int64_t)new_len;
-        }
-        if (status < 0 || !*str_p) {  // realloc failed
+        const size_t new_len = eol_crlf_len(*str_p, len);
+        if (new_len >= 0xFFFFFFFFUL) {
+            free(*str_p);
+            *str_p = NULL;
+            error("realloc size too large");
             return -1;
         }
-        _convert_to_crlf(*str_p, new_len);
+        if (new_len > len) {  // realloc since the text expands
+            *str_p = realloc_or_free(*str_p, new_len + 1);  // +1 for terminating '\0'
+            if (!*str_p) return -1;
+            eol_to_crlf(*str_p, len, new_len);
+        }
+        (*str_p)[new_len] = 0;
         return (int64_t)new_len;
     }
 #else
     (void)force_lf;
 #endif
-    return _convert_to_lf(*str_p);
+    const size_t new_len = eol_to_lf(*str_p, len);
+    (*str_p)[new_len] = 0;
+    return (int64_t)new_len;
+}
+
+int64_t convert_lf_eol(char **str_p, size_t len) {
+#ifdef _WIN32
+    return convert_eol(str_p, len, 0);
+#else
+    (*str_p)[len] = 0;
+    return (int64_t)len;
+#endif
+}
+
+/*
+ * Converts the EOLs of the text written through it to LF, as eol_to_lf() does, and writes the text with write_fn.
+ */
+typedef struct _lf_writer {
+    data_write_fn write_fn;
+    void *arg;
+    int8_t pending_cr; /* the last part ended with a CR, which is dropped if the next part starts with a LF */
+} lf_writer;
+
+static inline int _write_range(const lf_writer *writer, const char *start, const char *end) {
+    if (end <= start) return EXIT_SUCCESS;
+    return writer->write_fn(writer->arg, start, (size_t)(end - start));
+}
+
+static int _write_lf(void *arg, const char *data, size_t len) {
+    lf_writer *writer = (lf_writer *)arg;
+    if (len == 0) return EXIT_SUCCESS;
+    if (writer->pending_cr) {
+        writer->pending_cr = 0;
+        if (data[0] != '\n' && writer->write_fn(writer->arg, "\r", 1) != EXIT_SUCCESS) return EXIT_FAILURE;
+    }
+    const char *end = data + len;
+    const char *start = data;  // start of the text not written yet
+    const char *next = data;   // where to search for the next CR
+    const char *cr;
+    while ((cr = memchr(next, '\r', (size_t)(end - next)))) {
+        next = cr + 1;
+        if (next == data + len) {  // whether the CR is dropped depends on the next part
+            writer->pending_cr = 1;
+            end = cr;
+            break;
+        }
+        if (*next != '\n') continue;
+        if (_write_range(writer, start, cr) != EXIT_SUCCESS) return EXIT_FAILURE;
+        start = next;
+    }
+    return _write_range(writer, start, end);
+}
+
+#if defined(__linux__) && (HEADLESS != 1)
+
+#define MAX_SNAPSHOT_LEN 1048576UL  // 1 MiB
+
+/*
+ * The last text read from or put into the clipboard, which is served when the clipboard owner does not respond in time.
+ * Connections are served in forked processes. So this is kept in memory shared with all of them, and the text is
+ * guarded by a sequence number as a seqlock.
+ */
+typedef struct _text_snapshot {
+    uint64_t seq; /* incremented before and after the text is changed. So it is odd while the text is being changed */
+    uint32_t len; /* length of the text, or 0 if there is no text */
+    char lock;    /* set while a process changes the text */
+    char text[MAX_SNAPSHOT_LEN];
+} text_snapshot;
+
+static text_snapshot *snapshot = NULL;
+
+void init_text_snapshot(void) {
+    if (!configuration.serve_stale_text) return;
+    void *shared = mmap(NULL, sizeof(text_snapshot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared != MAP_FAILED) snapshot = (text_snapshot *)shared;
+}
+
+/*
+ * Keep the text as the last known clipboard text. Text longer than MAX_SNAPSHOT_LEN clears the snapshot, so that an
+ * older text is not served in place of it. The text is not kept if another process is changing the snapshot.
+ */
+static void _save_snapshot(const char *text, uint32_t len) {
+    if (!snapshot || __atomic_test_and_set(&(snapshot->lock), __ATOMIC_ACQUIRE)) return;
+    if (len > MAX_SNAPSHOT_LEN) len = 0;
+    __atomic_fetch_add(&(snapshot->seq), 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(snapshot->text, text, len);
+    __atomic_store_n(&(snapshot->len), len, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(snapshot->seq), 1, __ATOMIC_RELEASE);
+    __atomic_clear(&(snapshot->lock), __ATOMIC_RELEASE);
+}
+
+/*
+ * Copy the last known clipboard text to a new buffer, which the caller should free.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if there is no text.
+ */
+static int _load_snapshot(char **buf_ptr, uint32_t *len_ptr) {
+    if (!snapshot) return EXIT_FAILURE;
+    // retry a few times if the text changes while it is copied
+    for (int attempt = 0; attempt < 4; attempt++) {
+        const uint64_t seq = __atomic_load_n(&(snapshot->seq), __ATOMIC_ACQUIRE);
+        if (seq % 2) continue;
+        const uint32_t len = __atomic_load_n(&(snapshot->len), __ATOMIC_RELAXED);
+        if (len == 0 || len > MAX_SNAPSHOT_LEN) return EXIT_FAILURE;
+        char *buf = malloc(len + 1);
+        if (!buf) return EXIT_FAILURE;
+        memcpy(buf, snapshot->text, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&(snapshot->seq), __ATOMIC_RELAXED) != seq) {
+            free(buf);
+            continue;
+        }
+        buf[len] = 0;
+        *buf_ptr = buf;
+        *len_ptr = len;
+        return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+/*
+ * Keeps a copy of the text written with _write_lf() through it, up to MAX_SNAPSHOT_LEN bytes, to save it as the last
+ * known clipboard text.
+ */
+typedef struct _snapshot_writer {
+    lf_writer *lf;
+    char *buf;
+    uint32_t len;
+    int8_t overflow; /* the text is longer than MAX_SNAPSHOT_LEN */
+} snapshot_writer;
+
+static int _write_and_keep(void *arg, const char *data, size_t len) {
+    snapshot_writer *writer = (snapshot_writer *)arg;
+    if (writer->buf && !writer->overflow) {
+        if (len > MAX_SNAPSHOT_LEN - writer->len) {
+            writer->overflow = 1;
+        } else {
+            memcpy(writer->buf + writer->len, data, len);
+            writer->len += (uint32_t)len;
+        }
+    }
+    return _write_lf(writer->lf, data, len);
+}
+
+int get_stale_text(char **buf_ptr, uint32_t *len_ptr) { return _load_snapshot(buf_ptr, len_ptr); }
+
+#else
+// the clipboard is read without waiting for other applications on the other platforms
+void init_text_snapshot(void) {}
+
+int get_stale_text(char **buf_ptr, uint32_t *len_ptr) {
+    (void)buf_ptr;
+    (void)len_ptr;
+    return EXIT_FAILURE;
+}
+#endif
+
+int stream_clipboard_text(data_write_fn write_fn, void *arg) {
+    lf_writer writer = {.write_fn = write_fn, .arg = arg, .pending_cr = 0};
+#if defined(__linux__) && (HEADLESS != 1)
+    uint64_t len;
+    snapshot_writer keeper = {.lf = &writer, .buf = NULL, .len = 0, .overflow = 0};
+    if (snapshot) keeper.buf = malloc(MAX_SNAPSHOT_LEN);
+    int status = xclip_stream(NULL, _write_and_keep, &keeper, &len);
+    if (status == EXIT_SUCCESS) {
+        if (keeper.buf) _save_snapshot(keeper.buf, keeper.overflow ? UINT32_MAX : keeper.len);
+    } else if (status == CLIPBOARD_TIMEOUT && len == 0) {
+        // nothing is written yet. So the last known text can be written instead
+        char *stale;
+        uint32_t stale_len;
+        if (_load_snapshot(&stale, &stale_len) == EXIT_SUCCESS) {
+            status = _write_lf(&writer, stale, stale_len);
+            free(stale);
+        }
+    }
+    if (keeper.buf) free(keeper.buf);
+    if (status != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        printf("xclip stream text failed. len = %" PRIu64 "\n", len);
+#endif
+        return status;
+    }
+#else
+    // the text is written at once on platforms where the clipboard cannot be read in parts
+    uint32_t len = 0;
+    char *buf = NULL;
+    if (get_clipboard_text(&buf, &len) != EXIT_SUCCESS || len == 0 || !buf) {
+        if (buf) free(buf);
+        return EXIT_FAILURE;
+    }
+    const int status = _write_lf(&writer, buf, len);
+    free(buf);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+#endif
+    if (writer.pending_cr) return write_fn(arg, "\r", 1);
+    return EXIT_SUCCESS;
 }
 
 #if PROTOCOL_MIN <= 1
@@ -389,15 +627,18 @@ list2 *get_copied_files(void) {
         return NULL;
     }
 
-    list2 *lst = init_list((uint32_t)file_cnt);
+    list2 *lst = init_str_list((uint32_t)file_cnt);
     if (!lst) {
         free(fnames);
         return NULL;
     }
+    // names of the regular files are moved to the start of the buffer, and then appended to the list together
+    char *kept_end = file_path;
     char *fname = file_path;
     for (size_t i = 0; i < file_cnt; i++) {
         size_t off = strnlen(fname, MAX_FILE_NAME_LEN) + 1;
-        if (url_decode(fname, NULL) != EXIT_SUCCESS) break;
+        uint32_t fname_len;
+        if (url_decode(fname, &fname_len) != EXIT_SUCCESS) break;
 
         struct stat statbuf;
         if (stat(fname, &statbuf)) {
@@ -414,9 +655,11 @@ list2 *get_copied_files(void) {
             fname += off;
             continue;
         }
-        append(lst, strdup(fname));
+        memmove(kept_end, fname, (size_t)fname_len + 1);
+        kept_end += fname_len + 1;
         fname += off;
     }
+    append_strs(lst, file_path, (size_t)(kept_end - file_path), '\0');
     free(fnames);
     return lst;
 }
@@ -458,7 +701,7 @@ list2 *get_copied_files(void) {
         CloseClipboard();
         return NULL;
     }
-    list2 *lst = init_list((uint32_t)file_cnt);
+    list2 *lst = init_str_list((uint32_t)file_cnt);
     if (!lst) {
         GlobalUnlock(hGlobal);
         CloseClipboard();
@@ -489,7 +732,7 @@ list2 *get_copied_files(void) {
 
 #endif  // PROTOCOL_MIN <= 1
 
-#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
 
 /*
  * Try to create the directory at path.
@@ -575,7 +818,7 @@ list2 *list_dir(const char *dirname) {
 #endif
         return NULL;
     }
-    list2 *lst = init_list(2);
+    list2 *lst = init_str_list(2);
     if (!lst) return NULL;
     while (1) {
 #if defined(__linux__) || defined(__APPLE__)
@@ -589,7 +832,7 @@ list2 *list_dir(const char *dirname) {
         filename = dir->d_name;
 #if defined(__linux__) || defined(__APPLE__)
         if (!(strcmp(filename, ".") && strcmp(filename, ".."))) continue;
-        append(lst, strdup(filename));
+        append_str(lst, filename, strnlen(filename, sizeof(dir->d_name)));
 #elif defined(_WIN32)
         if (!(wcscmp(filename, L".") && wcscmp(filename, L".."))) continue;
         _wappend(lst, filename);
@@ -603,85 +846,52 @@ list2 *list_dir(const char *dirname) {
     return lst;
 }
 
-#if defined(__linux__) || defined(__APPLE__)
-
 /*
- * Check if the path is a file or a directory.
- * If the path is a directory, calls _recurse_dir() on that.
- * Otherwise, appends the path to the list
+ * State of walking through the copied files and directories with walk_copied_dirs_files()
  */
-static void _process_path(const char *path, list2 *lst, int depth, int include_leaf_dirs);
+typedef struct _path_walker {
+    path_visit_fn visit_fn;
+    void *arg;
+    size_t path_len; /* length of the path of the directory from which the files are copied */
+#ifdef _WIN32
+    int include_leaf_dirs; /* whether empty directories are visited */
+#endif
+} path_walker;
 
-/*
- * Recursively append all file paths in the directory and its subdirectories
- * to the list.
- * maximum recursion depth is limited to MAX_RECURSE_DEPTH
- */
-static void _recurse_dir(const char *_path, list2 *lst, int depth, int include_leaf_dirs);
+static int _append_path(void *arg, const char *path, size_t path_len, int64_t size) {
+    (void)size;
+    dir_files *dfiles_p = (dir_files *)arg;
+    dfiles_p->path_len = path_len;
+    append_str(dfiles_p->lst, path, strlen(path));
+    return EXIT_SUCCESS;
+}
 
-static void _process_path(const char *path, list2 *lst, int depth, int include_leaf_dirs) {
-    struct stat sb;
-    if (lstat(path, &sb) != 0) return;
-    if (S_ISDIR(sb.st_mode)) {
-        _recurse_dir(path, lst, depth + 1, include_leaf_dirs);
-    } else if (S_ISREG(sb.st_mode)) {
-        append(lst, strdup(path));
+void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
+    dfiles_p->path_len = 0;
+    dfiles_p->lst = init_str_list(2);
+    if (!dfiles_p->lst) return;
+    if (walk_copied_dirs_files(include_leaf_dirs, _append_path, dfiles_p) != EXIT_SUCCESS) {
+        free_list(dfiles_p->lst);
+        dfiles_p->lst = NULL;
+        dfiles_p->path_len = 0;
     }
 }
 
-static void _recurse_dir(const char *_path, list2 *lst, int depth, int include_leaf_dirs) {
-    if (depth > MAX_RECURSE_DEPTH) return;
-    DIR *d = opendir(_path);
-    if (!d) {
-#ifdef DEBUG_MODE
-        printf("Error opening directory %s", _path);
-#endif
-        return;
-    }
-    size_t p_len = strnlen(_path, MAX_FILE_NAME_LEN + 2);
-    if (p_len > MAX_FILE_NAME_LEN) {
-        error("Too long file name.");
-        (void)closedir(d);
-        return;
-    }
-    char path[p_len + 2];
-    strncpy(path, _path, p_len + 1);
-    path[p_len + 1] = 0;
-    if (path[p_len - 1] != PATH_SEP) {
-        path[p_len++] = PATH_SEP;
-        path[p_len] = '\0';
-    }
-    const struct dirent *dir;
-    int is_empty = 1;
-    while ((dir = readdir(d)) != NULL) {
-        const char *filename = dir->d_name;
-        if (!(strcmp(filename, ".") && strcmp(filename, ".."))) continue;
-        is_empty = 0;
-        const size_t _fname_len = strnlen(filename, sizeof(dir->d_name));
-        if ((_fname_len + p_len) > MAX_FILE_NAME_LEN) {
-            error("Too long file name.");
-            (void)closedir(d);
-            return;
-        }
-        char pathname[_fname_len + p_len + 1];
-        strncpy(pathname, path, p_len);
-        strncpy(pathname + p_len, filename, _fname_len + 1);
-        pathname[p_len + _fname_len] = 0;
-        _process_path(pathname, lst, depth, include_leaf_dirs);
-    }
-    if (include_leaf_dirs && is_empty) {
-        append(lst, strdup(path));
-    }
-    (void)closedir(d);
+#if defined(__linux__) || defined(__APPLE__)
+
+/*
+ * Visit a path found by walk_dirs() with the walker.
+ */
+static int _visit_walked(void *arg, const char *path, int64_t size) {
+    const path_walker *walker = (const path_walker *)arg;
+    return walker->visit_fn(walker->arg, path, walker->path_len, size);
 }
 
-void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
-    dfiles_p->lst = NULL;
-    dfiles_p->path_len = 0;
+int walk_copied_dirs_files(int include_leaf_dirs, path_visit_fn visit_fn, void *arg) {
     int offset = 0;
     char *fnames = get_copied_files_as_str(&offset);
     if (!fnames) {
-        return;
+        return EXIT_FAILURE;
     }
     char *file_path = fnames + offset;
 
@@ -694,15 +904,16 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
     }
     if (file_cnt >= 0xFFFFFFFFUL) {
         free(fnames);
-        return;
+        return EXIT_FAILURE;
     }
-
-    list2 *lst = init_list((uint32_t)file_cnt);
-    if (!lst) {
+    list2 *dirs = init_str_list(2);
+    if (!dirs) {
         free(fnames);
-        return;
+        return EXIT_FAILURE;
     }
-    dfiles_p->lst = lst;
+
+    // empty directories are found by walk_dirs(). So the walker does not need include_leaf_dirs
+    path_walker walker = {.visit_fn = visit_fn, .arg = arg, .path_len = 0};
     char *fname = file_path;
     for (size_t i = 0; i < file_cnt; i++) {
         const size_t off = strnlen(fname, MAX_FILE_NAME_LEN) + 1;
@@ -713,7 +924,7 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             if (fname[fname_len - 1] == PATH_SEP) fname[fname_len - 1] = 0;  // if directory, remove ending /
             const char *sep_ptr = strrchr(fname, PATH_SEP);
             if (sep_ptr > fname) {
-                dfiles_p->path_len = (size_t)(sep_ptr - fname) + 1;
+                walker.path_len = (size_t)(sep_ptr - fname) + 1;
             }
         }
 
@@ -725,14 +936,21 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             fname += off;
             continue;
         }
+        // directories are walked together after the copied files are visited
         if (S_ISDIR(statbuf.st_mode)) {
-            _recurse_dir(fname, lst, 1, include_leaf_dirs);
-        } else if (S_ISREG(statbuf.st_mode)) {
-            append(lst, strdup(fname));
+            append_str(dirs, fname, strnlen(fname, fname_len));
+        } else if (S_ISREG(statbuf.st_mode) &&
+                   visit_fn(arg, fname, walker.path_len, (int64_t)statbuf.st_size) != EXIT_SUCCESS) {
+            free_list(dirs);
+            free(fnames);
+            return EXIT_FAILURE;
         }
         fname += off;
     }
     free(fnames);
+    int status = walk_dirs(dirs, MAX_RECURSE_DEPTH, include_leaf_dirs, _visit_walked, &walker);
+    free_list(dirs);
+    return status;
 }
 
 #elif defined(_WIN32)
@@ -762,44 +980,63 @@ void create_temp_file(void) {
     close(fd);
 }
 
+/*
+ * Visit the path with the walker after converting it to UTF-8. size is the size of the file, or -1 if not known.
+ * returns the result of the visit function, or EXIT_SUCCESS if the path could not be converted.
+ */
+static int _wvisit(const path_walker *walker, const wchar_t *wpath, int64_t size) {
+    char *utf8path;
+    if (wchar_to_utf8_str(wpath, &utf8path, NULL) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        wprintf(L"Error while converting file path: %s\n", wpath);
+#endif
+        return EXIT_SUCCESS;
+    }
+    int status = walker->visit_fn(walker->arg, utf8path, walker->path_len, size);
+    free(utf8path);
+    return status;
+}
+
 /*
  * Check if the path is a file or a directory.
  * If the path is a directory, calls _recurse_dir() on that.
- * Otherwise, appends the path to the list
+ * Otherwise, visits the path with the walker.
+ * returns EXIT_FAILURE if the visit function stopped the walk, or EXIT_SUCCESS otherwise.
  */
-static void _process_path(const wchar_t *path, list2 *lst, int depth, int include_leaf_dirs);
+static int _process_path(const wchar_t *path, const path_walker *walker, int depth);
 
 /*
- * Recursively append all file paths in the directory and its subdirectories
- * to the list.
+ * Recursively visit all file paths in the directory and its subdirectories with the walker.
  * maximum recursion depth is limited to MAX_RECURSE_DEPTH
+ * returns EXIT_FAILURE if the visit function stopped the walk, or EXIT_SUCCESS otherwise.
  */
-static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int include_leaf_dirs);
+static int _recurse_dir(const wchar_t *_path, const path_walker *walker, int depth);
 
-static void _process_path(const wchar_t *path, list2 *lst, int depth, int include_leaf_dirs) {
+static int _process_path(const wchar_t *path, const path_walker *walker, int depth) {
     struct _stat64 sb;
-    if (_wstat64(path, &sb) != 0) return;
+    if (_wstat64(path, &sb) != 0) return EXIT_SUCCESS;
     if (S_ISDIR(sb.st_mode)) {
-        _recurse_dir(path, lst, depth + 1, include_leaf_dirs);
+        return _recurse_dir(path, walker, depth + 1);
     } else if (S_ISREG(sb.st_mode)) {
-        _wappend(lst, path);
+        return _wvisit(walker, path, (int64_t)sb.st_size);
     }
+    return EXIT_SUCCESS;
 }
 
-static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int include_leaf_dirs) {
-    if (depth > MAX_RECURSE_DEPTH) return;
+static int _recurse_dir(const wchar_t *_path, const path_walker *walker, int depth) {
+    if (depth > MAX_RECURSE_DEPTH) return EXIT_SUCCESS;
     _WDIR *d = _wopendir(_path);
     if (!d) {
 #ifdef DEBUG_MODE
         wprintf(L"Error opening directory %s", _path);
 #endif
-        return;
+        return EXIT_SUCCESS;
     }
     size_t p_len = wcsnlen(_path, MAX_FILE_NAME_LEN + 2);
     if (p_len > MAX_FILE_NAME_LEN) {
         error("Too long file name.");
         (void)_wclosedir(d);
-        return;
+        return EXIT_SUCCESS;
     }
     wchar_t path[p_len + 2];
     wcsncpy(path, _path, p_len + 1);
@@ -818,40 +1055,41 @@ static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int includ
         if (_fname_len + p_len > MAX_FILE_NAME_LEN) {
             error("Too long file name.");
             (void)_wclosedir(d);
-            return;
+            return EXIT_SUCCESS;
         }
         wchar_t pathname[_fname_len + p_len + 1];
         wcsncpy(pathname, path, p_len);
         wcsncpy(pathname + p_len, filename, _fname_len + 1);
         pathname[p_len + _fname_len] = 0;
-        _process_path(pathname, lst, depth, include_leaf_dirs);
-    }
-    if (include_leaf_dirs && is_empty) {
-        _wappend(lst, wcsdup(path));
+        if (_process_path(pathname, walker, depth) != EXIT_SUCCESS) {
+            (void)_wclosedir(d);
+            return EXIT_FAILURE;
+        }
     }
     (void)_wclosedir(d);
+    if (walker->include_leaf_dirs && is_empty) {
+        return _wvisit(walker, path, -1);
+    }
+    return EXIT_SUCCESS;
 }
 
-void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
-    dfiles_p->lst = NULL;
-    dfiles_p->path_len = 0;
-
+int walk_copied_dirs_files(int include_leaf_dirs, path_visit_fn visit_fn, void *arg) {
     if (!OpenClipboardWrapper(NULL)) {
-        return;
+        return EXIT_FAILURE;
     }
     if (!IsClipboardFormatAvailable(CF_HDROP)) {
         CloseClipboard();
-        return;
+        return EXIT_FAILURE;
     }
     HGLOBAL hGlobal = (HGLOBAL)GetClipboardData(CF_HDROP);
     if (!hGlobal) {
         CloseClipboard();
-        return;
+        return EXIT_FAILURE;
     }
     HDROP hDrop = (HDROP)GlobalLock(hGlobal);
     if (!hDrop) {
         CloseClipboard();
-        return;
+        return EXIT_FAILURE;
     }
 
     size_t file_cnt = DragQueryFileW(hDrop, (UINT)(-1), NULL, MAX_PATH);
@@ -859,19 +1097,26 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
     if (file_cnt <= 0 || file_cnt >= 0xFFFFFFFFUL) {
         GlobalUnlock(hGlobal);
         CloseClipboard();
-        return;
+        return EXIT_FAILURE;
     }
-    list2 *lst = init_list((uint32_t)file_cnt);
-    if (!lst) {
+    // the file names are copied out of the clipboard. So the clipboard is not kept open while the files are visited
+    wchar_t(*fileNames)[MAX_PATH + 1] = malloc(file_cnt * sizeof(*fileNames));
+    if (!fileNames) {
         GlobalUnlock(hGlobal);
         CloseClipboard();
-        return;
+        return EXIT_FAILURE;
     }
-    dfiles_p->lst = lst;
-    wchar_t fileName[MAX_PATH + 1];
     for (size_t i = 0; i < file_cnt; i++) {
-        fileName[0] = 0;
-        DragQueryFileW(hDrop, (UINT)i, fileName, MAX_PATH);
+        fileNames[i][0] = 0;
+        DragQueryFileW(hDrop, (UINT)i, fileNames[i], MAX_PATH);
+    }
+    GlobalUnlock(hGlobal);
+    CloseClipboard();
+
+    path_walker walker = {.visit_fn = visit_fn, .arg = arg, .path_len = 0, .include_leaf_dirs = include_leaf_dirs};
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < file_cnt && status == EXIT_SUCCESS; i++) {
+        const wchar_t *fileName = fileNames[i];
         DWORD attr = GetFileAttributesW(fileName);
         DWORD dontWant = FILE_ATTRIBUTE_DEVICE | FILE_ATTRIBUTE_REPARSE_POINT | FILE_ATTRIBUTE_OFFLINE;
         if (attr & dontWant) {
@@ -881,19 +1126,19 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             continue;
         }
         if (i == 0) {
-            wchar_t *sep_ptr = wcsrchr(fileName, PATH_SEP);
+            const wchar_t *sep_ptr = wcsrchr(fileName, PATH_SEP);
             if (sep_ptr > fileName) {
-                dfiles_p->path_len = (size_t)(sep_ptr - fileName + 1);
+                walker.path_len = (size_t)(sep_ptr - fileName + 1);
             }
         }
         if (attr & FILE_ATTRIBUTE_DIRECTORY) {
-            _recurse_dir(fileName, lst, 1, include_leaf_dirs);
+            status = _recurse_dir(fileName, &walker, 1);
         } else {  // regular file
-            _wappend(lst, fileName);
+            status = _wvisit(&walker, fileName, -1);
         }
     }
-    GlobalUnlock(hGlobal);
-    CloseClipboard();
+    free(fileNames);
+    return status;
 }
 
 int rename_file(const char *old_name, const char *new_name) {
@@ -920,7 +1165,7 @@ int remove_directory(const char *path) {
 
 #endif
 
-#endif  // (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#endif  // (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -1112,12 +1357,12 @@ int put_clipboard_text(char *data, uint32_t len) {
     return EXIT_SUCCESS;
 }
 
-int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
+int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, img_options *opts) {
     // TODO(thevindu-w): Implement
     (void)buf_ptr;
     (void)len_ptr;
     (void)mode;
-    (void)disp;
+    (void)opts;
     return EXIT_FAILURE;
 }
 
@@ -1197,6 +1442,7 @@ void cleanup_cur_dir(void) {
         strncat(path, files->array[i], sizeof(path) - 3);
         nftw(path, _remove_cb, 64, FTW_DEPTH | FTW_MOUNT | FTW_PHYS);
     }
+    free_list(files);
 }
 
 char *get_data_dir(void) {
@@ -1229,6 +1475,35 @@ char *get_data_dir(void) {
 
 #else
 
+/*
+ * Targets that identify the type of the copied data, in the descending order of the priority of the type. A target
+ * matches the name if it is equal to the name, or if it starts with the name when is_prefix is set.
+ */
+static const struct {
+    const char *name;
+    size_t len;
+    int8_t is_prefix;
+    int8_t type;
+    int8_t priority;
+} copied_type_targets[] = {
+    {"x-special/gnome-copied-files", 28, 1, COPIED_TYPE_FILE, 3},
+    {"image/png", 9, 0, COPIED_TYPE_IMAGE, 2},
+    {"image/jpeg", 10, 0, COPIED_TYPE_IMAGE, 2},
+    {"text/plain", 10, 1, COPIED_TYPE_TEXT, 1},
+    {"text/html", 9, 1, COPIED_TYPE_TEXT, 1},
+    {"UTF8_STRING", 11, 0, COPIED_TYPE_TEXT, 1},
+    {"TEXT", 4, 0, COPIED_TYPE_TEXT, 1},
+};
+
+#define COPIED_TYPE_TARGET_CNT (sizeof(copied_type_targets) / sizeof(copied_type_targets[0]))
+
+int prefetch_copied_data(void) {
+    static const char *const targets[] = {"TARGETS", "x-special/gnome-copied-files", "image/png", "UTF8_STRING"};
+    return xclip_prefetch(targets, sizeof(targets) / sizeof(targets[0]));
+}
+
+void clear_prefetched_data(void) { xclip_clear_prefetched(); }
+
 int8_t get_copied_type(void) {
     char *targets;
     uint32_t targets_len;
@@ -1242,73 +1517,55 @@ int8_t get_copied_type(void) {
         return COPIED_TYPE_NONE;
     }
 
-    // search for copied files
-    const char *token;
-    char found = 0;
-    char *copy = targets;
+    // classify the targets in a single pass, keeping the type of the highest priority found so far
+    int8_t type = COPIED_TYPE_NONE;
+    int8_t priority = 0;
+    const char *token = targets;
     const char *const endptr = targets + targets_len;
-    while ((token = strsep(&copy, "\n"))) {
-        if (!strncmp(token, "x-special/gnome-copied-files", 28)) {
-            found = 1;
-            break;
-        }
-        if (copy < endptr && copy > targets) {
-            *(copy - 1) = '\n';  // restore delemeter of targets
-        }
-    }
-    if (found) {
-        free(targets);
-        return COPIED_TYPE_FILE;
-    }
-
-    // search for image
-    copy = targets;
-    while ((token = strsep(&copy, "\n"))) {
-        if (!(strcmp(token, "image/png") && strcmp(token, "image/jpeg"))) {
-            found = 1;
-            break;
-        }
-        if (copy < endptr && copy > targets) {
-            *(copy - 1) = '\n';  // restore delemeter of targets
-        }
-    }
-    if (found) {
-        free(targets);
-        return COPIED_TYPE_IMAGE;
-    }
-
-    // search for text
-    copy = targets;
-    while ((token = strsep(&copy, "\n"))) {
-        if (!(strncmp(token, "text/plain", 10) && strncmp(token, "text/html", 9) && strcmp(token, "UTF8_STRING") &&
-              strcmp(token, "TEXT"))) {
-            found = 1;
+    while (token < endptr && priority < copied_type_targets[0].priority) {
+        const char *eol = memchr(token, '\n', (size_t)(endptr - token));
+        const size_t len = (size_t)((eol ? eol : endptr) - token);
+        for (size_t i = 0; i < COPIED_TYPE_TARGET_CNT && copied_type_targets[i].priority > priority; i++) {
+            const size_t name_len = copied_type_targets[i].len;
+            if (len < name_len || (len > name_len && !copied_type_targets[i].is_prefix)) continue;
+            if (memcmp(token, copied_type_targets[i].name, name_len)) continue;
+            type = copied_type_targets[i].type;
+            priority = copied_type_targets[i].priority;
             break;
         }
+        if (!eol) break;
+        token = eol + 1;
     }
     free(targets);
-    if (found) {
-        return COPIED_TYPE_TEXT;
-    }
 #ifdef DEBUG_MODE
-    puts("No copied files");
+    if (type == COPIED_TYPE_NONE) puts("No copied files");
 #endif
-    return COPIED_TYPE_NONE;
+    return type;
 }
 
 int get_clipboard_text(char **buf_ptr, uint32_t *len_ptr) {
-    if (xclip_util(XCLIP_OUT, NULL, len_ptr, buf_ptr) != EXIT_SUCCESS || *len_ptr <= 0) {  // do not change the order
+    const int status = xclip_util(XCLIP_OUT, NULL, len_ptr, buf_ptr);
+    if (status == CLIPBOARD_TIMEOUT && _load_snapshot(buf_ptr, len_ptr) == EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        puts("Serving the last known text");
+#endif
+        return EXIT_SUCCESS;
+    }
+    if (status != EXIT_SUCCESS || *len_ptr <= 0) {  // do not change the order
 #ifdef DEBUG_MODE
         printf("xclip read text failed. len = %" PRIu32 "\n", *len_ptr);
 #endif
         if (*buf_ptr) free(*buf_ptr);
-        return EXIT_FAILURE;
+        *buf_ptr = NULL;
+        return status == CLIPBOARD_TIMEOUT ? CLIPBOARD_TIMEOUT : EXIT_FAILURE;
     }
+    _save_snapshot(*buf_ptr, *len_ptr);
     return EXIT_SUCCESS;
 }
 
 int put_clipboard_text(char *data, uint32_t len) {
     create_temp_file();
+    _save_snapshot(data, len);
     if (xclip_util(XCLIP_IN, NULL, &len, &data) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
         fputs("Failed to write to clipboard\n", stderr);
@@ -1318,12 +1575,25 @@ int put_clipboard_text(char *data, uint32_t len) {
     return EXIT_SUCCESS;
 }
 
-int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
+int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, img_options *opts) {
     *buf_ptr = NULL;
 
-    // Try to get copied image unless the mode is screenshot only
-    if (mode != IMG_SCRN_ONLY && xclip_util(XCLIP_OUT, "image/png", len_ptr, buf_ptr) == EXIT_SUCCESS &&
-        *len_ptr > 8) {  // do not change the order
+    // Copied images that need not be downscaled are written as they are read from the clipboard if possible
+    if (mode != IMG_SCRN_ONLY && opts->write && !(opts->max_width || opts->max_height || opts->scale)) {
+        uint64_t written;
+        opts->format = IMG_FORMAT_PNG;
+        if (xclip_stream("image/png", opts->write, opts->write_arg, &written) == EXIT_SUCCESS) {
+            opts->written = 1;
+            *len_ptr = 0;
+            return EXIT_SUCCESS;
+        }
+        // a screenshot cannot be sent after a part of the copied image
+        if (written > 0) return EXIT_FAILURE;
+    } else if (mode != IMG_SCRN_ONLY && xclip_util(XCLIP_OUT, "image/png", len_ptr, buf_ptr) == EXIT_SUCCESS &&
+               *len_ptr > 8) {  // do not change the order
+        opts->format = IMG_FORMAT_PNG;
+        // the original image is sent if it cannot be downscaled
+        downscale_png(buf_ptr, len_ptr, opts);
         return EXIT_SUCCESS;
     }
 #ifdef DEBUG_MODE
@@ -1334,10 +1604,11 @@ int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
     *buf_ptr = NULL;
     *len_ptr = 0;
 
+    uint16_t disp = opts->disp;
     if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
     // Try to get screenshot unless the mode is copied image only
-    if (mode != IMG_COPIED_ONLY && screenshot_util(disp, len_ptr, buf_ptr) == EXIT_SUCCESS &&
-        *len_ptr > 8) {  // do not change the order
+    if (mode != IMG_COPIED_ONLY && screenshot_util(disp, opts, len_ptr, buf_ptr) == EXIT_SUCCESS &&
+        (*len_ptr > 8 || opts->written)) {  // do not change the order
         return EXIT_SUCCESS;
     }
 #ifdef DEBUG_MODE
@@ -1351,32 +1622,7 @@ int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
 
 char *get_copied_files_as_str(int *offset) {
     const char *const expected_target = "x-special/gnome-copied-files";
-    char *targets;
-    uint32_t targets_len;
-    if (xclip_util(XCLIP_OUT, "TARGETS", &targets_len, &targets) || targets_len <= 0) {  // do not change the order
-#ifdef DEBUG_MODE
-        printf("xclip read TARGETS. len = %" PRIu32 "\n", targets_len);
-#endif
-        if (targets) free(targets);
-        return NULL;
-    }
-    char found = 0;
-    char *copy = targets;
-    const char *token;
-    while ((token = strsep(&copy, "\n"))) {
-        if (!strcmp(token, expected_target)) {
-            found = 1;
-            break;
-        }
-    }
-    free(targets);
-    if (!found) {
-#ifdef DEBUG_MODE
-        puts("No copied files");
-#endif
-        return NULL;
-    }
-
+    // the conversion fails if there are no copied files. So TARGETS need not be checked before it
     char *fnames;
     uint32_t fname_len;
     if (xclip_util(XCLIP_OUT, expected_target, &fname_len, &fnames) || fname_len <= 0) {  // do not change the order
@@ -1511,18 +1757,20 @@ int remove_file(const char *filename) {
 }
 
 /*
- * A wrapper to append() for wide strings.
- * Convert wchar_t * string to utf-8 and append to list
+ * A wrapper to append_str() for wide strings.
+ * Convert wchar_t * string to utf-8 and append to list, which is from init_str_list()
  */
 static inline void _wappend(list2 *lst, const wchar_t *wstr) {
     char *utf8path;
-    if (wchar_to_utf8_str(wstr, &utf8path, NULL) != EXIT_SUCCESS) {
+    uint32_t len;
+    if (wchar_to_utf8_str(wstr, &utf8path, &len) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
         wprintf(L"Error while converting file path: %s\n", wstr);
 #endif
         return;
     }
-    append(lst, utf8path);
+    append_str(lst, utf8path, len);
+    free(utf8path);
 }
 
 int8_t get_copied_type(void) {
@@ -1621,14 +1869,16 @@ int put_clipboard_text(char *data, uint32_t len) {
     return EXIT_SUCCESS;
 }
 
-int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp) {
+int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, img_options *opts) {
+    opts->format = IMG_FORMAT_PNG;
     if (mode != IMG_SCRN_ONLY) {
-        getCopiedImage(buf_ptr, len_ptr);
+        getCopiedImage(buf_ptr, len_ptr, opts);
         if (*len_ptr > 8) return EXIT_SUCCESS;
     }
     if (mode != IMG_COPIED_ONLY) {
+        uint16_t disp = opts->disp;
         if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
-        screenCapture(buf_ptr, len_ptr, disp);
+        screenCapture(buf_ptr, len_ptr, disp, opts);
         if (*len_ptr > 8) return EXIT_SUCCESS;
     }
     return EXIT_FAILURE;
@@ -39,11 +39,19 @@
 #define IMG_COPIED_ONLY 1
 #define IMG_SCRN_ONLY 2
 
+#define IMG_FORMAT_PNG 1
+#define IMG_FORMAT_QOI 2
+
+#define MAX_IMG_FORMATS 4
+
 #define COPIED_TYPE_NONE 0
 #define COPIED_TYPE_TEXT 1
 #define COPIED_TYPE_FILE 2
 #define COPIED_TYPE_IMAGE 3
 
+// returned instead of EXIT_FAILURE when the clipboard owner does not respond within configuration.clipboard_timeout
+#define CLIPBOARD_TIMEOUT 2
+
 #if defined(__linux__) || defined(_WIN32)
 /*
  * In-memory file to write png image
@@ -55,6 +63,55 @@ struct mem_file {
 } __attribute__((aligned(__alignof__(FILE))));
 #endif
 
+/*
+ * Display number that selects the bounding rectangle of all monitors for screenshots
+ */
+#define DISPLAY_ALL 65535
+
+/*
+ * Denominator of the scale factor in img_options
+ */
+#define IMG_SCALE_UNIT 1000
+
+/*
+ * Function to write a part of data, such as an image while it is encoded, before the rest of the data is available. arg
+ * is the argument given along with the function, such as the write_arg of the image options.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+typedef int (*data_write_fn)(void *arg, const char *data, size_t len);
+
+/*
+ * Options of a requested image
+ */
+typedef struct _img_options {
+    uint16_t disp;                     /* display number for screenshots. 0 selects the default display */
+    uint8_t format_cnt;                /* number of formats the client accepts. 0 accepts only PNG */
+    uint8_t formats[MAX_IMG_FORMATS];  /* image formats the client accepts in its order of preference */
+    uint8_t format;                    /* format of the image. Set by get_image() */
+    uint16_t max_width;                /* maximum width of the image. 0 does not limit the width */
+    uint16_t max_height;               /* maximum height of the image. 0 does not limit the height */
+    uint16_t scale;                    /* scale factor in units of 1/IMG_SCALE_UNIT. 0 keeps the original size */
+    uint16_t region_x;                 /* left edge of the region of the display to capture, relative to the display */
+    uint16_t region_y;                 /* top edge of the region of the display to capture, relative to the display */
+    uint16_t region_width;             /* width of the region. 0 captures the whole display */
+    uint16_t region_height;            /* height of the region. 0 captures the whole display */
+    data_write_fn write;                /* if set, images that are encoded progressively are written with it */
+    void *write_arg;                   /* argument to the write function */
+    uint8_t written;                   /* set by get_image() if the image was written with write */
+} img_options;
+
+/*
+ * A tile of a streamed screen frame that changed since the previous frame, encoded as a PNG image
+ */
+typedef struct _frame_tile {
+    uint16_t x; /* left edge of the tile, relative to the frame */
+    uint16_t y; /* top edge of the tile, relative to the frame */
+    uint32_t len;
+    char *data;
+} frame_tile;
+
+typedef struct _screen_stream screen_stream;
+
 /*
  * List of files and the length of the path of their parent directory
  */
@@ -97,11 +154,43 @@ extern void create_temp_file(void);
  */
 extern void *realloc_or_free(void *ptr, size_t size) __attribute__((__malloc__));
 
+/*
+ * Get the value of a monotonic clock in nanoseconds.
+ */
+extern uint64_t get_time_ns(void);
+
 /*
  * Returns the data type available in the clipboard
  */
 extern int8_t get_copied_type(void);
 
+/*
+ * Read the copied data of all the types that get_copied_type() detects from the clipboard at once, if the platform
+ * supports it. The following calls to get_copied_type() and to the functions that get the copied data use the data read
+ * here instead of reading the clipboard again. This does nothing on platforms that cannot read several types at once.
+ * returns EXIT_SUCCESS on success, CLIPBOARD_TIMEOUT if the clipboard owner did not respond in time, and EXIT_FAILURE
+ * otherwise.
+ */
+extern int prefetch_copied_data(void);
+
+/*
+ * Discard the copied data read by prefetch_copied_data() that is not used yet.
+ */
+extern void clear_prefetched_data(void);
+
+/*
+ * Prepare the memory that keeps the last known clipboard text, if configuration.serve_stale_text is set.
+ * This must be called before creating the server processes so that all processes share the same text.
+ */
+extern void init_text_snapshot(void);
+
+/*
+ * Get the last text read from or put into the clipboard, which is kept if configuration.serve_stale_text is set. This
+ * does not read the clipboard. Caller should free the buffer set to *buf_ptr.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if there is no such text.
+ */
+extern int get_stale_text(char **buf_ptr, uint32_t *len_ptr);
+
 /*
  * Get copied text from clipboard.
  * Places the text in a buffer and sets the bufptr to point the buffer.
@@ -110,10 +199,23 @@ extern int8_t get_copied_type(void);
  * Places text length in the memory location pointed to by lenptr.
  * lenptr must be a valid pointer to a size_t variable.
  * On failure, buffer is set to NULL.
- * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ * If the clipboard owner does not respond in time and configuration.serve_stale_text is set, the last text read from
+ * or put into the clipboard is returned instead.
+ * returns EXIT_SUCCESS on success, CLIPBOARD_TIMEOUT if the clipboard owner did not respond in time, and EXIT_FAILURE
+ * on other failures.
  */
 extern int get_clipboard_text(char **bufptr, uint32_t *lenptr);
 
+/*
+ * Get copied text from clipboard and write it in parts with write_fn as it is read, so that large text need not be held
+ * in memory. EOLs are converted to LF as with convert_eol(). On platforms where the clipboard cannot be read in parts,
+ * the whole text is written as a single part. The last known text is written if the clipboard owner does not respond in
+ * time before any part is written, as with get_clipboard_text().
+ * returns EXIT_SUCCESS on success, CLIPBOARD_TIMEOUT if the clipboard owner did not respond in time, and EXIT_FAILURE
+ * on other failures. Parts of the text may have been written on failure.
+ */
+extern int stream_clipboard_text(data_write_fn write_fn, void *arg);
+
 /*
  * Reads len bytes of text from the data buffer and copies it into the clipboard.
  * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
@@ -125,14 +227,71 @@ extern int put_clipboard_text(char *data, uint32_t len);
  * If mode is IMG_ANY, get copied image from clipboard, and if there is no image, get a screenshot instead.
  * If mode is IMG_COPIED_ONLY, get copied image from clipboard if available.
  * If mode is IMG_SCRN_ONLY, get a screenshot.
- * If disp is positive and configuration.client_selects_display is set, use disp as display number instead of default or
- * configured value.
+ * If opts->disp is positive and configuration.client_selects_display is set, use opts->disp as display number instead
+ * of default or configured value.
+ * Screenshots are encoded in the format selected by select_image_format() from the formats in opts. Copied images are
+ * always PNG. Sets opts->format to the format of the image.
+ * If opts->write is set, a screenshot may be written in parts with it while it is encoded. Then opts->written is set,
+ * and the buffer is set to NULL with length 0. opts->format is set before the first part is written.
  * Places the image data in a buffer and sets the buf_ptr to point the buffer. buf_ptr must be a valid
  * pointer to a char * variable. Caller should free the buffer after using. Places data length in the memory location
  * pointed to by len_ptr. len_ptr must be a valid pointer to a size_t variable. On failure, buffer is set to NULL.
  * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
  */
-extern int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, uint16_t disp);
+extern int get_image(char **buf_ptr, uint32_t *len_ptr, int mode, img_options *opts);
+
+/*
+ * Select the format to encode a screenshot of pixel_cnt pixels in.
+ * The first format in the client's preference order that screenshots can be encoded in on this platform is selected.
+ * PNG is selected for small images if the client accepts it, since PNG is fast enough for them and smaller. PNG is also
+ * the fallback when none of the accepted formats is available.
+ * returns the selected format.
+ */
+extern uint8_t select_image_format(const img_options *opts, uint64_t pixel_cnt);
+
+/*
+ * Check if the region of the display to capture given by opts fits inside a display of width x height pixels.
+ * returns 1 if opts has a region that fits inside the display, or 0 otherwise.
+ */
+extern int region_fits(const img_options *opts, uint32_t width, uint32_t height);
+
+/*
+ * Start streaming the screen given by opts->disp at fps frames per second. The display is selected as in get_image().
+ * Sets the size of the frames to *width_p and *height_p.
+ * returns the stream, or NULL on failure or if streaming the screen is not supported on this platform.
+ */
+extern screen_stream *open_screen_stream(const img_options *opts, uint32_t fps, uint16_t *width_p, uint16_t *height_p);
+
+/*
+ * Capture the next frame of the stream and encode the tiles that changed since the previous frame. The first frame has
+ * all the tiles. Waits until the frame interval since the previous frame has elapsed before capturing.
+ * Allocates an array of the changed tiles and sets the pointer to *tiles_p and the number of tiles to *tile_cnt_p.
+ * The tiles should be freed with free_frame_tiles().
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int next_screen_frame(screen_stream *stream, frame_tile **tiles_p, uint32_t *tile_cnt_p);
+
+/*
+ * Free the tiles set by next_screen_frame() and their data.
+ */
+extern void free_frame_tiles(frame_tile *tiles, uint32_t tile_cnt);
+
+/*
+ * Stop the stream and free the resources used by it.
+ */
+extern void close_screen_stream(screen_stream *stream);
+
+/*
+ * Get the image format given by its name.
+ * returns the format code, or 0 if the name is not a known format.
+ */
+extern uint8_t image_format_from_name(const char *name);
+
+/*
+ * Write the names of the image formats that screenshots can be encoded in to buf as a comma separated list.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if the buffer is too small.
+ */
+extern int get_image_format_names(char *buf, size_t size);
 
 /*
  * Cut the files given by paths to clipboard. Another application may paste them.
@@ -172,13 +331,20 @@ void png_mem_write_data(png_structp png_ptr, png_bytep data, png_size_t length);
 
 /*
  * Converts line endings to LF or CRLF based on the platform.
- * param str_p is a valid pointer to malloced, null-terminated char * which may be realloced and returned.
+ * param str_p is a valid pointer to malloced char * of len bytes with space for a terminating '\0', which may be
+ * realloced and returned. Null bytes in the text are converted as any other byte.
  * If force_lf is non-zero, convert EOL to LF regardless of the platform
  * Else, convert EOL of str to LF
- * Returns the length of the new string without the terminating '\0'.
+ * Returns the length of the new string without the terminating '\0', which is added after the converted text.
  * If an error occured, this will free() the *str_p and return -1.
  */
-extern int64_t convert_eol(char **str_p, int force_lf);
+extern int64_t convert_eol(char **str_p, size_t len, int force_lf);
+
+/*
+ * Converts line endings of text, which are LF already, to the line endings of the platform. This is the same as
+ * convert_eol(str_p, len, 0) for such text, but does not go through the text on platforms that use LF.
+ */
+extern int64_t convert_lf_eol(char **str_p, size_t len);
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -237,7 +403,7 @@ extern list2 *get_copied_files(void);
 
 #endif  // PROTOCOL_MIN <= 1
 
-#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
 
 /*
  * Creates the directory given by the path and all its parent directories if missing.
@@ -261,6 +427,23 @@ extern list2 *list_dir(const char *dirname);
  */
 extern void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs);
 
+/*
+ * Called by walk_copied_dirs_files() for each file found. path is the full path of the file, and paths of empty
+ * directories end with the path separator. path_len is the length of path name of the directory which the files are
+ * copied. size is the size of the file if it is known while walking, or -1 otherwise and for empty directories.
+ * returns EXIT_SUCCESS to continue the walk, or EXIT_FAILURE to stop it.
+ */
+typedef int (*path_visit_fn)(void *arg, const char *path, size_t path_len, int64_t size);
+
+/*
+ * Get copied files and directories from the clipboard and walk through them, calling visit_fn with arg for each
+ * regular file, and for each empty directory if include_leaf_dirs is non-zero, as they are found. Unlike
+ * get_copied_dirs_files(), the paths are not kept in memory. On Linux and macOS, the copied directories are read by
+ * several threads, and the order in which the files are visited is not fixed.
+ * returns EXIT_SUCCESS if the walk completed, or EXIT_FAILURE if nothing is copied or visit_fn stopped the walk.
+ */
+extern int walk_copied_dirs_files(int include_leaf_dirs, path_visit_fn visit_fn, void *arg);
+
 #if HEADLESS == 1
 extern void cleanup_cur_dir(void);
 extern char *get_data_dir(void);
@@ -287,6 +470,6 @@ extern int remove_directory(const char *path);
 
 #endif
 
-#endif  // (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#endif  // (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
 
 #endif  // UTILS_UTILS_H_
@@ -23,6 +23,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <utils/img_scale.h>
+#include <utils/png_tuning.h>
 #include <utils/utils.h>
 #include <utils/win_image.h>
 #include <windows.h>
@@ -45,14 +47,17 @@ typedef struct _RGBBitmap {
 typedef struct _enum_cb_arg_t {
     uint16_t selected_display;
     uint16_t current_display;
+    const img_options *opts;
     char *buf;
     size_t len;
 } enum_cb_arg_t;
 
-static int write_png_to_mem(RGBBitmap *, char **, size_t *);
-static void write_image(HBITMAP, char **, size_t *);
+static int write_png_to_mem(RGBBitmap *, const img_options *, char **, size_t *);
+static void write_image(HBITMAP, const img_options *, char **, size_t *);
+static void capture_rect(HDC, int, int, int, int, const img_options *, char **, size_t *);
+static void capture_display(HDC, int, int, int, int, const img_options *, char **, size_t *);
 
-static void write_image(HBITMAP hBitmap3, char **buf_ptr, size_t *len_ptr) {
+static void write_image(HBITMAP hBitmap3, const img_options *opts, char **buf_ptr, size_t *len_ptr) {
     HDC hDC;
     int iBits;
     WORD wBitCount;
@@ -105,7 +110,7 @@ static void write_image(HBITMAP hBitmap3, char **buf_ptr, size_t *len_ptr) {
     rgbBitmap.height = (size_t)Bitmap0.bmHeight;
     rgbBitmap.bytewidth = (size_t)(((Bitmap0.bmWidth * wBitCount + 31) & ~31) / 8);
     rgbBitmap.pixels = (RGBPixel *)((LPSTR)lpbi + sizeof(BITMAPINFOHEADER) + dwPaletteSize);
-    write_png_to_mem(&rgbBitmap, buf_ptr, len_ptr);
+    write_png_to_mem(&rgbBitmap, opts, buf_ptr, len_ptr);
     GlobalUnlock(hDib);
     GlobalFree(hDib);
 }
@@ -119,30 +124,56 @@ static BOOL CALLBACK enumCallback(HMONITOR monitor, HDC hdcSource, LPRECT lprect
     info.cbSize = sizeof(MONITORINFO);
     if (!GetMonitorInfo(monitor, &info)) return FALSE;
 
-    HDC hdcMemory = CreateCompatibleDC(hdcSource);
-    if (!hdcMemory) return FALSE;
+    capture_display(hdcSource, (int)info.rcMonitor.left, (int)info.rcMonitor.top,
+                    (int)(info.rcMonitor.right - info.rcMonitor.left),
+                    (int)(info.rcMonitor.bottom - info.rcMonitor.top), cb_arg->opts, &(cb_arg->buf), &(cb_arg->len));
+    return FALSE;
+}
 
-    int capX = (int)(info.rcMonitor.right - info.rcMonitor.left);
-    int capY = (int)(info.rcMonitor.bottom - info.rcMonitor.top);
+/* Captures the given rectangle of the screen into a PNG. */
+static void capture_rect(HDC hdcSource, int left, int top, int capX, int capY, const img_options *opts, char **buf_ptr,
+                         size_t *len_ptr) {
+    HDC hdcMemory = CreateCompatibleDC(hdcSource);
+    if (!hdcMemory) return;
 
     HBITMAP hBitmap = CreateCompatibleBitmap(hdcSource, capX, capY);
     HBITMAP hBitmapOld = (HBITMAP)SelectObject(hdcMemory, hBitmap);
 
-    BitBlt(hdcMemory, 0, 0, capX, capY, hdcSource, info.rcMonitor.left, info.rcMonitor.top, SRCCOPY);
+    BitBlt(hdcMemory, 0, 0, capX, capY, hdcSource, left, top, SRCCOPY);
     hBitmap = (HBITMAP)SelectObject(hdcMemory, hBitmapOld);
 
     DeleteDC(hdcSource);
     DeleteDC(hdcMemory);
-    write_image(hBitmap, &(cb_arg->buf), &(cb_arg->len));
-    return FALSE;
+    write_image(hBitmap, opts, buf_ptr, len_ptr);
+}
+
+/* Captures the region of the display rectangle given by opts, or the whole rectangle if opts has no region. */
+static void capture_display(HDC hdcSource, int left, int top, int width, int height, const img_options *opts,
+                            char **buf_ptr, size_t *len_ptr) {
+    if (opts->region_width == 0) {
+        capture_rect(hdcSource, left, top, width, height, opts, buf_ptr, len_ptr);
+        return;
+    }
+    if (width <= 0 || height <= 0 || !region_fits(opts, (uint32_t)width, (uint32_t)height)) {
+        DeleteDC(hdcSource);
+        return;
+    }
+    capture_rect(hdcSource, left + opts->region_x, top + opts->region_y, opts->region_width, opts->region_height, opts,
+                 buf_ptr, len_ptr);
 }
 
-void screenCapture(char **buf_ptr, uint32_t *len_ptr, uint16_t disp) {
+void screenCapture(char **buf_ptr, uint32_t *len_ptr, uint16_t disp, const img_options *opts) {
     *len_ptr = 0;
     *buf_ptr = NULL;
     HDC hdcSource = GetDC(NULL);
-    enum_cb_arg_t cb_arg = {.selected_display = disp, .current_display = 1, .buf = NULL, .len = 0};
-    if (EnumDisplayMonitors(hdcSource, NULL, enumCallback, (LPARAM)&cb_arg) == 0 && cb_arg.len == 0) {
+    enum_cb_arg_t cb_arg = {.selected_display = disp, .current_display = 1, .opts = opts, .buf = NULL, .len = 0};
+    if (disp == DISPLAY_ALL) {
+        // the virtual screen is the bounding rectangle of all monitors
+        capture_display(hdcSource, GetSystemMetrics(SM_XVIRTUALSCREEN), GetSystemMetrics(SM_YVIRTUALSCREEN),
+                        GetSystemMetrics(SM_CXVIRTUALSCREEN), GetSystemMetrics(SM_CYVIRTUALSCREEN), opts,
+                        &(cb_arg.buf), &(cb_arg.len));
+        if (cb_arg.len == 0) return;
+    } else if (EnumDisplayMonitors(hdcSource, NULL, enumCallback, (LPARAM)&cb_arg) == 0 && cb_arg.len == 0) {
         return;
     }
     if (cb_arg.len >= 0xFFFFFFFFUL) {
@@ -153,7 +184,7 @@ void screenCapture(char **buf_ptr, uint32_t *len_ptr, uint16_t disp) {
 }
 
 /* Attempts to save PNG to file; returns 0 on success, non-zero on error. */
-static int write_png_to_mem(RGBBitmap *bitmap, char **buf_ptr, size_t *len_ptr) {
+static int write_png_to_mem(RGBBitmap *bitmap, const img_options *opts, char **buf_ptr, size_t *len_ptr) {
     png_structp png_ptr = NULL;
     png_infop info_ptr = NULL;
     size_t x, y;
@@ -181,22 +212,57 @@ static int write_png_to_mem(RGBBitmap *bitmap, char **buf_ptr, size_t *len_ptr)
         return -1;
     }
 
+    /* Find the size of the image after downscaling. */
+    uint32_t width;
+    uint32_t height;
+    const int scaled = get_scaled_size(opts, (uint32_t)bitmap->width, (uint32_t)bitmap->height, &width, &height);
+
     /* Set image attributes. */
-    png_set_IHDR(png_ptr, info_ptr, (png_uint_32)bitmap->width, (png_uint_32)bitmap->height, 8, PNG_COLOR_TYPE_RGB,
-                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+    /* Set compression parameters. */
+    const int level = get_png_level();
+    png_set_compression_level(png_ptr, level);
+    png_set_compression_strategy(png_ptr, configuration.png.strategy);
+    if (configuration.png.filter == PNG_FILTER_ADAPTIVE) {
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+    } else {
+        // PNG_FILTER_NONE ... PNG_FILTER_PAETH are consecutive bits in the order of the filter types
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE << configuration.png.filter);
+    }
 
-    /* Initialize rows of PNG. */
-    row_pointers = png_malloc(png_ptr, bitmap->height * sizeof(png_byte *) + 1);
+    /* Initialize rows of PNG. Rows are downscaled as they are converted to RGB if the image is scaled. */
+    const size_t stride = (size_t)width * 3;
+    uint8_t *pixels = (uint8_t *)malloc(stride * height + 1);
+    uint8_t *src_row = scaled ? (uint8_t *)malloc(bitmap->width * 3 + 1) : NULL;
+    img_scaler scaler = {.acc = NULL, .col_ends = NULL};
+    if (!pixels || (scaled && (!src_row || init_scaler(&scaler, (uint32_t)bitmap->width, (uint32_t)bitmap->height,
+                                                       width, height, 3, pixels, stride) != EXIT_SUCCESS))) {
+        if (pixels) free(pixels);
+        if (src_row) free(src_row);
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        *len_ptr = 0;
+        return -1;
+    }
     for (y = 0; y < bitmap->height; ++y) {
-        uint8_t *row = (uint8_t *)malloc(bitmap->bytes_per_pixel * bitmap->width + 1);
-        row_pointers[y] = (png_byte *)row;
+        uint8_t *row = scaled ? src_row : pixels + stride * y;
         for (x = 0; x < bitmap->width; ++x) {
             RGBPixel color = *(RGBPixel *)(((uint8_t *)(bitmap->pixels)) + ((bitmap->bytewidth) * y) +
                                            (bitmap->bytes_per_pixel) * x);
-            *row++ = color.red;
-            *row++ = color.green;
-            *row++ = color.blue;
+            row[x * 3] = color.red;
+            row[x * 3 + 1] = color.green;
+            row[x * 3 + 2] = color.blue;
         }
+        if (scaled) scaler_add_row(&scaler, row);
+    }
+    if (scaled) {
+        free_scaler(&scaler);
+        free(src_row);
+    }
+    row_pointers = png_malloc(png_ptr, height * sizeof(png_byte *) + 1);
+    for (y = 0; y < height; ++y) {
+        row_pointers[y] = (png_byte *)(pixels + stride * y);
     }
 
     struct mem_file fake_file;
@@ -208,13 +274,13 @@ static int write_png_to_mem(RGBBitmap *bitmap, char **buf_ptr, size_t *len_ptr)
     png_init_io(png_ptr, (png_FILE_p)&fake_file);
     png_set_write_fn(png_ptr, (png_FILE_p)&fake_file, png_mem_write_data, NULL);
     png_set_rows(png_ptr, info_ptr, row_pointers);
+    const uint64_t start = get_time_ns();
     png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+    record_png_encode(level, stride * height, fake_file.size, get_time_ns() - start);
 
     /* Cleanup. */
-    for (y = 0; y < bitmap->height; y++) {
-        png_free(png_ptr, row_pointers[y]);
-    }
     png_free(png_ptr, row_pointers);
+    free(pixels);
 
     /* Finish writing. */
     png_destroy_write_struct(&png_ptr, &info_ptr);
@@ -225,7 +291,7 @@ static int write_png_to_mem(RGBBitmap *bitmap, char **buf_ptr, size_t *len_ptr)
     return 0;
 }
 
-void getCopiedImage(char **buf_ptr, uint32_t *len_ptr) {
+void getCopiedImage(char **buf_ptr, uint32_t *len_ptr, const img_options *opts) {
     *len_ptr = 0;
     if (!OpenClipboard(0)) {
         Sleep(20);  // retry after a short delay
@@ -245,7 +311,7 @@ void getCopiedImage(char **buf_ptr, uint32_t *len_ptr) {
     CloseClipboard();
     size_t len;
     *buf_ptr = NULL;
-    write_image(hBitmap, buf_ptr, &len);
+    write_image(hBitmap, opts, buf_ptr, &len);
     if (len >= 0xFFFFFFFFUL) {
         if (*buf_ptr) free(*buf_ptr);
         *buf_ptr = NULL;
@@ -21,9 +21,10 @@
 #ifdef _WIN32
 
 #include <stdlib.h>
+#include <utils/utils.h>
 
-extern void screenCapture(char **, uint32_t *, uint16_t);
-extern void getCopiedImage(char **, uint32_t *);
+extern void screenCapture(char **, uint32_t *, uint16_t, const img_options *);
+extern void getCopiedImage(char **, uint32_t *, const img_options *);
 
 #endif
 #endif  // UTILS_WIN_IMAGE_H_
@@ -31,10 +31,15 @@
 
 #define MAX_BUF_LEN 16777216UL
 
+/* Returns the size of the largest buffer that xcmalloc() and xcrealloc() allocate */
+static inline unsigned long _max_buf_len(void) {
+    return MAX_BUF_LEN > configuration.max_text_length ? MAX_BUF_LEN : configuration.max_text_length;
+}
+
 /* wrapper for malloc that checks for errors */
 void *xcmalloc(size_t size) {
     if (!size) error_exit("malloc zero");
-    if (size > MAX_BUF_LEN && size > configuration.max_text_length) error_exit("malloc too large");
+    if (size > _max_buf_len()) error_exit("malloc too large");
 
     void *mem = malloc(size);
     if (!mem) error_exit("malloc failed");
@@ -48,7 +53,7 @@ void *xcrealloc(void *ptr, size_t size) {
         if (ptr) free(ptr);
         error_exit("realloc zero");
     }
-    if (size > MAX_BUF_LEN && size > configuration.max_text_length) {
+    if (size > _max_buf_len()) {
         if (ptr) free(ptr);
         error_exit("realloc too large");
     }
@@ -62,9 +67,36 @@ void *xcrealloc(void *ptr, size_t size) {
     return mem;
 }
 
+/* Grow the buffer ptr of capacity *cap_p, if needed, to hold size bytes followed by
+ * a null terminator. The capacity grows geometrically, so that data received in
+ * many parts is not copied again for each part. Sets the new capacity to cap_p. */
+void *xcreserve(void *ptr, unsigned long *cap_p, unsigned long size) {
+    if (ptr && size < *cap_p) return ptr;
+    unsigned long cap = size + 1;
+    if (ptr) {
+        /* double the capacity, up to the largest buffer allowed */
+        const unsigned long max_len = _max_buf_len();
+        const unsigned long doubled = (*cap_p <= max_len / 2) ? *cap_p * 2 : max_len;
+        if (cap < doubled) cap = doubled;
+    }
+
+    void *mem = ptr ? xcrealloc(ptr, cap) : xcmalloc(cap);
+    *cap_p = cap;
+    return mem;
+}
+
+/* Allocate a buffer for the data of an INCR transfer of which the selection owner gave lower_bound as the lower bound
+ * on its size. Unlike xcreserve(), this returns NULL instead of exiting if the lower bound is more than the largest
+ * buffer allowed, since it is given by another client. The data is received into a growing buffer in that case.
+ */
+void *xcreserve_incr(unsigned long *cap_p, unsigned long lower_bound) {
+    if (lower_bound == 0 || lower_bound >= _max_buf_len()) return NULL;
+    return xcreserve(NULL, cap_p, lower_bound);
+}
+
 /* Returns the machine-specific number of bytes per data element
  * returned by XGetWindowProperty */
-static size_t mach_itemsize(int format) {
+size_t mach_itemsize(int format) {
     if (format == 8) return sizeof(char);
     if (format == 16) return sizeof(short);
     if (format == 32) return sizeof(long);
@@ -91,11 +123,17 @@ static size_t mach_itemsize(int format) {
  *
  * A pointer to an int to record the context in which to process the event
  *
+ * A function to write each part of the selection data with as it is
+ * received, or NULL to collect the data into the char array. The data is
+ * not put into the char array if the function is given.
+ *
+ * The argument to the write function
+ *
  * Return value is 1 if the retrieval of the selection data is complete,
  * otherwise it's 0.
  */
 int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *type, void **txt_p, unsigned long *len_p,
-          unsigned int *context) {
+          unsigned long *cap_p, unsigned int *context, data_write_fn write_fn, void *write_arg) {
     /* a property for other windows to put their selection into */
     static Atom pty;
     static Atom inc;
@@ -122,10 +160,12 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
         /* there is no context, do an XConvertSelection() */
         case XCLIB_XCOUT_NONE: {
             /* initialise return length to 0 */
-            if (*len_p > 0) {
+            if (*txt_p) {
                 free(*txt_p);
-                *len_p = 0;
+                *txt_p = NULL;
             }
+            *len_p = 0;
+            *cap_p = 0;
 
             /* send a selection request */
             XConvertSelection(dpy, sel, target, pty, win, CurrentTime);
@@ -147,6 +187,16 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
             if (buffer) XFree(buffer);
 
             if (*type == inc) {
+                /* the INCR property holds a lower bound on the size of the data.
+                 * reserve that much so that the buffer need not grow for each item
+                 */
+                XGetWindowProperty(dpy, win, pty, 0, 1, False, inc, type, &pty_format, &pty_items, &pty_size, &buffer);
+                if (!write_fn && buffer && pty_format == 32 && pty_items == 1) {
+                    const unsigned long lower_bound = *(unsigned long *)(void *)buffer;
+                    *txt_p = xcreserve_incr(cap_p, lower_bound);
+                }
+                if (buffer) XFree(buffer);
+
                 /* start INCR mechanism by deleting property */
                 XDeleteProperty(dpy, win, pty);
                 XFlush(dpy);
@@ -164,9 +214,17 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
             /* compute the size of the data buffer we received */
             pty_machsize = pty_items * mach_itemsize(pty_format);
 
-            /* copy the buffer to the pointer for returned data */
+            if (write_fn) {
+                /* write the buffer directly instead of copying it */
+                int status = (pty_machsize > 0) ? write_fn(write_arg, (char *)buffer, pty_machsize) : EXIT_SUCCESS;
+                if (buffer) XFree(buffer);
+                *context = (status == EXIT_SUCCESS) ? XCLIB_XCOUT_NONE : XCLIB_XCOUT_WRITE_FAILED;
+                return status == EXIT_SUCCESS;
+            }
+
+            /* copy the buffer to the pointer for returned data, with room for a null terminator */
             if (pty_machsize > 0) {
-                ltxt = (unsigned char *)xcmalloc(pty_machsize);
+                ltxt = (unsigned char *)xcreserve(NULL, cap_p, pty_machsize);
                 memcpy(ltxt, buffer, pty_machsize);
             } else {
                 ltxt = NULL;
@@ -224,18 +282,25 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
             /* compute the size of the data buffer we received */
             pty_machsize = pty_items * mach_itemsize(pty_format);
 
-            /* allocate memory to accommodate data in *txt */
+            if (write_fn) {
+                /* delete property first so that the owner prepares the
+                 * next item while this item is being written
+                 */
+                XDeleteProperty(dpy, win, pty);
+                XFlush(dpy);
+                int status = (pty_machsize > 0) ? write_fn(write_arg, (char *)buffer, pty_machsize) : EXIT_SUCCESS;
+                if (buffer) XFree(buffer);
+                if (status != EXIT_SUCCESS) *context = XCLIB_XCOUT_WRITE_FAILED;
+                return 0;
+            }
+
+            /* make room for the data in *txt */
             if (pty_machsize > 0) {
-                if (*len_p == 0) {
-                    *len_p = pty_machsize;
-                    ltxt = (unsigned char *)xcmalloc(*len_p);
-                } else {
-                    *len_p += pty_machsize;
-                    ltxt = (unsigned char *)xcrealloc(ltxt, *len_p);
-                }
+                ltxt = (unsigned char *)xcreserve(ltxt, cap_p, *len_p + pty_machsize);
 
                 /* add data to ltxt */
-                memcpy(&ltxt[*len_p - pty_machsize], buffer, pty_machsize);
+                memcpy(&ltxt[*len_p], buffer, pty_machsize);
+                *len_p += pty_machsize;
             }
 
             *txt_p = ltxt;
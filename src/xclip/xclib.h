@@ -24,6 +24,7 @@
 #define XCLIP_XCLIB_H_
 
 #include <X11/Xlib.h>
+#include <utils/utils.h>
 
 /* xcout() contexts */
 #define XCLIB_XCOUT_NONE 0              /* no context */
@@ -31,6 +32,7 @@
 #define XCLIB_XCOUT_INCR 2              /* in an incr loop */
 #define XCLIB_XCOUT_BAD_TARGET 3        /* given target failed */
 #define XCLIB_XCOUT_SELECTION_REFUSED 4 /* owner signaled an error */
+#define XCLIB_XCOUT_WRITE_FAILED 5      /* write function failed */
 
 /* xcin() contexts */
 #define XCLIB_XCIN_NONE 0
@@ -38,10 +40,14 @@
 #define XCLIB_XCIN_INCR 2
 
 /* functions in xclib.c */
-extern int xcout(Display *, Window, XEvent, Atom, Atom, Atom *, void **, unsigned long *, unsigned int *);
+extern int xcout(Display *, Window, XEvent, Atom, Atom, Atom *, void **, unsigned long *, unsigned long *,
+                 unsigned int *, data_write_fn, void *);
 extern int xcin(Display *, Window *, XEvent, Atom *, Atom, const unsigned char *, unsigned long, unsigned long *,
                 unsigned int *);
+extern size_t mach_itemsize(int);
 extern void *xcmalloc(size_t) __attribute__((__malloc__));
 extern void *xcrealloc(void *, size_t) __attribute__((__malloc__));
+extern void *xcreserve(void *, unsigned long *, unsigned long);
+extern void *xcreserve_incr(unsigned long *, unsigned long);
 
 #endif  // XCLIP_XCLIB_H_
@@ -23,10 +23,15 @@
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xmu/Atoms.h>
+#include <errno.h>
+#include <globals.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <utils/config.h>
 #include <utils/utils.h>
 #include <xclip/xclib.h>
 #include <xclip/xclip.h>
@@ -36,8 +41,119 @@ typedef struct _xclip_options {
     Atom target;
     Display *dpy; /* connection to X11 display */
     char is_targets;
+    data_write_fn write_fn; /* if set, the selection is written with it as it is received instead of returning it */
+    void *write_arg;
+    uint64_t deadline; /* time by which the selection must be received, from _deadline() */
 } xclip_options;
 
+#define MAGIC_MAX_LEN 8
+#define MAX_ATOM_NAME_LEN 511
+#define MAX_PREFETCH_TARGETS 8
+
+/*
+ * Get the names of cnt atoms as a newly allocated null-terminated text with a name in each line.
+ * The names are fetched with a single XGetAtomNames() request instead of a request per atom.
+ * Sets the length of the text to *len_ptr.
+ */
+static char *_atom_names_text(Display *dpy, const Atom *atoms, size_t cnt, unsigned long *len_ptr) {
+    // None is not a valid atom to request. The names of atoms the X server rejects are set to NULL
+    Atom *valid = xcmalloc((cnt + 1) * sizeof(Atom));
+    int valid_cnt = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (atoms[i] != None) valid[valid_cnt++] = atoms[i];
+    }
+    char **names = xcmalloc(((size_t)valid_cnt + 1) * sizeof(char *));
+    for (int i = 0; i < valid_cnt; i++) names[i] = NULL;
+    if (valid_cnt > 0) XGetAtomNames(dpy, valid, valid_cnt, names);
+    free(valid);
+    size_t out_len = 0;
+    for (int i = 0; i < valid_cnt; i++) {
+        if (names[i]) out_len += strnlen(names[i], MAX_ATOM_NAME_LEN) + 1;
+    }
+    char *out_buf = xcmalloc(out_len + 1);
+    char *ptr = out_buf;
+    for (int i = 0; i < valid_cnt; i++) {
+        if (!names[i]) continue;
+        const size_t atom_name_len = strnlen(names[i], MAX_ATOM_NAME_LEN);
+        memcpy(ptr, names[i], atom_name_len);
+        ptr += atom_name_len;
+        *ptr++ = '\n';
+        XFree(names[i]);
+    }
+    *ptr = 0;
+    free(names);
+    *len_ptr = out_len;
+    return out_buf;
+}
+
+/*
+ * Get the time by which a request for the selection that starts now must complete, on the clock of get_time_ns().
+ * This is computed once per request, so that an owner that sends the parts of the selection slowly cannot hold the
+ * request for longer.
+ * Returns UINT64_MAX if there is no time limit.
+ */
+static uint64_t _deadline(void) {
+    if (configuration.clipboard_timeout == CLIPBOARD_TIMEOUT_NONE) return UINT64_MAX;
+    return get_time_ns() + (uint64_t)configuration.clipboard_timeout * 1000000ULL;
+}
+
+/*
+ * Wait for the next event until the deadline given by _deadline(), and store it in *evt. Unlike XNextEvent(), this does
+ * not block after the deadline if the other client stops responding.
+ * Returns EXIT_SUCCESS if an event was received, CLIPBOARD_TIMEOUT if the deadline passed, and EXIT_FAILURE on error.
+ */
+static int _next_event(Display *dpy, XEvent *evt, uint64_t deadline) {
+    // XPending() reads the events that are already sent by the X server without blocking
+    while (!XPending(dpy)) {
+        int timeout_ms = -1;
+        if (deadline != UINT64_MAX) {
+            const uint64_t now = get_time_ns();
+            if (now >= deadline) {
+#ifdef DEBUG_MODE
+                fputs("Timed out waiting for the selection owner\n", stderr);
+#endif
+                return CLIPBOARD_TIMEOUT;
+            }
+            const uint64_t wait_ms = (deadline - now + 999999ULL) / 1000000ULL;
+            timeout_ms = wait_ms < INT_MAX ? (int)wait_ms : INT_MAX;
+        }
+        struct pollfd pfd = {.fd = ConnectionNumber(dpy), .events = POLLIN, .revents = 0};
+        if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR) return EXIT_FAILURE;
+    }
+    XNextEvent(dpy, evt);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Get the signature that the data of the target given by atom_name must start with, and set its length to *len_p.
+ * Returns NULL if the target has no signature, which is the case for targets other than images.
+ */
+static const char *_get_magic(const char *atom_name, size_t *len_p) {
+    *len_p = 0;
+    if (!atom_name) return NULL;
+    if (!strcmp(atom_name, "image/png")) {
+        *len_p = 8;
+        return "\x89PNG\r\n\x1a\n";
+    }
+    if (!strcmp(atom_name, "image/jpeg")) {
+        *len_p = 3;
+        return "\xff\xd8\xff";
+    }
+    return NULL;
+}
+
+/*
+ * Check if the data of the target given by atom_name starts with the signature of its format.
+ * Returns EXIT_SUCCESS if the data is valid and EXIT_FAILURE otherwise.
+ */
+static int _check_magic(const char *atom_name, const char *data, unsigned long len) {
+    size_t magic_len;
+    const char *magic = _get_magic(atom_name, &magic_len);
+    if (!magic) return EXIT_SUCCESS;
+    if (len < magic_len || memcmp(data, magic, magic_len)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
 static int doIn(Window win, unsigned long len, const char *buf, xclip_options *options) {
     XEvent evt; /* X Event Structures */
 
@@ -69,12 +185,24 @@ static int doIn(Window win, unsigned long len, const char *buf, xclip_options *o
             static unsigned long sel_pos = 0;
             static Window cwin;
             static Atom pty;
+            static uint64_t incr_deadline = UINT64_MAX;
             int finished;
 
-            XNextEvent(options->dpy, &evt);
+            if (context == XCLIB_XCIN_NONE) {
+                XNextEvent(options->dpy, &evt);
+            } else if (_next_event(options->dpy, &evt, incr_deadline) != EXIT_SUCCESS) {
+                /* the requestor stopped taking the parts of an INCR transfer. Abandon it and serve other requests */
+                XSelectInput(options->dpy, cwin, NoEventMask);
+                context = XCLIB_XCIN_NONE;
+                if (clear) return EXIT_SUCCESS;
+                continue;
+            }
 
+            const unsigned int prev_context = context;
             finished = xcin(options->dpy, &cwin, evt, &pty, options->target, (const unsigned char *)buf, len, &sel_pos,
                             &context);
+            /* the requestor must take all the parts of an INCR transfer within the time limit */
+            if (prev_context == XCLIB_XCIN_NONE && context != XCLIB_XCIN_NONE) incr_deadline = _deadline();
 
             if (evt.type == SelectionClear) clear = 1;
 
@@ -93,43 +221,32 @@ static int doOut(Window win, unsigned long *len_ptr, char **buf_ptr, xclip_optio
     Atom sel_type = None;
     void *sel_buf = NULL;       // buffer for selection data
     unsigned long sel_len = 0;  // length of sel_buf
+    unsigned long sel_cap = 0;  // capacity of sel_buf, which has room for a null terminator after the data
     XEvent evt;                 // X Event Structures
     unsigned int context = XCLIB_XCOUT_NONE;
 
     while (1) {
         /* only get an event if xcout() is doing something */
-        if (context != XCLIB_XCOUT_NONE) XNextEvent(options->dpy, &evt);
+        if (context != XCLIB_XCOUT_NONE) {
+            const int status = _next_event(options->dpy, &evt, options->deadline);
+            if (status != EXIT_SUCCESS) {
+                if (sel_buf) free(sel_buf);
+                return status;
+            }
+        }
 
         /* fetch the selection, or part of it */
-        xcout(options->dpy, win, evt, options->sseln, options->target, &sel_type, &sel_buf, &sel_len, &context);
+        xcout(options->dpy, win, evt, options->sseln, options->target, &sel_type, &sel_buf, &sel_len, &sel_cap,
+              &context,
+              options->write_fn, options->write_arg);
 
-        if (context == XCLIB_XCOUT_SELECTION_REFUSED) {
+        if (context == XCLIB_XCOUT_SELECTION_REFUSED || context == XCLIB_XCOUT_WRITE_FAILED) {
             if (sel_buf) free(sel_buf);
             return EXIT_FAILURE;
         }
 
         if (options->is_targets && sel_type == XA_ATOM) {
-            const Atom *atom_buf = (Atom *)sel_buf;
-            size_t atom_len = sel_len / sizeof(Atom);
-            size_t out_len = 0;
-            size_t out_capacity = 128;
-            char *out_buf = xcmalloc(out_capacity);
-            out_buf[0] = 0;
-            while (atom_len--) {
-                char *atom_name = XGetAtomName(options->dpy, *atom_buf);
-                atom_buf++;
-                const size_t atom_name_len = strnlen(atom_name, 511);
-                if ((atom_name_len + out_len + 1) >= out_capacity) {
-                    out_capacity = atom_name_len + out_len + 1;
-                    out_buf = xcrealloc(out_buf, out_capacity);
-                }
-                if ((ssize_t)(out_capacity - out_len) >= 0 &&
-                    !snprintf_check(out_buf + out_len, out_capacity - out_len, "%s\n", atom_name))
-                    out_len += atom_name_len + 1;
-                XFree(atom_name);
-            }
-            *len_ptr = out_len;
-            *buf_ptr = out_buf;
+            *buf_ptr = _atom_names_text(options->dpy, (Atom *)sel_buf, sel_len / sizeof(Atom), len_ptr);
             if (sel_buf) free(sel_buf);
             return EXIT_SUCCESS;
         }
@@ -152,35 +269,22 @@ static int doOut(Window win, unsigned long *len_ptr, char **buf_ptr, xclip_optio
 
     *len_ptr = sel_len;
     if (0 < sel_len && sel_len < 0x7FFFFFFFUL) {
-        *buf_ptr = xcmalloc(sel_len + 1);
-        memcpy(*buf_ptr, sel_buf, sel_len);
+        /* return the buffer of xcout() as it is, without copying the selection to a new buffer */
+        *buf_ptr = sel_buf;
         (*buf_ptr)[sel_len] = 0;
+        return EXIT_SUCCESS;
     }
-
-    if (options->sseln == XA_STRING) {
-        XFree(sel_buf);
-    } else {
-        free(sel_buf);
-    }
-
+    if (sel_buf) free(sel_buf);
     return EXIT_SUCCESS;
 }
 
-int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr) {
-    if (io == XCLIP_OUT) {
-        *len_ptr = 0;
-        *buf_ptr = NULL;
-    }
-
-    /* Declare variables */
-    Window win; /* Window */
-    int exit_code;
-    xclip_options options;
-
-    options.target = XA_STRING;
-
+/*
+ * Connect to the X server and create a window to receive the selection of the target given by atom_name.
+ * Returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _xclip_init(const char *atom_name, xclip_options *options, Window *win_p) {
     /* Connect to the X server. */
-    if ((options.dpy = XOpenDisplay(NULL))) {
+    if ((options->dpy = XOpenDisplay(NULL))) {
 /* successful */
 #ifdef DEBUG_MODE
         fputs("Connected to X server\n", stderr);
@@ -194,56 +298,377 @@ int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr)
     }
 
     /* parse selection command line option */
-    options.sseln = XA_CLIPBOARD(options.dpy);
+    options->sseln = XA_CLIPBOARD(options->dpy);
 
     /* parse target options */
     if (atom_name == NULL) {
-        options.target = XA_UTF8_STRING(options.dpy);
+        options->target = XA_UTF8_STRING(options->dpy);
     } else {
-        options.target = XInternAtom(options.dpy, atom_name, False);
+        options->target = XInternAtom(options->dpy, atom_name, False);
     }
 
     if (atom_name && !strcmp("TARGETS", atom_name)) {
-        options.is_targets = 1;
+        options->is_targets = 1;
     } else {
-        options.is_targets = 0;
+        options->is_targets = 0;
     }
+    options->write_fn = NULL;
+    options->write_arg = NULL;
+    options->deadline = _deadline();
 
     /* Create a window to trap events */
-    win = XCreateSimpleWindow(options.dpy, DefaultRootWindow(options.dpy), 0, 0, 1, 1, 0, 0, 0);
+    *win_p = XCreateSimpleWindow(options->dpy, DefaultRootWindow(options->dpy), 0, 0, 1, 1, 0, 0, 0);
 
     /* get events about property changes */
-    XSelectInput(options.dpy, win, PropertyChangeMask);
+    XSelectInput(options->dpy, *win_p, PropertyChangeMask);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Data of a target fetched in advance with xclip_prefetch()
+ */
+typedef struct _prefetched_data {
+    char *target;   /* name of the target */
+    Atom property;  /* property of the window that the data is received on */
+    Atom type;      /* type of the data */
+    char *buf;      /* null-terminated data, or NULL if there is no data */
+    unsigned long len;
+    unsigned long cap; /* capacity of buf, which has room for a null terminator after the data */
+    int8_t incr;       /* the data is being received with the INCR mechanism */
+} prefetched_data;
+
+static prefetched_data *prefetched = NULL;
+static size_t prefetched_cnt = 0;
 
+/*
+ * Take the prefetched data of the target given by atom_name, if any. The data is removed from the prefetched data, and
+ * the caller should free *buf_ptr.
+ * Returns EXIT_SUCCESS if the data was prefetched, and EXIT_FAILURE otherwise.
+ */
+static int _take_prefetched(const char *atom_name, char **buf_ptr, unsigned long *len_ptr) {
+    if (!atom_name) atom_name = "UTF8_STRING";
+    for (size_t i = 0; i < prefetched_cnt; i++) {
+        prefetched_data *item = prefetched + i;
+        if (!item->buf || strcmp(item->target, atom_name)) continue;
+        *buf_ptr = item->buf;
+        *len_ptr = item->len;
+        item->buf = NULL;
+        item->len = 0;
+        return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr) {
+    if (io == XCLIP_OUT) {
+        *len_ptr = 0;
+        *buf_ptr = NULL;
+    }
+
+    /* Declare variables */
+    int exit_code;
     unsigned long len = 0;
-    if (io == XCLIP_IN) {
-        exit_code = doIn(win, *len_ptr, *buf_ptr, &options);
+
+    if (io == XCLIP_OUT && _take_prefetched(atom_name, buf_ptr, &len) == EXIT_SUCCESS) {
+        exit_code = EXIT_SUCCESS;
     } else {
-        exit_code = doOut(win, &len, buf_ptr, &options);
-    }
+        Window win; /* Window */
+        xclip_options options;
 
-    /* Disconnect from the X server */
-    XCloseDisplay(options.dpy);
+        if (_xclip_init(atom_name, &options, &win) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
 
-    if (io == XCLIP_IN) return exit_code;
+        if (io == XCLIP_IN) {
+            exit_code = doIn(win, *len_ptr, *buf_ptr, &options);
+        } else {
+            exit_code = doOut(win, &len, buf_ptr, &options);
+        }
 
-    if (exit_code != EXIT_SUCCESS || len >= 0xFFFFFFFFUL || !*buf_ptr) {
-        exit_code = EXIT_FAILURE;
+        /* Disconnect from the X server */
+        XCloseDisplay(options.dpy);
+
+        if (io == XCLIP_IN) return exit_code;
     }
-    if ((exit_code != EXIT_SUCCESS) ||
-        (atom_name && !strcmp(atom_name, "image/png") &&
-         (len < 8 || memcmp(*buf_ptr, "\x89PNG\r\n\x1a\n", 8))) ||  // invalid png
-        (atom_name && !strcmp(atom_name, "image/jpeg") &&
-         (len < 3 || memcmp(*buf_ptr, "\xff\xd8\xff", 3)))) {  // invalid jpeg
-        *len_ptr = 0;
+
+    if (exit_code == EXIT_SUCCESS &&
+        (len >= 0xFFFFFFFFUL || !*buf_ptr || _check_magic(atom_name, *buf_ptr, len) != EXIT_SUCCESS)) {
         exit_code = EXIT_FAILURE;
     }
     if (exit_code == EXIT_SUCCESS) {
         *len_ptr = (uint32_t)len;
     } else {
+        *len_ptr = 0;
         if (*buf_ptr) free(*buf_ptr);
         *buf_ptr = NULL;
     }
 
     return exit_code;
 }
+
+/*
+ * Writes the parts of a selection with the given function. The first bytes are held until there are enough of them to
+ * check the signature of image targets, so that nothing is written for invalid images.
+ */
+typedef struct _stream_writer {
+    const char *atom_name;
+    data_write_fn write_fn;
+    void *arg;
+    char head[MAGIC_MAX_LEN]; /* first bytes of the selection that are not written yet */
+    size_t head_len;
+    uint64_t written;
+} stream_writer;
+
+static int _write_part(void *arg, const char *data, size_t len) {
+    stream_writer *writer = (stream_writer *)arg;
+    size_t magic_len;
+    _get_magic(writer->atom_name, &magic_len);
+    if (writer->written == 0 && writer->head_len + len < magic_len) {
+        memcpy(writer->head + writer->head_len, data, len);
+        writer->head_len += len;
+        return EXIT_SUCCESS;
+    }
+    if (writer->written == 0 && magic_len > 0) {
+        const size_t rest = magic_len - writer->head_len;
+        memcpy(writer->head + writer->head_len, data, rest);
+        if (_check_magic(writer->atom_name, writer->head, magic_len) != EXIT_SUCCESS ||
+            writer->write_fn(writer->arg, writer->head, magic_len) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        writer->written = magic_len;
+        writer->head_len = 0;
+        data += rest;
+        len -= rest;
+    }
+    if (len == 0) return EXIT_SUCCESS;
+    if (writer->write_fn(writer->arg, data, len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    writer->written += len;
+    return EXIT_SUCCESS;
+}
+
+int xclip_stream(const char *atom_name, data_write_fn write_fn, void *arg, uint64_t *len_ptr) {
+    *len_ptr = 0;
+    Window win;
+    xclip_options options;
+    if (_xclip_init(atom_name, &options, &win) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    stream_writer writer = {.atom_name = atom_name, .write_fn = write_fn, .arg = arg, .head_len = 0, .written = 0};
+    options.write_fn = _write_part;
+    options.write_arg = &writer;
+    unsigned long len = 0;
+    char *buf = NULL;
+    int exit_code = doOut(win, &len, &buf, &options);
+
+    /* Disconnect from the X server */
+    XCloseDisplay(options.dpy);
+
+    if (buf) free(buf);
+    *len_ptr = writer.written;
+    if (exit_code != EXIT_SUCCESS) return exit_code;
+    // selections shorter than the signature are not written
+    if (writer.written == 0) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+void xclip_clear_prefetched(void) {
+    for (size_t i = 0; i < prefetched_cnt; i++) {
+        if (prefetched[i].target) free(prefetched[i].target);
+        if (prefetched[i].buf) free(prefetched[i].buf);
+    }
+    if (prefetched) free(prefetched);
+    prefetched = NULL;
+    prefetched_cnt = 0;
+}
+
+/*
+ * Read size bytes of the property of the prefetched data, append them to its data, and delete the property.
+ */
+static void _read_prefetched(Display *dpy, Window win, prefetched_data *item, unsigned long size) {
+    int format;
+    unsigned long items;
+    unsigned long after;
+    unsigned char *buf = NULL;
+    XGetWindowProperty(dpy, win, item->property, 0, (long)size, True, AnyPropertyType, &(item->type), &format, &items,
+                       &after, &buf);
+    const size_t len = items * mach_itemsize(format);
+    if (len > 0 && buf) {
+        item->buf = xcreserve(item->buf, &(item->cap), item->len + len);
+        memcpy(item->buf + item->len, buf, len);
+        item->len += len;
+        item->buf[item->len] = 0;
+    }
+    if (buf) XFree(buf);
+}
+
+/*
+ * Handle the property of the prefetched data after it is set by the selection owner. The whole data is read unless the
+ * owner starts an INCR transfer, in which case the property is deleted to get the first part.
+ * Returns 1 if an INCR transfer was started, and 0 otherwise.
+ */
+static int _start_prefetched(Display *dpy, Window win, prefetched_data *item, Atom incr) {
+    int format;
+    unsigned long items;
+    unsigned long size;
+    unsigned char *buf = NULL;
+    XGetWindowProperty(dpy, win, item->property, 0, 0, False, AnyPropertyType, &(item->type), &format, &items, &size,
+                       &buf);
+    if (buf) XFree(buf);
+    if (item->type == incr) {
+        // the INCR property holds a lower bound on the size of the data. Reserve that much to receive the data into
+        XGetWindowProperty(dpy, win, item->property, 0, 1, False, incr, &(item->type), &format, &items, &size, &buf);
+        if (buf && format == 32 && items == 1) {
+            const unsigned long lower_bound = *(unsigned long *)(void *)buf;
+            item->buf = xcreserve_incr(&(item->cap), lower_bound);
+            if (item->buf) item->buf[0] = 0;
+        }
+        if (buf) XFree(buf);
+        item->incr = 1;
+        XDeleteProperty(dpy, win, item->property);
+        return 1;
+    }
+    _read_prefetched(dpy, win, item, size);
+    return 0;
+}
+
+/*
+ * Receive the parts of the prefetched data that are sent with the INCR mechanism, until all incr_cnt transfers end.
+ * Each transfer ends with an empty part.
+ * Returns EXIT_SUCCESS on success, CLIPBOARD_TIMEOUT if the transfers do not end by the deadline, and EXIT_FAILURE on
+ * error.
+ */
+static int _receive_incr_parts(Display *dpy, Window win, size_t incr_cnt, uint64_t deadline) {
+    XEvent evt;
+    while (incr_cnt > 0) {
+        const int status = _next_event(dpy, &evt, deadline);
+        if (status != EXIT_SUCCESS) return status;
+        if (evt.type != PropertyNotify || evt.xproperty.state != PropertyNewValue) continue;
+        prefetched_data *item = NULL;
+        for (size_t i = 0; i < prefetched_cnt; i++) {
+            if (prefetched[i].incr && prefetched[i].property == evt.xproperty.atom) item = prefetched + i;
+        }
+        if (!item) continue;
+        int format;
+        unsigned long items;
+        unsigned long size;
+        unsigned char *buf = NULL;
+        XGetWindowProperty(dpy, win, item->property, 0, 0, False, AnyPropertyType, &(item->type), &format, &items,
+                           &size, &buf);
+        if (buf) XFree(buf);
+        if (size == 0) {
+            XDeleteProperty(dpy, win, item->property);
+            item->incr = 0;
+            incr_cnt--;
+        } else {
+            _read_prefetched(dpy, win, item, size);
+        }
+        XFlush(dpy);
+    }
+    return EXIT_SUCCESS;
+}
+
+int xclip_prefetch(const char *const *targets, size_t cnt) {
+    xclip_clear_prefetched();
+    if (cnt == 0 || cnt > MAX_PREFETCH_TARGETS) return EXIT_FAILURE;
+    Window win;
+    xclip_options options;
+    if (_xclip_init(NULL, &options, &win) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    Display *dpy = options.dpy;
+
+    prefetched = xcmalloc(cnt * sizeof(prefetched_data));
+    prefetched_cnt = cnt;
+    // intern the targets, a property for each target, and the atoms of the MULTIPLE request in a single request
+    char pty_names[MAX_PREFETCH_TARGETS][16];
+    char multiple_name[] = "MULTIPLE";
+    char atom_pair_name[] = "ATOM_PAIR";
+    char multiple_pty_name[] = "XCLIP_MULTIPLE";
+    char incr_name[] = "INCR";
+    char *names[2 * MAX_PREFETCH_TARGETS + 4];
+    for (size_t i = 0; i < cnt; i++) {
+        prefetched[i].target = strdup(targets[i]);
+        prefetched[i].buf = NULL;
+        prefetched[i].len = 0;
+        prefetched[i].cap = 0;
+        prefetched[i].incr = 0;
+        prefetched[i].type = None;
+        if (!prefetched[i].target || snprintf_check(pty_names[i], sizeof(pty_names[i]), "XCLIP_OUT_%zu", i)) {
+            prefetched_cnt = i + 1;
+            xclip_clear_prefetched();
+            XCloseDisplay(dpy);
+            return EXIT_FAILURE;
+        }
+        names[i] = prefetched[i].target;
+        names[cnt + i] = pty_names[i];
+    }
+    names[2 * cnt] = multiple_name;
+    names[2 * cnt + 1] = atom_pair_name;
+    names[2 * cnt + 2] = multiple_pty_name;
+    names[2 * cnt + 3] = incr_name;
+    Atom atoms[2 * MAX_PREFETCH_TARGETS + 4];
+    XInternAtoms(dpy, names, (int)(2 * cnt + 4), False, atoms);
+    const Atom multiple = atoms[2 * cnt];
+    const Atom atom_pair = atoms[2 * cnt + 1];
+    const Atom multiple_pty = atoms[2 * cnt + 2];
+    const Atom incr = atoms[2 * cnt + 3];
+
+    // the parameters of MULTIPLE are the pairs of a target and the property to put its data into
+    Atom pairs[2 * MAX_PREFETCH_TARGETS];
+    for (size_t i = 0; i < cnt; i++) {
+        pairs[2 * i] = atoms[i];
+        pairs[2 * i + 1] = atoms[cnt + i];
+        prefetched[i].property = atoms[cnt + i];
+    }
+    XChangeProperty(dpy, win, multiple_pty, atom_pair, 32, PropModeReplace, (unsigned char *)pairs, (int)(2 * cnt));
+    XConvertSelection(dpy, options.sseln, multiple, multiple_pty, win, CurrentTime);
+
+    XEvent evt;
+    int status;
+    do {
+        status = _next_event(dpy, &evt, options.deadline);
+    } while (status == EXIT_SUCCESS && evt.type != SelectionNotify);
+    if (status != EXIT_SUCCESS || evt.xselection.property == None) {
+#ifdef DEBUG_MODE
+        if (status == EXIT_SUCCESS) fputs("MULTIPLE target is not supported by the selection owner\n", stderr);
+#endif
+        xclip_clear_prefetched();
+        XCloseDisplay(dpy);
+        return status == EXIT_SUCCESS ? EXIT_FAILURE : status;
+    }
+
+    // the owner replaces the property of each target that it could not convert with None
+    Atom type;
+    int format;
+    unsigned long items;
+    unsigned long after;
+    unsigned char *buf = NULL;
+    XGetWindowProperty(dpy, win, multiple_pty, 0, (long)(2 * cnt), True, AnyPropertyType, &type, &format, &items,
+                       &after, &buf);
+    const Atom *results = (const Atom *)buf;
+    size_t incr_cnt = 0;
+    for (size_t i = 0; i < cnt; i++) {
+        if (!results || format != 32 || items < 2 * cnt || results[2 * i + 1] == None) continue;
+        incr_cnt += (size_t)_start_prefetched(dpy, win, prefetched + i, incr);
+    }
+    if (buf) XFree(buf);
+    XFlush(dpy);
+    status = _receive_incr_parts(dpy, win, incr_cnt, options.deadline);
+    if (status != EXIT_SUCCESS) {
+        xclip_clear_prefetched();
+        XCloseDisplay(dpy);
+        return status;
+    }
+
+    // TARGETS are kept as the names of the targets, in the same format as they are returned by xclip_util()
+    for (size_t i = 0; i < cnt; i++) {
+        prefetched_data *item = prefetched + i;
+        if (item->type != XA_ATOM || !item->buf || strcmp(item->target, "TARGETS")) continue;
+        char *names_text = _atom_names_text(dpy, (Atom *)(void *)item->buf, item->len / sizeof(Atom), &(item->len));
+        free(item->buf);
+        item->buf = names_text;
+    }
+    XCloseDisplay(dpy);
+    return EXIT_SUCCESS;
+}
@@ -4,7 +4,9 @@
 #define XCLIP_IN 0
 #define XCLIP_OUT 1
 
+#include <stddef.h>
 #include <stdint.h>
+#include <utils/utils.h>
 
 /*
  * Get or set clipboard data
@@ -13,7 +15,35 @@
  * Gets or sets the size of the buffer in bytes from/to len_ptr.
  * Returns 0 on success.
  * Returns -1 if an error occured.
+ * Returns CLIPBOARD_TIMEOUT if the selection owner does not respond within configuration.clipboard_timeout. In set
+ * mode, an INCR transfer to a requestor that stops taking the parts for that long is abandoned instead.
  */
 extern int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr);
 
+/*
+ * Fetch the clipboard data of several targets in advance with a single request for the MULTIPLE target, which the
+ * selection owner answers with the data of all the targets it can convert. All the data is received on one connection
+ * to the X server. Later calls to xclip_util() in get mode for these targets return the prefetched data instead of
+ * requesting it again. The data of each target is returned only once. Data of TARGETS is kept as the names of the
+ * targets. At most 8 targets can be prefetched.
+ * Returns EXIT_SUCCESS on success, CLIPBOARD_TIMEOUT if the owner does not respond in time, and EXIT_FAILURE on other
+ * failures, such as when the owner does not support MULTIPLE.
+ */
+extern int xclip_prefetch(const char *const *targets, size_t cnt);
+
+/*
+ * Discard the prefetched clipboard data that is not taken yet.
+ */
+extern void xclip_clear_prefetched(void);
+
+/*
+ * Get clipboard data and write it in parts with write_fn as the parts are received, without holding the whole data in
+ * memory. Large data is received in parts with the INCR mechanism.
+ * Image data is written only if it starts with the signature of its format.
+ * Sets the number of bytes written to len_ptr. Parts of the data may have been written on failure.
+ * Returns EXIT_SUCCESS on success, CLIPBOARD_TIMEOUT if the owner does not respond in time, and EXIT_FAILURE on other
+ * failures or if there is no data.
+ */
+extern int xclip_stream(const char *atom_name, data_write_fn write_fn, void *arg, uint64_t *len_ptr);
+
 #endif  // XCLIP_XCLIP_H_
@@ -0,0 +1,232 @@
+/*
+ * xscreenshot/pixel_convert.c - convert X image rows to RGB
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <xscreenshot/pixel_convert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define PIXEL_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Scalar converter for 24-bit and 32-bit pixels where each color is a whole byte.
+ * This is also used to convert the remaining pixels at the end of a row after the vectorized converters.
+ */
+static void convertrow_bytes(unsigned char *drow, const unsigned char *srow, uint32_t width,
+                             const row_converter *conv) {
+    const uint8_t bytes_per_pixel = conv->bytes_per_pixel;
+    const uint8_t r = conv->offsets[0];
+    const uint8_t g = conv->offsets[1];
+    const uint8_t b = conv->offsets[2];
+    for (uint32_t x = 0; x < width; x++) {
+        drow[0] = srow[r];
+        drow[1] = srow[g];
+        drow[2] = srow[b];
+        drow += 3;
+        srow += bytes_per_pixel;
+    }
+}
+
+static inline uint32_t _read_pixel(const unsigned char *src, uint8_t bytes_per_pixel, uint8_t byte_order) {
+    uint32_t value = 0;
+    if (byte_order == XCB_IMAGE_ORDER_LSB_FIRST) {
+        for (uint8_t i = bytes_per_pixel; i > 0; i--) value = (value << 8) | src[i - 1];
+    } else {
+        for (uint8_t i = 0; i < bytes_per_pixel; i++) value = (value << 8) | src[i];
+    }
+    return value;
+}
+
+static inline unsigned char _scale_channel(uint32_t value, const row_converter *conv, int channel) {
+    const uint8_t bits = conv->bits[channel];
+    const uint32_t c = (value & conv->masks[channel]) >> conv->shifts[channel];
+    if (bits >= 8) return (unsigned char)(c >> (bits - 8));
+    const uint32_t max = (1U << bits) - 1;
+    return (unsigned char)((c * 255 + max / 2) / max);
+}
+
+/*
+ * Scalar converter for any supported pixel format. Used for 8-bit and 16-bit visuals and for color masks that are not
+ * aligned to bytes.
+ */
+static void convertrow_generic(unsigned char *drow, const unsigned char *srow, uint32_t width,
+                               const row_converter *conv) {
+    const uint8_t bytes_per_pixel = conv->bytes_per_pixel;
+    const uint8_t byte_order = conv->byte_order;
+    const unsigned char *palette = conv->palette;
+    for (uint32_t x = 0; x < width; x++) {
+        const uint32_t value = _read_pixel(srow, bytes_per_pixel, byte_order);
+        if (palette) {
+            memcpy(drow, palette + (value & 0xFF) * 3, 3);
+        } else {
+            drow[0] = _scale_channel(value, conv, 0);
+            drow[1] = _scale_channel(value, conv, 1);
+            drow[2] = _scale_channel(value, conv, 2);
+        }
+        drow += 3;
+        srow += bytes_per_pixel;
+    }
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+/*
+ * Build a pshufb mask that picks R, G, B of 4 consecutive pixels into the first 12 bytes.
+ */
+static void _shuffle_mask(unsigned char mask[16], const row_converter *conv) {
+    memset(mask, 0x80, 16);
+    for (unsigned char i = 0; i < 4; i++) {
+        for (unsigned char c = 0; c < 3; c++) {
+            mask[i * 3 + c] = (unsigned char)(i * conv->bytes_per_pixel + conv->offsets[c]);
+        }
+    }
+}
+
+__attribute__((target("ssse3"))) static void convertrow_32_ssse3(unsigned char *drow, const unsigned char *srow,
+                                                                  uint32_t width, const row_converter *conv) {
+    unsigned char mask_bytes[16];
+    _shuffle_mask(mask_bytes, conv);
+    const __m128i mask = _mm_loadu_si128((const __m128i *)(const void *)mask_bytes);
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(const void *)(srow + x * 4));
+        _mm_storeu_si128((__m128i *)(void *)(drow + x * 3), _mm_shuffle_epi8(px, mask));
+    }
+    convertrow_bytes(drow + x * 3, srow + x * 4, width - x, conv);
+}
+
+__attribute__((target("ssse3"))) static void convertrow_24_ssse3(unsigned char *drow, const unsigned char *srow,
+                                                                  uint32_t width, const row_converter *conv) {
+    unsigned char mask_bytes[16];
+    _shuffle_mask(mask_bytes, conv);
+    const __m128i mask = _mm_loadu_si128((const __m128i *)(const void *)mask_bytes);
+    uint32_t x = 0;
+    // each load reads 16 bytes (5 and a third pixels). Keep the loads within the row.
+    for (; x + 6 <= width; x += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(const void *)(srow + x * 3));
+        _mm_storeu_si128((__m128i *)(void *)(drow + x * 3), _mm_shuffle_epi8(px, mask));
+    }
+    convertrow_bytes(drow + x * 3, srow + x * 3, width - x, conv);
+}
+
+__attribute__((target("avx2"))) static void convertrow_32_avx2(unsigned char *drow, const unsigned char *srow,
+                                                                uint32_t width, const row_converter *conv) {
+    unsigned char mask_bytes[16];
+    _shuffle_mask(mask_bytes, conv);
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *)mask_bytes));
+    // pshufb works within 128-bit lanes. Move the 12 bytes of the upper lane next to those of the lower lane.
+    const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(const void *)(srow + x * 4));
+        px = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(px, mask), pack);
+        _mm256_storeu_si256((__m256i *)(void *)(drow + x * 3), px);
+    }
+    convertrow_bytes(drow + x * 3, srow + x * 4, width - x, conv);
+}
+
+#elif defined(PIXEL_CONVERT_NEON)
+
+// NEON structured loads return arrays of vectors by value
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waggregate-return"
+
+static void convertrow_32_neon(unsigned char *drow, const unsigned char *srow, uint32_t width,
+                               const row_converter *conv) {
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x4_t px = vld4q_u8(srow + x * 4);
+        uint8x16x3_t rgb;
+        rgb.val[0] = px.val[conv->offsets[0]];
+        rgb.val[1] = px.val[conv->offsets[1]];
+        rgb.val[2] = px.val[conv->offsets[2]];
+        vst3q_u8(drow + x * 3, rgb);
+    }
+    convertrow_bytes(drow + x * 3, srow + x * 4, width - x, conv);
+}
+
+static void convertrow_24_neon(unsigned char *drow, const unsigned char *srow, uint32_t width,
+                               const row_converter *conv) {
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x3_t px = vld3q_u8(srow + x * 3);
+        uint8x16x3_t rgb;
+        rgb.val[0] = px.val[conv->offsets[0]];
+        rgb.val[1] = px.val[conv->offsets[1]];
+        rgb.val[2] = px.val[conv->offsets[2]];
+        vst3q_u8(drow + x * 3, rgb);
+    }
+    convertrow_bytes(drow + x * 3, srow + x * 3, width - x, conv);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+int init_row_converter(row_converter *conv, const pixel_format *fmt) {
+    const uint8_t bits_per_pixel = fmt->bits_per_pixel;
+    if (bits_per_pixel != 8 && bits_per_pixel != 16 && bits_per_pixel != 24 && bits_per_pixel != 32) {
+        return EXIT_FAILURE;
+    }
+    conv->bytes_per_pixel = bits_per_pixel / 8;
+    conv->byte_order = fmt->byte_order;
+    conv->palette = fmt->palette;
+    conv->convert = convertrow_generic;
+    if (conv->palette) return EXIT_SUCCESS;
+
+    conv->masks[0] = fmt->red_mask;
+    conv->masks[1] = fmt->green_mask;
+    conv->masks[2] = fmt->blue_mask;
+    int whole_bytes = bits_per_pixel >= 24;
+    for (int c = 0; c < 3; c++) {
+        const uint32_t mask = conv->masks[c];
+        if (!mask) return EXIT_FAILURE;
+        const uint8_t shift = (uint8_t)__builtin_ctz(mask);
+        conv->shifts[c] = shift;
+        conv->bits[c] = (uint8_t)__builtin_popcount(mask >> shift);
+        if (conv->bits[c] != 8 || shift % 8 || shift / 8 >= conv->bytes_per_pixel) {
+            whole_bytes = 0;
+            continue;
+        }
+        if (conv->byte_order == XCB_IMAGE_ORDER_LSB_FIRST) {
+            conv->offsets[c] = shift / 8;
+        } else {
+            conv->offsets[c] = (uint8_t)(conv->bytes_per_pixel - 1 - shift / 8);
+        }
+    }
+    if (!whole_bytes) return EXIT_SUCCESS;
+
+    conv->convert = convertrow_bytes;
+#if defined(PIXEL_CONVERT_X86)
+    if (bits_per_pixel == 32 && __builtin_cpu_supports("avx2")) {
+        conv->convert = convertrow_32_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        conv->convert = bits_per_pixel == 32 ? convertrow_32_ssse3 : convertrow_24_ssse3;
+    }
+#elif defined(PIXEL_CONVERT_NEON)
+    conv->convert = bits_per_pixel == 32 ? convertrow_32_neon : convertrow_24_neon;
+#endif
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/*
+ * xscreenshot/pixel_convert.h - convert X image rows to RGB
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XSCREENSHOT_PIXEL_CONVERT_H_
+#define XSCREENSHOT_PIXEL_CONVERT_H_
+
+#include <stdint.h>
+
+/*
+ * Number of bytes that the vectorized converters may write past the end of a destination row.
+ * Destination rows should be allocated with (width * 3 + CONVERT_ROW_SLACK) bytes.
+ */
+#define CONVERT_ROW_SLACK 32
+
+/*
+ * Pixel format of a ZPixmap image.
+ * Color masks are used for TrueColor and DirectColor visuals. palette is used for other visuals.
+ */
+typedef struct _pixel_format {
+    uint8_t bits_per_pixel;
+    uint8_t byte_order;
+    uint32_t red_mask;
+    uint32_t green_mask;
+    uint32_t blue_mask;
+    const unsigned char *palette; /* 256 RGB triplets or NULL */
+} pixel_format;
+
+/*
+ * Image data in ZPixmap format as received from the X server
+ */
+typedef struct _raw_image {
+    const unsigned char *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_line;
+    pixel_format format;
+} raw_image;
+
+typedef struct _row_converter row_converter;
+
+/*
+ * Convert width pixels of the source row srow to 8-bit RGB and write them to drow.
+ */
+typedef void (*convert_row_fn)(unsigned char *drow, const unsigned char *srow, uint32_t width,
+                               const row_converter *conv);
+
+struct _row_converter {
+    convert_row_fn convert;
+    const unsigned char *palette;
+    uint8_t bytes_per_pixel;
+    uint8_t byte_order;
+    uint8_t offsets[3]; /* byte offsets of R, G, B in a pixel when each channel is a whole byte */
+    uint8_t shifts[3];
+    uint8_t bits[3];
+    uint32_t masks[3];
+};
+
+/*
+ * Prepare a row converter for the given pixel format. The fastest converter supported by the CPU is selected.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if the pixel format is not supported.
+ */
+extern int init_row_converter(row_converter *conv, const pixel_format *fmt);
+
+#endif  // XSCREENSHOT_PIXEL_CONVERT_H_
@@ -0,0 +1,637 @@
+/*
+ * xscreenshot/png_encoder.c - parallel PNG encoder for screenshots
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <png.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/config.h>
+#include <utils/utils.h>
+#include <xscreenshot/png_encoder.h>
+#include <zlib.h>
+
+#define MIN_STRIP_ROWS 64
+#define MAX_STRIPS 16
+#define MAX_THREADS 16
+#define FILTER_CNT 5
+#define STREAM_STRIPS_PER_THREAD 4
+
+/*
+ * Strips of an image to be deflated by a pool of threads. Each thread takes the next strip that is not taken yet.
+ */
+typedef struct _strip_queue {
+    const raw_image *img;
+    const row_converter *conv;
+    const png_params *params;
+    png_strip *strips;
+    uint32_t strip_cnt;
+    uint32_t next;
+    int status;
+    int8_t *done;     /* if not NULL, the flag of each strip is set when the strip is deflated and cond is signaled */
+    uint32_t workers; /* number of workers that have not exited. Used only with done */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} strip_queue;
+
+/*
+ * Tiles to be encoded by a pool of threads. Each thread takes the next tile that is not taken yet.
+ */
+typedef struct _tile_queue {
+    const row_converter *conv;
+    const png_params *params;
+    png_tile *tiles;
+    uint32_t tile_cnt;
+    uint32_t next;
+    int status;
+} tile_queue;
+
+static inline unsigned char _paeth(unsigned char a, unsigned char b, unsigned char c) {
+    // distances of p = a + b - c from a, b, and c
+    const unsigned pa = b > c ? (unsigned)(b - c) : (unsigned)(c - b);
+    const unsigned pb = a > c ? (unsigned)(a - c) : (unsigned)(c - a);
+    const unsigned ab = (unsigned)a + b;
+    const unsigned cc = 2U * c;
+    const unsigned pc = ab > cc ? ab - cc : cc - ab;
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+/*
+ * Sum of the filtered bytes taken as signed values. This is the heuristic libpng uses to choose a filter.
+ */
+static inline size_t _filter_cost(const unsigned char *row, size_t len) {
+    size_t sum = 0;
+    for (size_t i = 0; i < len; i++) sum += row[i] < 128 ? row[i] : 256U - row[i];
+    return sum;
+}
+
+/*
+ * Apply the PNG filter type filter to the row cur and write the filtered row to out.
+ */
+static void _apply_filter(int filter, const unsigned char *cur, const unsigned char *prev, size_t len,
+                          unsigned char *out) {
+    const size_t bpp = 3;
+    switch (filter) {
+        case PNG_FILTER_VALUE_SUB: {
+            memcpy(out, cur, bpp);
+            for (size_t i = bpp; i < len; i++) out[i] = (unsigned char)(cur[i] - cur[i - bpp]);
+            break;
+        }
+        case PNG_FILTER_VALUE_UP: {
+            for (size_t i = 0; i < len; i++) out[i] = (unsigned char)(cur[i] - prev[i]);
+            break;
+        }
+        case PNG_FILTER_VALUE_AVG: {
+            for (size_t i = 0; i < bpp; i++) out[i] = (unsigned char)(cur[i] - (prev[i] >> 1));
+            for (size_t i = bpp; i < len; i++) out[i] = (unsigned char)(cur[i] - ((cur[i - bpp] + prev[i]) >> 1));
+            break;
+        }
+        case PNG_FILTER_VALUE_PAETH: {
+            // the predictor is the byte above when there is no byte to the left
+            for (size_t i = 0; i < bpp; i++) out[i] = (unsigned char)(cur[i] - prev[i]);
+            for (size_t i = bpp; i < len; i++) {
+                out[i] = (unsigned char)(cur[i] - _paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+            }
+            break;
+        }
+        default: {
+            memcpy(out, cur, len);
+        }
+    }
+}
+
+/*
+ * Filter the row cur and return the filtered row including the leading filter type byte.
+ * If filter is PNG_FILTER_ADAPTIVE, each PNG filter is applied and the filtered row with the lowest cost is returned.
+ * Then candidates should have space for FILTER_CNT * (len + 1) bytes. Otherwise, the given filter type is applied and
+ * candidates should have space for len + 1 bytes.
+ */
+static unsigned char *_filter_row(const unsigned char *cur, const unsigned char *prev, size_t len,
+                                  unsigned char *candidates, int filter) {
+    if (filter != PNG_FILTER_ADAPTIVE) {
+        candidates[0] = (unsigned char)filter;
+        _apply_filter(filter, cur, prev, len, candidates + 1);
+        return candidates;
+    }
+    const size_t bpp = 3;
+    for (unsigned char f = 0; f < FILTER_CNT; f++) candidates[f * (len + 1)] = f;
+    unsigned char *none = candidates + 1;
+    unsigned char *sub = none + len + 1;
+    unsigned char *up = sub + len + 1;
+    unsigned char *avg = up + len + 1;
+    unsigned char *paeth = avg + len + 1;
+
+    memcpy(none, cur, len);
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char a = i >= bpp ? cur[i - bpp] : 0;
+        const unsigned char b = prev[i];
+        const unsigned char c = i >= bpp ? prev[i - bpp] : 0;
+        sub[i] = (unsigned char)(cur[i] - a);
+        up[i] = (unsigned char)(cur[i] - b);
+        avg[i] = (unsigned char)(cur[i] - ((a + b) >> 1));
+        paeth[i] = (unsigned char)(cur[i] - _paeth(a, b, c));
+    }
+
+    unsigned char *best = candidates;
+    size_t best_cost = _filter_cost(none, len);
+    for (unsigned char f = 1; f < FILTER_CNT; f++) {
+        unsigned char *row = candidates + f * (len + 1);
+        const size_t cost = _filter_cost(row + 1, len);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = row;
+        }
+    }
+    return best;
+}
+
+/*
+ * Run deflate until all input is consumed, growing the output buffer of the strip whenever it is full.
+ * returns the return value of the last deflate call, or Z_MEM_ERROR if the output buffer could not be grown.
+ */
+static int _deflate_all(z_stream *strm, png_strip *strip, size_t *capacity_p, int flush) {
+    int ret;
+    do {
+        if (strm->avail_out == 0) {
+            const size_t new_cap = *capacity_p * 2;
+            unsigned char *new_out = realloc(strip->out, new_cap);
+            if (!new_out) return Z_MEM_ERROR;
+            strip->out = new_out;
+            strm->next_out = new_out + *capacity_p;
+            strm->avail_out = (uInt)(new_cap - *capacity_p);
+            *capacity_p = new_cap;
+        }
+        ret = deflate(strm, flush);
+        if (ret == Z_STREAM_ERROR) return ret;
+    } while (strm->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    return ret;
+}
+
+/*
+ * Convert, filter and deflate the rows of a strip with a freshly initialized or reset deflate stream.
+ * The stream of the strip that ends at the last row of the image is finished while the others end on a sync flush
+ * boundary so that the streams can be concatenated.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _deflate_strip(const strip_queue *queue, png_strip *strip, z_stream *strm, unsigned char *prev,
+                          unsigned char *cur, unsigned char *candidates) {
+    const raw_image *img = queue->img;
+    const row_converter *conv = queue->conv;
+    const int filter = queue->params->filter;
+    const size_t row_len = (size_t)img->width * 3;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    size_t capacity = deflateBound(strm, (uLong)((row_len + 1) * (strip->row_end - strip->row_start))) + 64;
+    strip->out = malloc(capacity);
+    if (!strip->out) return EXIT_FAILURE;
+    strm->next_out = strip->out;
+    strm->avail_out = (uInt)capacity;
+
+    // the filters of the first row need the row above it
+    if (strip->row_start > 0) {
+        conv->convert(prev, img->data + (size_t)(strip->row_start - 1) * img->bytes_per_line, img->width, conv);
+    } else {
+        memset(prev, 0, row_len);
+    }
+    for (uint32_t h = strip->row_start; h < strip->row_end; h++) {
+        conv->convert(cur, img->data + (size_t)h * img->bytes_per_line, img->width, conv);
+        unsigned char *filtered = _filter_row(cur, prev, row_len, candidates, filter);
+        adler = adler32(adler, filtered, (uInt)(row_len + 1));
+        strm->next_in = filtered;
+        strm->avail_in = (uInt)(row_len + 1);
+        if (_deflate_all(strm, strip, &capacity, Z_NO_FLUSH) < 0) return EXIT_FAILURE;
+        unsigned char *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    const int last = strip->row_end == img->height;
+    int ret = _deflate_all(strm, strip, &capacity, last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (ret < 0 || (last && ret != Z_STREAM_END)) return EXIT_FAILURE;
+    strip->out_len = capacity - strm->avail_out;
+    strip->adler = (uint32_t)adler;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Mark the strip at index ind as deflated, or the worker as exited if ind is the number of strips, and wake up the
+ * thread waiting for strips if the queue tracks the progress.
+ */
+static void _notify_progress(strip_queue *queue, uint32_t ind) {
+    if (!queue->done) return;
+    pthread_mutex_lock(&(queue->lock));
+    if (ind < queue->strip_cnt) {
+        queue->done[ind] = 1;
+    } else {
+        queue->workers--;
+    }
+    pthread_cond_broadcast(&(queue->cond));
+    pthread_mutex_unlock(&(queue->lock));
+}
+
+/*
+ * Deflate strips taken from the queue until no strip is left. The buffers and the deflate stream are reused for all
+ * strips taken by the thread.
+ */
+static void *_deflate_worker(void *arg) {
+    strip_queue *queue = (strip_queue *)arg;
+    const size_t row_len = (size_t)queue->img->width * 3;
+    const png_params *params = queue->params;
+    const size_t candidate_cnt = params->filter == PNG_FILTER_ADAPTIVE ? FILTER_CNT : 1;
+
+    unsigned char *prev = malloc(row_len + CONVERT_ROW_SLACK);
+    unsigned char *cur = malloc(row_len + CONVERT_ROW_SLACK);
+    unsigned char *candidates = malloc(candidate_cnt * (row_len + 1));
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (!(prev && cur && candidates) ||
+        deflateInit2(&strm, params->level, Z_DEFLATED, -MAX_WBITS, 8, params->strategy) != Z_OK) {
+        // strips not taken by this thread are deflated by the other threads
+        if (prev) free(prev);
+        if (cur) free(cur);
+        if (candidates) free(candidates);
+        _notify_progress(queue, queue->strip_cnt);
+        return NULL;
+    }
+    uint32_t ind;
+    while ((ind = __atomic_fetch_add(&(queue->next), 1, __ATOMIC_RELAXED)) < queue->strip_cnt) {
+        if (_deflate_strip(queue, queue->strips + ind, &strm, prev, cur, candidates) != EXIT_SUCCESS) {
+            __atomic_store_n(&(queue->status), EXIT_FAILURE, __ATOMIC_RELAXED);
+        }
+        deflateReset(&strm);
+        _notify_progress(queue, ind);
+    }
+    deflateEnd(&strm);
+    free(prev);
+    free(cur);
+    free(candidates);
+    _notify_progress(queue, queue->strip_cnt);
+    return NULL;
+}
+
+static uint32_t _get_cpu_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    if (cpus > MAX_THREADS) cpus = MAX_THREADS;
+    return (uint32_t)cpus;
+}
+
+int deflate_png_strips(const raw_image *img, const row_converter *conv, const png_params *params, png_strip *strips,
+                       uint32_t strip_cnt) {
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        strips[i].out = NULL;
+        strips[i].out_len = 0;
+    }
+    strip_queue queue = {.img = img,
+                         .conv = conv,
+                         .params = params,
+                         .strips = strips,
+                         .strip_cnt = strip_cnt,
+                         .next = 0,
+                         .status = EXIT_SUCCESS,
+                         .done = NULL};
+    uint32_t thread_cnt = _get_cpu_count();
+    if (thread_cnt > strip_cnt) thread_cnt = strip_cnt;
+    pthread_t threads[MAX_THREADS];
+    int8_t started[MAX_THREADS];
+    // the calling thread also takes strips. So it is enough if at least one thread is working on the queue.
+    for (uint32_t i = 1; i < thread_cnt; i++) {
+        started[i] = pthread_create(threads + i, NULL, _deflate_worker, &queue) == 0;
+    }
+    _deflate_worker(&queue);
+    for (uint32_t i = 1; i < thread_cnt; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+    int status = queue.status;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        if (!strips[i].out_len) status = EXIT_FAILURE;
+    }
+    if (status == EXIT_SUCCESS) return EXIT_SUCCESS;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        if (strips[i].out) free(strips[i].out);
+        strips[i].out = NULL;
+    }
+    return EXIT_FAILURE;
+}
+
+/*
+ * Fill the 2 bytes of the header of a zlib stream of raw deflate streams compressed at the given level.
+ */
+static void _zlib_header(int level, unsigned char *header) {
+    // deflate with 32K window. The compression level is only informative
+    const unsigned cmf = 0x78;
+    const unsigned flevel = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+    const unsigned flg = (flevel << 6) + 31 - ((cmf << 8) + (flevel << 6)) % 31;
+    header[0] = (unsigned char)cmf;
+    header[1] = (unsigned char)flg;
+}
+
+/*
+ * Write the PNG with a single IDAT chunk holding the zlib stream made of the deflate streams of the strips.
+ */
+static int _write_png(uint32_t width, uint32_t height, int level, const png_strip *strips, uint32_t strip_cnt,
+                      struct mem_file *file) {
+    const size_t row_len = (size_t)width * 3;
+    size_t deflate_len = 0;
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        const size_t in_len = (row_len + 1) * (strips[i].row_end - strips[i].row_start);
+        deflate_len += strips[i].out_len;
+        adler = adler32_combine(adler, strips[i].adler, (z_off_t)in_len);
+    }
+    const size_t idat_len = deflate_len + 6; /* zlib header and the adler32 checksum */
+    if (idat_len > PNG_UINT_31_MAX) return EXIT_FAILURE;
+
+    png_structp png_write_p = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_write_p) return EXIT_FAILURE;
+    png_infop png_info_p = png_create_info_struct(png_write_p);
+    if ((!png_info_p) || setjmp(png_jmpbuf(png_write_p))) {
+        png_destroy_write_struct(&png_write_p, &png_info_p);
+        return EXIT_FAILURE;
+    }
+    png_set_write_fn(png_write_p, file, &png_mem_write_data, NULL);
+    png_set_IHDR(png_write_p, png_info_p, (png_uint_32)width, (png_uint_32)height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
+    png_write_info(png_write_p, png_info_p);
+
+    unsigned char zlib_header[2];
+    _zlib_header(level, zlib_header);
+    const unsigned char zlib_trailer[4] = {(unsigned char)(adler >> 24), (unsigned char)(adler >> 16),
+                                           (unsigned char)(adler >> 8), (unsigned char)adler};
+    png_write_chunk_start(png_write_p, (png_const_bytep)"IDAT", (png_uint_32)idat_len);
+    png_write_chunk_data(png_write_p, zlib_header, sizeof(zlib_header));
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        png_write_chunk_data(png_write_p, strips[i].out, strips[i].out_len);
+    }
+    png_write_chunk_data(png_write_p, zlib_trailer, sizeof(zlib_trailer));
+    png_write_chunk_end(png_write_p);
+    png_write_chunk(png_write_p, (png_const_bytep)"IEND", NULL, 0);
+    png_destroy_write_struct(&png_write_p, &png_info_p);
+    return EXIT_SUCCESS;
+}
+
+int write_png_strips(uint32_t width, uint32_t height, int level, const png_strip *strips, uint32_t strip_cnt,
+                     char **buf_p, size_t *len_p) {
+    *buf_p = NULL;
+    *len_p = 0;
+    struct mem_file fake_file;
+    fake_file.buffer = NULL;
+    fake_file.capacity = 0;
+    fake_file.size = 0;
+    if (_write_png(width, height, level, strips, strip_cnt, &fake_file) != EXIT_SUCCESS) {
+        if (fake_file.buffer) free(fake_file.buffer);
+        return EXIT_FAILURE;
+    }
+
+    char *new_buf = realloc(fake_file.buffer, fake_file.size);
+    if (new_buf) fake_file.buffer = new_buf;
+    *buf_p = fake_file.buffer;
+    *len_p = fake_file.size;
+    return EXIT_SUCCESS;
+}
+
+int encode_png(const raw_image *img, const row_converter *conv, const png_params *params, char **buf_p,
+               size_t *len_p) {
+    *buf_p = NULL;
+    *len_p = 0;
+    if (img->width == 0 || img->height == 0) return EXIT_FAILURE;
+
+    // one strip per thread. Each strip boundary restarts the deflate dictionary
+    uint32_t strip_cnt = img->height / MIN_STRIP_ROWS;
+    if (strip_cnt > _get_cpu_count()) strip_cnt = _get_cpu_count();
+    if (strip_cnt > MAX_STRIPS) strip_cnt = MAX_STRIPS;
+    if (strip_cnt < 1) strip_cnt = 1;
+    const uint32_t rows_per_strip = (img->height + strip_cnt - 1) / strip_cnt;
+    png_strip strips[MAX_STRIPS];
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        strips[i].row_start = i * rows_per_strip;
+        strips[i].row_end = (i + 1 == strip_cnt) ? img->height : (i + 1) * rows_per_strip;
+    }
+    if (deflate_png_strips(img, conv, params, strips, strip_cnt) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int status = write_png_strips(img->width, img->height, params->level, strips, strip_cnt, buf_p, len_p);
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        free(strips[i].out);
+    }
+    return status;
+}
+
+static unsigned char *_put_uint32(unsigned char *p, uint32_t value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+    return p + 4;
+}
+
+/*
+ * Write the length and the type of a PNG chunk at p.
+ * returns the position of the data of the chunk.
+ */
+static unsigned char *_start_chunk(unsigned char *p, const char *type, size_t len) {
+    p = _put_uint32(p, (uint32_t)len);
+    memcpy(p, type, 4);
+    return p + 4;
+}
+
+/*
+ * Write the CRC of the PNG chunk that starts at chunk and ends at end.
+ * returns the position after the chunk.
+ */
+static unsigned char *_end_chunk(unsigned char *chunk, unsigned char *end) {
+    // the CRC covers the chunk type and the data
+    return _put_uint32(end, (uint32_t)crc32(0L, chunk + 4, (uInt)(end - chunk - 4)));
+}
+
+/*
+ * Write the deflate stream of a strip as an IDAT chunk with write_fn. The PNG signature, the IHDR chunk, and the zlib
+ * header are written before the first strip. The zlib checksum adler of all strips and the IEND chunk are written after
+ * the last strip.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _write_strip_chunk(const raw_image *img, int level, const png_strip *strip, uLong adler,
+                              data_write_fn write_fn, void *arg) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    const int first = strip->row_start == 0;
+    const int last = strip->row_end == img->height;
+    const size_t idat_len = strip->out_len + (first ? 2 : 0) + (last ? 4 : 0);
+    if (idat_len > PNG_UINT_31_MAX) return EXIT_FAILURE;
+    // each chunk has 12 bytes for its length, type, and CRC
+    const size_t len = (first ? sizeof(signature) + 25 : 0) + idat_len + 12 + (last ? 12 : 0);
+    unsigned char *buf = malloc(len);
+    if (!buf) return EXIT_FAILURE;
+    unsigned char *p = buf;
+    if (first) {
+        memcpy(p, signature, sizeof(signature));
+        unsigned char *ihdr = p + sizeof(signature);
+        p = _start_chunk(ihdr, "IHDR", 13);
+        p = _put_uint32(p, img->width);
+        p = _put_uint32(p, img->height);
+        const unsigned char ihdr_rest[5] = {8, PNG_COLOR_TYPE_RGB, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE,
+                                            PNG_INTERLACE_NONE};
+        memcpy(p, ihdr_rest, sizeof(ihdr_rest));
+        p = _end_chunk(ihdr, p + sizeof(ihdr_rest));
+    }
+    unsigned char *idat = p;
+    p = _start_chunk(idat, "IDAT", idat_len);
+    if (first) {
+        _zlib_header(level, p);
+        p += 2;
+    }
+    memcpy(p, strip->out, strip->out_len);
+    p += strip->out_len;
+    if (last) p = _put_uint32(p, (uint32_t)adler);
+    p = _end_chunk(idat, p);
+    if (last) {
+        unsigned char *iend = p;
+        p = _end_chunk(iend, _start_chunk(iend, "IEND", 0));
+    }
+    const int status = write_fn(arg, (const char *)buf, (size_t)(p - buf));
+    free(buf);
+    return status;
+}
+
+/*
+ * Wait until the strip at index ind of the queue is deflated and write it with write_fn. adler_p points to the zlib
+ * checksum of the strips above it, and it is updated with the checksum of the strip.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _write_next_strip(strip_queue *queue, uint32_t ind, int level, uLong *adler_p, data_write_fn write_fn,
+                             void *arg) {
+    pthread_mutex_lock(&(queue->lock));
+    while (!queue->done[ind] && queue->workers > 0) pthread_cond_wait(&(queue->cond), &(queue->lock));
+    const int8_t done = queue->done[ind];
+    pthread_mutex_unlock(&(queue->lock));
+    png_strip *strip = queue->strips + ind;
+    // the out_len of a strip that could not be deflated is 0
+    if (!done || !strip->out_len) return EXIT_FAILURE;
+    const size_t row_len = (size_t)queue->img->width * 3;
+    const size_t in_len = (row_len + 1) * (strip->row_end - strip->row_start);
+    *adler_p = adler32_combine(*adler_p, strip->adler, (z_off_t)in_len);
+    const int status = _write_strip_chunk(queue->img, level, strip, *adler_p, write_fn, arg);
+    free(strip->out);
+    strip->out = NULL;
+    return status;
+}
+
+int stream_png(const raw_image *img, const row_converter *conv, const png_params *params, data_write_fn write_fn,
+               void *arg) {
+    if (img->width == 0 || img->height == 0) return EXIT_FAILURE;
+
+    // more strips than threads so that the first strips are written while the others are deflated
+    const uint32_t cpus = _get_cpu_count();
+    uint32_t strip_cnt = img->height / MIN_STRIP_ROWS;
+    if (strip_cnt > cpus * STREAM_STRIPS_PER_THREAD) strip_cnt = cpus * STREAM_STRIPS_PER_THREAD;
+    if (strip_cnt < 1) strip_cnt = 1;
+    const uint32_t rows_per_strip = (img->height + strip_cnt - 1) / strip_cnt;
+    strip_cnt = (img->height + rows_per_strip - 1) / rows_per_strip;
+    png_strip *strips = malloc(sizeof(png_strip) * strip_cnt);
+    int8_t *done = calloc(strip_cnt, sizeof(int8_t));
+    if (!strips || !done) {
+        if (strips) free(strips);
+        if (done) free(done);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        strips[i].row_start = i * rows_per_strip;
+        strips[i].row_end = (i + 1 == strip_cnt) ? img->height : (i + 1) * rows_per_strip;
+        strips[i].out = NULL;
+        strips[i].out_len = 0;
+    }
+    strip_queue queue = {.img = img,
+                         .conv = conv,
+                         .params = params,
+                         .strips = strips,
+                         .strip_cnt = strip_cnt,
+                         .next = 0,
+                         .status = EXIT_SUCCESS,
+                         .done = done,
+                         .workers = 0};
+    pthread_mutex_init(&(queue.lock), NULL);
+    pthread_cond_init(&(queue.cond), NULL);
+
+    // the calling thread writes the strips while the workers deflate them
+    uint32_t thread_cnt = cpus < strip_cnt ? cpus : strip_cnt;
+    pthread_t threads[MAX_THREADS];
+    int8_t started[MAX_THREADS];
+    pthread_mutex_lock(&(queue.lock));
+    for (uint32_t i = 0; i < thread_cnt; i++) {
+        started[i] = pthread_create(threads + i, NULL, _deflate_worker, &queue) == 0;
+        if (started[i]) queue.workers++;
+    }
+    pthread_mutex_unlock(&(queue.lock));
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < strip_cnt && status == EXIT_SUCCESS; i++) {
+        status = _write_next_strip(&queue, i, params->level, &adler, write_fn, arg);
+    }
+    // stop the workers from taking the remaining strips
+    if (status != EXIT_SUCCESS) __atomic_store_n(&(queue.next), strip_cnt, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < thread_cnt; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        if (strips[i].out) free(strips[i].out);
+    }
+    pthread_cond_destroy(&(queue.cond));
+    pthread_mutex_destroy(&(queue.lock));
+    free(strips);
+    free(done);
+    return status;
+}
+
+static void *_encode_tile_worker(void *arg) {
+    tile_queue *queue = (tile_queue *)arg;
+    uint32_t ind;
+    while ((ind = __atomic_fetch_add(&(queue->next), 1, __ATOMIC_RELAXED)) < queue->tile_cnt) {
+        png_tile *tile = queue->tiles + ind;
+        if (encode_png(&(tile->img), queue->conv, queue->params, &(tile->out), &(tile->out_len)) != EXIT_SUCCESS) {
+            __atomic_store_n(&(queue->status), EXIT_FAILURE, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+int encode_png_tiles(const row_converter *conv, const png_params *params, png_tile *tiles, uint32_t tile_cnt) {
+    for (uint32_t i = 0; i < tile_cnt; i++) {
+        tiles[i].out = NULL;
+        tiles[i].out_len = 0;
+    }
+    tile_queue queue = {
+        .conv = conv, .params = params, .tiles = tiles, .tile_cnt = tile_cnt, .next = 0, .status = EXIT_SUCCESS};
+    uint32_t thread_cnt = _get_cpu_count();
+    if (thread_cnt > tile_cnt) thread_cnt = tile_cnt;
+    pthread_t threads[MAX_THREADS];
+    int8_t started[MAX_THREADS];
+    // the calling thread also takes tiles
+    for (uint32_t i = 1; i < thread_cnt; i++) {
+        started[i] = pthread_create(threads + i, NULL, _encode_tile_worker, &queue) == 0;
+    }
+    _encode_tile_worker(&queue);
+    for (uint32_t i = 1; i < thread_cnt; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    if (queue.status == EXIT_SUCCESS) return EXIT_SUCCESS;
+    for (uint32_t i = 0; i < tile_cnt; i++) {
+        if (tiles[i].out) free(tiles[i].out);
+        tiles[i].out = NULL;
+    }
+    return EXIT_FAILURE;
+}
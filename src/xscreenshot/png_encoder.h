@@ -0,0 +1,104 @@
+/*
+ * xscreenshot/png_encoder.h - parallel PNG encoder for screenshots
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XSCREENSHOT_PNG_ENCODER_H_
+#define XSCREENSHOT_PNG_ENCODER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <utils/utils.h>
+#include <xscreenshot/pixel_convert.h>
+
+/*
+ * Compression parameters of a PNG image
+ */
+typedef struct _png_params {
+    int level;    /* zlib compression level */
+    int strategy; /* zlib compression strategy */
+    int filter;   /* PNG filter type of all rows, or PNG_FILTER_ADAPTIVE to select the filter of each row */
+} png_params;
+
+/*
+ * Raw deflate stream of the filtered rows from row_start (inclusive) to row_end (exclusive) of an image
+ */
+typedef struct _png_strip {
+    uint32_t row_start;
+    uint32_t row_end;
+    unsigned char *out;
+    size_t out_len;
+    uint32_t adler; /* adler32 checksum of the filtered rows */
+} png_strip;
+
+/*
+ * Encode the image as an RGB PNG and write it with write_fn in parts while it is encoded.
+ * The image is split into horizontal strips that are converted, filtered and deflated in parallel. Each strip is
+ * written as a separate IDAT chunk as soon as it and the strips above it are deflated. Therefore, the first parts are
+ * written before the whole image is encoded, and only the strips waiting to be written are held in memory.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure. Parts of the image may have been written on failure.
+ */
+extern int stream_png(const raw_image *img, const row_converter *conv, const png_params *params, data_write_fn write_fn,
+                      void *arg);
+
+/*
+ * A rectangle of an image to be encoded as a separate PNG image
+ */
+typedef struct _png_tile {
+    raw_image img; /* the rectangle. Its rows may point into the rows of a larger image */
+    char *out;
+    size_t out_len;
+} png_tile;
+
+/*
+ * Filter and deflate the given strips of the image in parallel. row_start and row_end of each strip should be set.
+ * Each strip is deflated into an independent stream. The stream of the strip that ends at the last row of the image is
+ * finished while the others end on a sync flush boundary. Therefore, the streams of strips that cover all rows of an
+ * image can be joined in order even if they were deflated at different times.
+ * On success, allocates the out buffer of each strip, which should be freed by the caller.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int deflate_png_strips(const raw_image *img, const row_converter *conv, const png_params *params,
+                              png_strip *strips, uint32_t strip_cnt);
+
+/*
+ * Write an RGB PNG of the given size into a memory buffer with the deflate streams of strips that cover all rows of the
+ * image in order. level is the compression level to be recorded in the zlib header.
+ * Allocates a memory buffer and sets the pointer to *buf_p. Sets the size of the buffer in bytes to *len_p.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int write_png_strips(uint32_t width, uint32_t height, int level, const png_strip *strips, uint32_t strip_cnt,
+                            char **buf_p, size_t *len_p);
+
+/*
+ * Encode the image as an RGB PNG into a memory buffer.
+ * The image is split into horizontal strips that are converted, filtered and deflated in parallel. The deflate streams
+ * of the strips are joined with sync flush boundaries into a single IDAT stream.
+ * Allocates a memory buffer and sets the pointer to *buf_p. Sets the size of the buffer in bytes to *len_p.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int encode_png(const raw_image *img, const row_converter *conv, const png_params *params, char **buf_p,
+                      size_t *len_p);
+
+/*
+ * Encode each tile as an RGB PNG in a separate memory buffer. Tiles are encoded in parallel. Tiles should have less
+ * than twice the rows of a strip so that each of them is encoded by a single thread.
+ * On success, allocates the out buffer of each tile, which should be freed by the caller.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int encode_png_tiles(const row_converter *conv, const png_params *params, png_tile *tiles, uint32_t tile_cnt);
+
+#endif  // XSCREENSHOT_PNG_ENCODER_H_
@@ -0,0 +1,137 @@
+/*
+ * xscreenshot/qoi_encoder.c - QOI encoder for screenshots
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xscreenshot/qoi_encoder.h>
+
+#define QOI_HEADER_SIZE 14
+#define QOI_END_SIZE 8
+#define QOI_MAX_RUN 62
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+
+// alpha is always 255 since the image has no alpha channel
+#define QOI_HASH(r, g, b) (((r) * 3U + (g) * 5U + (b) * 7U + 255U * 11U) % 64U)
+
+static inline unsigned char *_write_be32(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+    return out + 4;
+}
+
+/*
+ * Encode a pixel that differs from the previous pixel and return the position after the written op.
+ */
+static inline unsigned char *_encode_pixel(unsigned char *out, const unsigned char *px, const unsigned char *prev,
+                                           unsigned char index[64][3], uint64_t *index_set) {
+    const unsigned hash = QOI_HASH(px[0], px[1], px[2]);
+    // the decoder starts with transparent black entries. They must not be referenced as opaque pixels.
+    if ((*index_set >> hash & 1) && !memcmp(index[hash], px, 3)) {
+        *out++ = (unsigned char)(QOI_OP_INDEX | hash);
+        return out;
+    }
+    memcpy(index[hash], px, 3);
+    *index_set |= 1ULL << hash;
+
+    // differences wrap around as in the QOI specification
+    const signed char dr = (signed char)(px[0] - prev[0]);
+    const signed char dg = (signed char)(px[1] - prev[1]);
+    const signed char db = (signed char)(px[2] - prev[2]);
+    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+        *out++ = (unsigned char)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+        return out;
+    }
+    const signed char dr_dg = (signed char)(dr - dg);
+    const signed char db_dg = (signed char)(db - dg);
+    if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+        *out++ = (unsigned char)(QOI_OP_LUMA | (dg + 32));
+        *out++ = (unsigned char)((dr_dg + 8) << 4 | (db_dg + 8));
+        return out;
+    }
+    *out++ = QOI_OP_RGB;
+    memcpy(out, px, 3);
+    return out + 3;
+}
+
+int encode_qoi(const raw_image *img, const row_converter *conv, char **buf_p, size_t *len_p) {
+    *buf_p = NULL;
+    *len_p = 0;
+    if (img->width == 0 || img->height == 0) return EXIT_FAILURE;
+
+    const size_t pixel_cnt = (size_t)img->width * img->height;
+    // each pixel takes at most 4 bytes with QOI_OP_RGB
+    unsigned char *buf = malloc(QOI_HEADER_SIZE + pixel_cnt * 4 + QOI_END_SIZE);
+    unsigned char *row = malloc((size_t)img->width * 3 + CONVERT_ROW_SLACK);
+    if (!buf || !row) {
+        if (buf) free(buf);
+        if (row) free(row);
+        return EXIT_FAILURE;
+    }
+
+    unsigned char *out = buf;
+    memcpy(out, "qoif", 4);
+    out = _write_be32(out + 4, img->width);
+    out = _write_be32(out, img->height);
+    *out++ = 3;  // channels
+    *out++ = 0;  // sRGB with linear alpha
+
+    unsigned char index[64][3];
+    uint64_t index_set = 0;
+    unsigned char prev[3] = {0, 0, 0};
+    unsigned run = 0;
+    for (uint32_t y = 0; y < img->height; y++) {
+        conv->convert(row, img->data + (size_t)y * img->bytes_per_line, img->width, conv);
+        const unsigned char *px = row;
+        for (uint32_t x = 0; x < img->width; x++, px += 3) {
+            if (!memcmp(px, prev, 3)) {
+                run++;
+                if (run == QOI_MAX_RUN) {
+                    *out++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run) {
+                *out++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            out = _encode_pixel(out, px, prev, index, &index_set);
+            memcpy(prev, px, 3);
+        }
+    }
+    if (run) *out++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+    free(row);
+
+    memset(out, 0, QOI_END_SIZE - 1);
+    out[QOI_END_SIZE - 1] = 1;
+    out += QOI_END_SIZE;
+
+    const size_t len = (size_t)(out - buf);
+    char *new_buf = realloc(buf, len);
+    *buf_p = new_buf ? new_buf : (char *)buf;
+    *len_p = len;
+    return EXIT_SUCCESS;
+}
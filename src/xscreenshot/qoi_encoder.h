@@ -0,0 +1,33 @@
+/*
+ * xscreenshot/qoi_encoder.h - QOI encoder for screenshots
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XSCREENSHOT_QOI_ENCODER_H_
+#define XSCREENSHOT_QOI_ENCODER_H_
+
+#include <stdlib.h>
+#include <xscreenshot/pixel_convert.h>
+
+/*
+ * Encode the image as an RGB QOI image (https://qoiformat.org) into a memory buffer.
+ * QOI encodes several times faster than PNG at the cost of a larger output.
+ * Allocates a memory buffer and sets the pointer to *buf_p. Sets the size of the buffer in bytes to *len_p.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int encode_qoi(const raw_image *img, const row_converter *conv, char **buf_p, size_t *len_p);
+
+#endif  // XSCREENSHOT_QOI_ENCODER_H_
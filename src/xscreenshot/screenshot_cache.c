@@ -0,0 +1,385 @@
+/*
+ * xscreenshot/screenshot_cache.c - damage-tracked cache of encoded screenshots
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utils/utils.h>
+#include <xcb/damage.h>
+#include <xcb/xcb.h>
+#include <xscreenshot/screenshot_cache.h>
+
+// xcb returns request cookies by value
+#pragma GCC diagnostic ignored "-Waggregate-return"
+
+#define MAX_ROWS 65536
+#define DAMAGE_BAND_ROWS 16
+#define BAND_CNT (MAX_ROWS / DAMAGE_BAND_ROWS)
+#define MAX_CACHE_STRIPS (MAX_ROWS / CACHE_STRIP_ROWS)
+#define CACHE_SLOTS 4
+#define SLOT_SIZE 134217728UL  // 128 MiB of address space. Only the pages that are written use memory
+#define HEARTBEAT_INTERVAL_MS 1000
+#define HEARTBEAT_TIMEOUT_NS 3000000000ULL
+#define RECONNECT_INTERVAL_MS 5000
+
+/*
+ * Deflate streams of the strips of the PNG of a monitor. The streams are stored in the shared cache data at fixed
+ * offsets of strip_capacity bytes so that a strip can be replaced without moving the others.
+ */
+typedef struct _cache_slot {
+    uint8_t index;
+    int8_t valid;
+    int display;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    size_t strip_capacity;
+    uint64_t seq; /* damage sequence number read before capturing the screen */
+    uint64_t last_used;
+    uint32_t out_len[MAX_CACHE_STRIPS];
+    uint32_t adler[MAX_CACHE_STRIPS];
+} cache_slot;
+
+/*
+ * State shared by the damage tracker and the processes serving clients.
+ * The damage tracker increments seq for each batch of damage events. band_seq holds the value of seq when each band
+ * of DAMAGE_BAND_ROWS rows of the root window was last damaged.
+ */
+typedef struct _damage_state {
+    pthread_mutex_t lock;
+    uint64_t heartbeat; /* time of the last heartbeat of the damage tracker, or 0 if it is not tracking */
+    uint64_t seq;
+    uint64_t band_seq[BAND_CNT];
+    cache_slot slots[CACHE_SLOTS];
+} damage_state;
+
+static damage_state *state = NULL;
+static unsigned char *cache_data = NULL;
+
+int init_screenshot_cache(void) {
+    void *shared = mmap(NULL, sizeof(damage_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) return EXIT_FAILURE;
+    void *data = mmap(NULL, SLOT_SIZE * CACHE_SLOTS, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1, 0);
+    if (data == MAP_FAILED) {
+        munmap(shared, sizeof(damage_state));
+        return EXIT_FAILURE;
+    }
+
+    damage_state *new_state = (damage_state *)shared;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    // a process may be killed while holding the lock (ex: when the server is stopped)
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int status = pthread_mutex_init(&(new_state->lock), &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (status) {
+        munmap(shared, sizeof(damage_state));
+        munmap(data, SLOT_SIZE * CACHE_SLOTS);
+        return EXIT_FAILURE;
+    }
+    for (uint8_t i = 0; i < CACHE_SLOTS; i++) {
+        new_state->slots[i].index = i;
+    }
+    state = new_state;
+    cache_data = (unsigned char *)data;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Mark the root window rows from row_start (inclusive) to row_end (exclusive) as damaged at sequence number seq.
+ */
+static void _damage_rows(int32_t row_start, int32_t row_end, uint64_t seq) {
+    if (row_start < 0) row_start = 0;
+    if (row_end > MAX_ROWS) row_end = MAX_ROWS;
+    if (row_start >= row_end) return;
+    for (int32_t band = row_start / DAMAGE_BAND_ROWS; band <= (row_end - 1) / DAMAGE_BAND_ROWS; band++) {
+        __atomic_store_n(&(state->band_seq[band]), seq, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Publish the damage recorded at sequence number seq. The damaged bands are stored before the sequence number so that
+ * a process that reads the sequence number sees all the damage recorded up to it.
+ */
+static inline void _publish_damage(uint64_t seq) { __atomic_store_n(&(state->seq), seq, __ATOMIC_RELEASE); }
+
+/*
+ * Check if all the server processes exited, from the result of polling the read end of the pipe held by the servers.
+ * Its write end is closed when they exit.
+ * returns 1 if the servers exited, or 0 otherwise.
+ */
+static inline int _servers_exited(const struct pollfd *server_pfd) { return server_pfd->revents != 0; }
+
+/*
+ * Track damage with a connection to the X server until the connection is lost or the servers exit. If reconnecting is
+ * zero, failing to connect means that there is no display.
+ * returns EXIT_SUCCESS if it should reconnect after the connection is lost, or EXIT_FAILURE if it should stop because
+ * there is no display, the X server does not support the damage extension, or the servers exited.
+ */
+static int _track_damage_connection(int servers_fd, int reconnecting) {
+    int screen_num = 0;
+    xcb_connection_t *conn = xcb_connect(NULL, &screen_num);
+    if (xcb_connection_has_error(conn)) {
+        xcb_disconnect(conn);
+        return reconnecting ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(conn, &xcb_damage_id);
+    xcb_damage_query_version_reply_t *version =
+        (ext && ext->present) ? xcb_damage_query_version_reply(conn, xcb_damage_query_version(conn, 1, 1), NULL)
+                              : NULL;
+    if (!version) {
+        xcb_disconnect(conn);
+        return EXIT_FAILURE;
+    }
+    free(version);
+    xcb_screen_iterator_t itr = xcb_setup_roots_iterator(xcb_get_setup(conn));
+    for (; itr.rem > 1 && screen_num > 0; screen_num--) {
+        xcb_screen_next(&itr);
+    }
+    if (!itr.data) {
+        xcb_disconnect(conn);
+        return EXIT_SUCCESS;
+    }
+
+    // every drawing reports its own rectangle. So there is no need to subtract the damage and race with new damage.
+    xcb_damage_damage_t damage = xcb_generate_id(conn);
+    xcb_damage_create(conn, damage, itr.data->root, XCB_DAMAGE_REPORT_LEVEL_RAW_RECTANGLES);
+    xcb_flush(conn);
+
+    // the screen may have changed while it was not tracked
+    uint64_t seq = __atomic_load_n(&(state->seq), __ATOMIC_RELAXED) + 1;
+    _damage_rows(0, MAX_ROWS, seq);
+    _publish_damage(seq);
+
+    const uint8_t damage_notify = (uint8_t)(ext->first_event + XCB_DAMAGE_NOTIFY);
+    struct pollfd pfds[2] = {{.fd = xcb_get_file_descriptor(conn), .events = POLLIN}, {.fd = servers_fd, .events = 0}};
+    while (!xcb_connection_has_error(conn)) {
+        __atomic_store_n(&(state->heartbeat), get_time_ns(), __ATOMIC_RELAXED);
+        // record all pending events under the same sequence number
+        const uint64_t next_seq = seq + 1;
+        int damaged = 0;
+        xcb_generic_event_t *event;
+        while ((event = xcb_poll_for_event(conn))) {
+            if ((event->response_type & 0x7F) == damage_notify) {
+                const xcb_rectangle_t *area = &(((xcb_damage_notify_event_t *)event)->area);
+                _damage_rows(area->y, (int32_t)area->y + area->height, next_seq);
+                damaged = 1;
+            }
+            free(event);
+        }
+        if (damaged) {
+            seq = next_seq;
+            _publish_damage(seq);
+        }
+        pfds[1].revents = 0;
+        poll(pfds, 2, HEARTBEAT_INTERVAL_MS);
+        if (_servers_exited(pfds + 1)) {
+            xcb_disconnect(conn);
+            return EXIT_FAILURE;
+        }
+    }
+    xcb_disconnect(conn);
+    return EXIT_SUCCESS;
+}
+
+void track_damage(int servers_fd) {
+    if (!state) return;
+    int reconnecting = 0;
+    while (_track_damage_connection(servers_fd, reconnecting) == EXIT_SUCCESS) {
+        __atomic_store_n(&(state->heartbeat), 0, __ATOMIC_RELAXED);
+        reconnecting = 1;
+        // wait before reconnecting, but stop at once if the servers exit meanwhile
+        struct pollfd server_pfd = {.fd = servers_fd, .events = 0};
+        poll(&server_pfd, 1, RECONNECT_INTERVAL_MS);
+        if (_servers_exited(&server_pfd)) break;
+    }
+    __atomic_store_n(&(state->heartbeat), 0, __ATOMIC_RELAXED);
+}
+
+int get_damage_seq(uint64_t *seq_p) {
+    if (!state) return EXIT_FAILURE;
+    const uint64_t heartbeat = __atomic_load_n(&(state->heartbeat), __ATOMIC_RELAXED);
+    if (!heartbeat || get_time_ns() - heartbeat > HEARTBEAT_TIMEOUT_NS) return EXIT_FAILURE;
+    *seq_p = __atomic_load_n(&(state->seq), __ATOMIC_ACQUIRE);
+    return EXIT_SUCCESS;
+}
+
+int rows_damaged_after(int32_t row_start, int32_t row_end, uint64_t seq) {
+    if (row_start < 0) row_start = 0;
+    if (row_end > MAX_ROWS) row_end = MAX_ROWS;
+    for (int32_t band = row_start / DAMAGE_BAND_ROWS; band <= (row_end - 1) / DAMAGE_BAND_ROWS; band++) {
+        if (__atomic_load_n(&(state->band_seq[band]), __ATOMIC_RELAXED) > seq) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Check if the rows of a strip of the cached monitor are damaged after the slot was cached. The row above the strip is
+ * also checked since the filters of the first row of the strip depend on it.
+ */
+static int _is_damaged(const cache_slot *slot, const png_strip *strip) {
+    return rows_damaged_after((int32_t)slot->y + (int32_t)strip->row_start - 1,
+                              (int32_t)slot->y + (int32_t)strip->row_end, slot->seq);
+}
+
+/*
+ * Find the slot with the PNG of the display with the given geometry.
+ * returns the slot, or NULL if it is not cached.
+ */
+static cache_slot *_find_slot(int display, int16_t x, int16_t y, uint16_t width, uint16_t height) {
+    for (uint8_t i = 0; i < CACHE_SLOTS; i++) {
+        cache_slot *slot = state->slots + i;
+        if (slot->valid && slot->display == display && slot->x == x && slot->y == y && slot->width == width &&
+            slot->height == height) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Find the slot to store the PNG of the display, which is its current slot or the least recently used slot.
+ */
+static cache_slot *_slot_to_store(int display) {
+    cache_slot *lru = state->slots;
+    for (uint8_t i = 0; i < CACHE_SLOTS; i++) {
+        cache_slot *slot = state->slots + i;
+        if (slot->valid && slot->display == display) return slot;
+        if (!slot->valid || (lru->valid && slot->last_used < lru->last_used)) lru = slot;
+    }
+    return lru;
+}
+
+/*
+ * Get the space for the deflate stream of a strip of a PNG of width pixels in the cache.
+ * returns the size in bytes, or 0 if the strips of a PNG of height rows do not fit in a slot.
+ */
+static size_t _strip_capacity(uint16_t width, uint16_t height) {
+    const uint32_t strip_cnt = ((uint32_t)height + CACHE_STRIP_ROWS - 1) / CACHE_STRIP_ROWS;
+    const size_t strip_raw_len = ((size_t)width * 3 + 1) * CACHE_STRIP_ROWS;
+    // deflate falls back to stored blocks that add 5 bytes for up to 64 KiB when the data does not compress
+    const size_t strip_capacity = strip_raw_len + (strip_raw_len >> 8) + 64;
+    if (strip_capacity * strip_cnt > SLOT_SIZE) return 0;
+    return strip_capacity;
+}
+
+static int _lock_cache(void) {
+    int status = pthread_mutex_lock(&(state->lock));
+    if (status == EOWNERDEAD) {
+        // the previous owner may have died while updating a slot
+        for (uint8_t i = 0; i < CACHE_SLOTS; i++) state->slots[i].valid = 0;
+        pthread_mutex_consistent(&(state->lock));
+    } else if (status) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int get_cached_png(int display, int16_t x, int16_t y, uint16_t width, uint16_t height, png_strip *strips,
+                   uint32_t *strip_cnt_p, uint64_t *seq_p, unsigned char **cached_p) {
+    *strip_cnt_p = 0;
+    *cached_p = NULL;
+    if (!state || width == 0 || height == 0) return EXIT_FAILURE;
+    const uint64_t heartbeat = __atomic_load_n(&(state->heartbeat), __ATOMIC_RELAXED);
+    if (!heartbeat || get_time_ns() - heartbeat > HEARTBEAT_TIMEOUT_NS) return EXIT_FAILURE;
+    const size_t strip_capacity = _strip_capacity(width, height);
+    if (!strip_capacity) return EXIT_FAILURE;
+
+    const uint32_t strip_cnt = ((uint32_t)height + CACHE_STRIP_ROWS - 1) / CACHE_STRIP_ROWS;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        png_strip *strip = strips + i;
+        strip->row_start = i * CACHE_STRIP_ROWS;
+        strip->row_end = (i + 1 == strip_cnt) ? height : (i + 1) * CACHE_STRIP_ROWS;
+        strip->out = NULL;
+        strip->out_len = 0;
+    }
+    *strip_cnt_p = strip_cnt;
+
+    if (_lock_cache() != EXIT_SUCCESS) return EXIT_FAILURE;
+    *seq_p = __atomic_load_n(&(state->seq), __ATOMIC_ACQUIRE);
+    cache_slot *slot = _find_slot(display, x, y, width, height);
+    if (!slot) {
+        pthread_mutex_unlock(&(state->lock));
+        return EXIT_SUCCESS;
+    }
+    slot->last_used = get_time_ns();
+    size_t cached_len = 0;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        if (!_is_damaged(slot, strips + i)) cached_len += slot->out_len[i];
+    }
+    unsigned char *cached = cached_len ? malloc(cached_len) : NULL;
+    if (cached) {
+        const unsigned char *data = cache_data + SLOT_SIZE * slot->index;
+        size_t pos = 0;
+        for (uint32_t i = 0; i < strip_cnt; i++) {
+            png_strip *strip = strips + i;
+            if (_is_damaged(slot, strip)) continue;
+            strip->out = cached + pos;
+            strip->out_len = slot->out_len[i];
+            strip->adler = slot->adler[i];
+            memcpy(strip->out, data + strip_capacity * i, strip->out_len);
+            pos += strip->out_len;
+        }
+    }
+    pthread_mutex_unlock(&(state->lock));
+    *cached_p = cached;
+    return EXIT_SUCCESS;
+}
+
+void put_cached_png(int display, int16_t x, int16_t y, uint16_t width, uint16_t height, const png_strip *strips,
+                    uint32_t strip_cnt, uint64_t seq) {
+    if (!state) return;
+    const size_t strip_capacity = _strip_capacity(width, height);
+    if (!strip_capacity) return;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        if (strips[i].out_len > strip_capacity) return;
+    }
+
+    if (_lock_cache() != EXIT_SUCCESS) return;
+    cache_slot *slot = _find_slot(display, x, y, width, height);
+    // another process may have stored a PNG captured after this one while this was encoded
+    if (slot && slot->seq > seq) {
+        pthread_mutex_unlock(&(state->lock));
+        return;
+    }
+    if (!slot) slot = _slot_to_store(display);
+    slot->display = display;
+    slot->x = x;
+    slot->y = y;
+    slot->width = width;
+    slot->height = height;
+    slot->strip_capacity = strip_capacity;
+    slot->last_used = get_time_ns();
+    unsigned char *data = cache_data + SLOT_SIZE * slot->index;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        memcpy(data + strip_capacity * i, strips[i].out, strips[i].out_len);
+        slot->out_len[i] = (uint32_t)strips[i].out_len;
+        slot->adler[i] = strips[i].adler;
+    }
+    slot->seq = seq;
+    slot->valid = 1;
+    pthread_mutex_unlock(&(state->lock));
+}
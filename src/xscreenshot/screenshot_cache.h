@@ -0,0 +1,80 @@
+/*
+ * xscreenshot/screenshot_cache.h - damage-tracked cache of encoded screenshots
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XSCREENSHOT_SCREENSHOT_CACHE_H_
+#define XSCREENSHOT_SCREENSHOT_CACHE_H_
+
+#include <stdint.h>
+#include <xscreenshot/png_encoder.h>
+
+/*
+ * Number of rows in a strip of a cached PNG. Strips are the units that are re-encoded when the screen is damaged.
+ */
+#define CACHE_STRIP_ROWS 64
+
+/*
+ * Prepare the cache and the damage records shared by all processes.
+ * This must be called before creating the server processes and the damage tracker process.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int init_screenshot_cache(void);
+
+/*
+ * Subscribe to damage events of the root window and record the damaged rows in the shared damage records. This runs
+ * in a dedicated process and reconnects to the X server if the connection is lost.
+ * servers_fd is the read end of a pipe whose write end is held only by the server processes. Tracking stops when all of
+ * them exit and the pipe is closed.
+ * Returns if the servers exited, there is no display at the start, or damage events are not available.
+ */
+extern void track_damage(int servers_fd);
+
+/*
+ * Get the strips of the cached PNG of the monitor with the given display number and geometry.
+ * strips should have space for (height + CACHE_STRIP_ROWS - 1) / CACHE_STRIP_ROWS strips. Sets the rows of each strip
+ * and the number of strips to *strip_cnt_p. The deflate streams of the strips that are not damaged since they were
+ * cached are copied into a buffer, which is set to *cached_p and should be freed by the caller. The out buffer of other
+ * strips is set to NULL. Sets the damage sequence number, which should be passed to put_cached_png() after capturing
+ * the screen, to *seq_p.
+ * The cache is locked only while the strips are copied. So other processes can use it while the screen is captured.
+ * returns EXIT_SUCCESS on success, or EXIT_FAILURE if the cache is not available.
+ */
+extern int get_cached_png(int display, int16_t x, int16_t y, uint16_t width, uint16_t height, png_strip *strips,
+                          uint32_t *strip_cnt_p, uint64_t *seq_p, unsigned char **cached_p);
+
+/*
+ * Store all the strips of the PNG of the monitor with the given display number and geometry in the cache, unless
+ * another process stored a PNG of it captured later. seq should be the damage sequence number set by get_cached_png().
+ */
+extern void put_cached_png(int display, int16_t x, int16_t y, uint16_t width, uint16_t height, const png_strip *strips,
+                           uint32_t strip_cnt, uint64_t seq);
+
+/*
+ * Get the current damage sequence number to *seq_p. It should be read before capturing the screen so that the damage
+ * after the capture is found by rows_damaged_after().
+ * returns EXIT_SUCCESS if the damage tracker is running, or EXIT_FAILURE if damage is not tracked.
+ */
+extern int get_damage_seq(uint64_t *seq_p);
+
+/*
+ * Check if any of the root window rows from row_start (inclusive) to row_end (exclusive) is damaged after the damage
+ * sequence number seq.
+ * returns 1 if the rows are damaged, or 0 otherwise.
+ */
+extern int rows_damaged_after(int32_t row_start, int32_t row_end, uint64_t seq);
+
+#endif  // XSCREENSHOT_SCREENSHOT_CACHE_H_
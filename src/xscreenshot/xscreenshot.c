@@ -1,179 +1,706 @@
 /* see LICENSE / README for more info */
 /*
- * 2022-2023 Modified by H. Thevindu J. Wijesekera
+ * 2022-2026 Modified by H. Thevindu J. Wijesekera
  */
 
-#include <X11/X.h>
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <png.h>
+#include <errno.h>
+#include <globals.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <utils/utils.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <time.h>
+#include <utils/img_scale.h>
+#include <utils/png_tuning.h>
 #include <xcb/randr.h>
+#include <xcb/shm.h>
 #include <xcb/xcb.h>
+#include <xscreenshot/pixel_convert.h>
+#include <xscreenshot/png_encoder.h>
+#include <xscreenshot/qoi_encoder.h>
+#include <xscreenshot/screenshot_cache.h>
 #include <xscreenshot/xscreenshot.h>
 
-/* LSBFirst: BGRA -> RGBA */
-static void convertrow_lsb(unsigned char *drow, const unsigned char *srow, const XImage *img) {
-    const int bytes_per_line = img->bytes_per_line;
-    const unsigned char bytes_per_pixel = (unsigned char)(img->bits_per_pixel / 8);
-    int sx;
-    int dx;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
-    for (sx = 0, dx = 0; (sx + 3) <= bytes_per_line; sx += bytes_per_pixel) {
-        drow[dx++] = srow[sx + 2]; /* B -> R */
-        drow[dx++] = srow[sx + 1]; /* G -> G */
-        drow[dx++] = srow[sx];     /* R -> B */
-    }
-}
+// xcb returns request cookies and iterators by value
+#pragma GCC diagnostic ignored "-Waggregate-return"
 
-/* MSBFirst: ARGB -> RGBA */
-static void convertrow_msb(unsigned char *drow, const unsigned char *srow, const XImage *img) {
-    const int bytes_per_line = img->bytes_per_line;
-    const unsigned char bytes_per_pixel = (unsigned char)(img->bits_per_pixel / 8);
-    int sx;
-    int dx;
+#define STREAM_TILE_SIZE 64
 
-    for (sx = 0, dx = 0; (sx + 3) <= bytes_per_line; sx += bytes_per_pixel) {
-        drow[dx++] = srow[sx + 1]; /* G -> R */
-        drow[dx++] = srow[sx + 2]; /* B -> G */
-        drow[dx++] = srow[sx + 3]; /* A -> B */
-    }
+#define MIN(x, y) (x < y ? x : y)
+
+/*
+ * Connection to the X server with the pixmap format and visual of the root window and the shared memory segment used
+ * to fetch images. The shared memory segment is reused for subsequent captures as long as it is large enough.
+ * When all monitors are captured together, monitors holds the rectangles of the monitors relative to the captured
+ * rectangle.
+ */
+typedef struct _capture_ctx {
+    xcb_connection_t *conn;
+    xcb_window_t root;
+    xcb_colormap_t colormap;
+    uint8_t depth;
+    uint8_t bits_per_pixel;
+    uint8_t scanline_pad;
+    uint8_t byte_order;
+    uint8_t visual_class;
+    uint32_t red_mask;
+    uint32_t green_mask;
+    uint32_t blue_mask;
+    int8_t has_shm;
+    xcb_shm_seg_t shm_seg;
+    unsigned char *shm_addr;
+    size_t shm_size;
+    unsigned char palette[768];
+    xcb_rectangle_t *monitors;
+    int monitor_cnt;
+} capture_ctx;
+
+static capture_ctx context = {.conn = NULL, .monitors = NULL, .monitor_cnt = 0};
+
+/*
+ * Detach the shared memory segment of the context from this process only, if there is one. Used when the X server
+ * is not reachable to detach it on its side.
+ */
+static void _detach_shm_local(capture_ctx *ctx) {
+    if (!ctx->shm_addr) return;
+    shmdt(ctx->shm_addr);
+    ctx->shm_addr = NULL;
+    ctx->shm_size = 0;
 }
 
-static int png_write_buf(XImage *img, char **buf_ptr, size_t *len) {
-    png_structp png_write_p;
-    png_infop png_info_p;
-    unsigned char *drow = NULL;
-    const unsigned char *srow;
+/*
+ * Detach and release the shared memory segment of the context if there is one.
+ */
+static void _release_shm(capture_ctx *ctx) {
+    if (!ctx->shm_addr) return;
+    xcb_shm_detach(ctx->conn, ctx->shm_seg);
+    _detach_shm_local(ctx);
+}
+
+/*
+ * Make sure the context has a shared memory segment of at least size bytes attached to the X server.
+ * The segment is marked for removal as soon as the X server attaches it. Therefore, it is freed automatically once
+ * both the X server and this process detach it, even if the process exits without cleaning up.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _ensure_shm(capture_ctx *ctx, size_t size) {
+    if (ctx->shm_addr && ctx->shm_size >= size) return EXIT_SUCCESS;
+    _release_shm(ctx);
 
-    png_write_p = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_write_p) {
-        *len = 0;
+    int shm_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shm_id < 0) return EXIT_FAILURE;
+    void *addr = shmat(shm_id, NULL, 0);
+    if (addr == (void *)-1) {
+        shmctl(shm_id, IPC_RMID, NULL);
         return EXIT_FAILURE;
     }
-
-    png_info_p = png_create_info_struct(png_write_p);
-    if ((!png_info_p) || setjmp(png_jmpbuf(png_write_p))) {
-        png_destroy_write_struct(&png_write_p, NULL);
-        *len = 0;
+    xcb_shm_seg_t seg = xcb_generate_id(ctx->conn);
+    xcb_generic_error_t *err =
+        xcb_request_check(ctx->conn, xcb_shm_attach_checked(ctx->conn, seg, (uint32_t)shm_id, 0));
+    shmctl(shm_id, IPC_RMID, NULL);
+    if (err) {
+        // The X server cannot access the segment. (ex: remote X server)
+        free(err);
+        shmdt(addr);
         return EXIT_FAILURE;
     }
+    ctx->shm_seg = seg;
+    ctx->shm_addr = (unsigned char *)addr;
+    ctx->shm_size = size;
+    return EXIT_SUCCESS;
+}
+
+static void _close_context(capture_ctx *ctx) {
+    if (!ctx->conn) return;
+    _release_shm(ctx);
+    xcb_disconnect(ctx->conn);
+    ctx->conn = NULL;
+}
 
-    struct mem_file fake_file;
-    fake_file.buffer = NULL;
-    fake_file.capacity = 0;
-    fake_file.size = 0;
-    png_init_io(png_write_p, (png_FILE_p)&fake_file);
-    png_set_write_fn(png_write_p, &fake_file, &png_mem_write_data, NULL);
-    png_set_IHDR(png_write_p, png_info_p, (png_uint_32)(img->width), (png_uint_32)(img->height), 8, PNG_COLOR_TYPE_RGB,
-                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_BASE);
-    png_write_info(png_write_p, png_info_p);
+/*
+ * Connect to the X server if the context is not already connected and find the pixmap format of the root window.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _open_context(capture_ctx *ctx) {
+    if (ctx->conn) {
+        if (!xcb_connection_has_error(ctx->conn)) return EXIT_SUCCESS;
+        // the connection is broken. Reconnect. The X server releases its side of the segment with the connection
+        _detach_shm_local(ctx);
+        xcb_disconnect(ctx->conn);
+        ctx->conn = NULL;
+    }
 
-    srow = (unsigned char *)img->data;
-    drow = malloc((size_t)(img->width) * 4); /* output RGBA */
-    if (!drow) {
-        png_destroy_write_struct(&png_write_p, &png_info_p);
-        *len = 0;
+    int screen_num = 0;
+    xcb_connection_t *conn = xcb_connect(NULL, &screen_num);
+    if (xcb_connection_has_error(conn)) {
+        xcb_disconnect(conn);
+        return EXIT_FAILURE;
+    }
+    const xcb_setup_t *setup = xcb_get_setup(conn);
+    xcb_screen_iterator_t itr = xcb_setup_roots_iterator(setup);
+    for (; itr.rem > 1 && screen_num > 0; screen_num--) {
+        xcb_screen_next(&itr);
+    }
+    const xcb_screen_t *screen = itr.data;
+    if (!screen) {
+        xcb_disconnect(conn);
         return EXIT_FAILURE;
     }
 
-    void (*convert)(unsigned char *, const unsigned char *, const XImage *);
-    if (img->byte_order == LSBFirst)
-        convert = convertrow_lsb;
-    else
-        convert = convertrow_msb;
+    ctx->bits_per_pixel = 0;
+    const xcb_format_t *formats = xcb_setup_pixmap_formats(setup);
+    const int format_cnt = xcb_setup_pixmap_formats_length(setup);
+    for (int i = 0; i < format_cnt; i++) {
+        if (formats[i].depth == screen->root_depth) {
+            ctx->bits_per_pixel = formats[i].bits_per_pixel;
+            ctx->scanline_pad = formats[i].scanline_pad;
+            break;
+        }
+    }
+    if (ctx->bits_per_pixel < 8 || ctx->scanline_pad < 8) {
+        xcb_disconnect(conn);
+        return EXIT_FAILURE;
+    }
 
-    for (int h = 0; h < img->height; h++) {
-        convert(drow, srow, img);
-        srow += img->bytes_per_line;
-        png_write_row(png_write_p, (png_const_bytep)drow);
+    ctx->visual_class = XCB_VISUAL_CLASS_STATIC_GRAY;
+    ctx->red_mask = ctx->green_mask = ctx->blue_mask = 0;
+    xcb_depth_iterator_t depth_itr = xcb_screen_allowed_depths_iterator(screen);
+    for (; depth_itr.rem; xcb_depth_next(&depth_itr)) {
+        if (depth_itr.data->depth != screen->root_depth) continue;
+        xcb_visualtype_iterator_t visual_itr = xcb_depth_visuals_iterator(depth_itr.data);
+        for (; visual_itr.rem; xcb_visualtype_next(&visual_itr)) {
+            const xcb_visualtype_t *visual = visual_itr.data;
+            if (visual->visual_id != screen->root_visual) continue;
+            ctx->visual_class = visual->_class;
+            ctx->red_mask = visual->red_mask;
+            ctx->green_mask = visual->green_mask;
+            ctx->blue_mask = visual->blue_mask;
+            break;
+        }
     }
-    png_write_end(png_write_p, NULL);
-    free(drow);
 
-    char *new_buf = realloc(fake_file.buffer, fake_file.size);
-    if (new_buf) fake_file.buffer = new_buf;
-    *buf_ptr = fake_file.buffer;
-    *len = fake_file.size;
-    png_free_data(png_write_p, png_info_p, PNG_FREE_ALL, -1);
-    png_destroy_write_struct(&png_write_p, &png_info_p);
+    ctx->conn = conn;
+    ctx->root = screen->root;
+    ctx->colormap = screen->default_colormap;
+    ctx->depth = screen->root_depth;
+    ctx->byte_order = setup->image_byte_order;
+    ctx->shm_addr = NULL;
+    ctx->shm_size = 0;
+
+    xcb_shm_query_version_reply_t *shm_reply = xcb_shm_query_version_reply(conn, xcb_shm_query_version(conn), NULL);
+    ctx->has_shm = shm_reply != NULL;
+    if (shm_reply) free(shm_reply);
     return EXIT_SUCCESS;
 }
 
-int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
-    XImage *img;
-    Display *dpy;
-    Window win;
-
-    *len_p = 0;
-    if (!(dpy = XOpenDisplay(NULL))) {
-        return EXIT_FAILURE;
+/*
+ * Fill the pixel format of images captured with the context. For visuals that are not TrueColor or DirectColor, the
+ * colormap is fetched again since it may have changed after the previous capture.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _get_pixel_format(capture_ctx *ctx, pixel_format *fmt) {
+    fmt->bits_per_pixel = ctx->bits_per_pixel;
+    fmt->byte_order = ctx->byte_order;
+    fmt->red_mask = ctx->red_mask;
+    fmt->green_mask = ctx->green_mask;
+    fmt->blue_mask = ctx->blue_mask;
+    fmt->palette = NULL;
+    if (ctx->visual_class == XCB_VISUAL_CLASS_TRUE_COLOR || ctx->visual_class == XCB_VISUAL_CLASS_DIRECT_COLOR) {
+        return EXIT_SUCCESS;
     }
+    if (ctx->depth > 8) return EXIT_FAILURE;
 
-    xcb_connection_t *dsp = xcb_connect(NULL, NULL);
-    if (xcb_connection_has_error(dsp)) {
-        XCloseDisplay(dpy);
-        return EXIT_FAILURE;
+    const uint32_t color_cnt = 1U << ctx->depth;
+    uint32_t pixels[256];
+    for (uint32_t i = 0; i < color_cnt; i++) pixels[i] = i;
+    xcb_query_colors_reply_t *reply =
+        xcb_query_colors_reply(ctx->conn, xcb_query_colors(ctx->conn, ctx->colormap, color_cnt, pixels), NULL);
+    if (!reply) return EXIT_FAILURE;
+    const xcb_rgb_t *colors = xcb_query_colors_colors(reply);
+    const int colors_len = xcb_query_colors_colors_length(reply);
+    uint32_t palette_len = colors_len < 0 ? 0 : (uint32_t)colors_len;
+    if (palette_len > color_cnt) palette_len = color_cnt;
+    memset(ctx->palette, 0, sizeof(ctx->palette));
+    for (uint32_t i = 0; i < palette_len; i++) {
+        ctx->palette[i * 3] = (unsigned char)(colors[i].red >> 8);
+        ctx->palette[i * 3 + 1] = (unsigned char)(colors[i].green >> 8);
+        ctx->palette[i * 3 + 2] = (unsigned char)(colors[i].blue >> 8);
     }
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Waggregate-return"
-    xcb_window_t root = xcb_setup_roots_iterator(xcb_get_setup(dsp)).data->root;
-    xcb_randr_get_monitors_cookie_t cookie = xcb_randr_get_monitors(dsp, root, 1);
-#pragma GCC diagnostic pop
-    xcb_randr_get_monitors_reply_t *reply = xcb_randr_get_monitors_reply(dsp, cookie, NULL);
+    free(reply);
+    fmt->palette = ctx->palette;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Find the geometry of the monitor given by the display number, which starts from 1.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _get_monitor(const capture_ctx *ctx, int display, int16_t *x_p, int16_t *y_p, uint16_t *width_p,
+                        uint16_t *height_p) {
+    xcb_randr_get_monitors_reply_t *reply =
+        xcb_randr_get_monitors_reply(ctx->conn, xcb_randr_get_monitors(ctx->conn, ctx->root, 1), NULL);
+    if (!reply) return EXIT_FAILURE;
     int cnt = xcb_randr_get_monitors_monitors_length(reply);
-    if (display > cnt) {
+    if (display <= 0 || display > cnt) {
         free(reply);
-        xcb_disconnect(dsp);
-        XCloseDisplay(dpy);
         return EXIT_FAILURE;
     }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Waggregate-return"
     xcb_randr_monitor_info_iterator_t itr = xcb_randr_get_monitors_monitors_iterator(reply);
-#pragma GCC diagnostic pop
 
-    int x = 0;
-    int y = 0;
-    unsigned int width = 0;
-    unsigned int height = 0;
+    *width_p = 0;
+    *height_p = 0;
     while (itr.rem) {
         display--;
         if (display == 0) {
             const xcb_randr_monitor_info_t *info = itr.data;
-            x = info->x;
-            y = info->y;
-            width = info->width;
-            height = info->height;
+            *x_p = info->x;
+            *y_p = info->y;
+            *width_p = info->width;
+            *height_p = info->height;
             break;
         }
         xcb_randr_monitor_info_next(&itr);
     }
     free(reply);
-    xcb_disconnect(dsp);
-    if (width == 0 || height == 0) {
-        XCloseDisplay(dpy);
+    if (*width_p == 0 || *height_p == 0) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Find the bounding rectangle of all monitors and store the rectangles of the monitors relative to it in the context.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _get_all_monitors(capture_ctx *ctx, int16_t *x_p, int16_t *y_p, uint16_t *width_p, uint16_t *height_p) {
+    xcb_randr_get_monitors_reply_t *reply =
+        xcb_randr_get_monitors_reply(ctx->conn, xcb_randr_get_monitors(ctx->conn, ctx->root, 1), NULL);
+    if (!reply) return EXIT_FAILURE;
+    const int cnt = xcb_randr_get_monitors_monitors_length(reply);
+    xcb_rectangle_t *monitors = cnt > 0 ? malloc(sizeof(xcb_rectangle_t) * (size_t)cnt) : NULL;
+    if (!monitors) {
+        free(reply);
+        return EXIT_FAILURE;
+    }
+
+    int32_t left = INT32_MAX;
+    int32_t top = INT32_MAX;
+    int32_t right = INT32_MIN;
+    int32_t bottom = INT32_MIN;
+    xcb_randr_monitor_info_iterator_t itr = xcb_randr_get_monitors_monitors_iterator(reply);
+    for (int i = 0; i < cnt && itr.rem; i++, xcb_randr_monitor_info_next(&itr)) {
+        const xcb_randr_monitor_info_t *info = itr.data;
+        monitors[i].x = info->x;
+        monitors[i].y = info->y;
+        monitors[i].width = info->width;
+        monitors[i].height = info->height;
+        if (info->x < left) left = info->x;
+        if (info->y < top) top = info->y;
+        if (info->x + (int32_t)info->width > right) right = info->x + (int32_t)info->width;
+        if (info->y + (int32_t)info->height > bottom) bottom = info->y + (int32_t)info->height;
+    }
+    free(reply);
+    if (right <= left || bottom <= top || right - left > UINT16_MAX || bottom - top > UINT16_MAX) {
+        free(monitors);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < cnt; i++) {
+        monitors[i].x = (int16_t)(monitors[i].x - left);
+        monitors[i].y = (int16_t)(monitors[i].y - top);
+    }
+    if (ctx->monitors) free(ctx->monitors);
+    ctx->monitors = monitors;
+    ctx->monitor_cnt = cnt;
+    *x_p = (int16_t)left;
+    *y_p = (int16_t)top;
+    *width_p = (uint16_t)(right - left);
+    *height_p = (uint16_t)(bottom - top);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Fill the parts of the captured image that are not covered by any monitor of the context with zero bytes. The X
+ * server returns whatever the framebuffer holds in those parts. Monitors may extend beyond the captured image.
+ */
+static void _blank_uncovered(const capture_ctx *ctx, unsigned char *data, const raw_image *img) {
+    const size_t bytes_per_pixel = ctx->bits_per_pixel / 8;
+    const xcb_rectangle_t *monitors = ctx->monitors;
+    const int32_t width = (int32_t)img->width;
+    for (int32_t row = 0; row < (int32_t)img->height; row++) {
+        unsigned char *line = data + (size_t)row * img->bytes_per_line;
+        int32_t col = 0;
+        while (col < width) {
+            // skip to the farthest right edge of the monitors covering this pixel
+            int32_t next = col;
+            for (int i = 0; i < ctx->monitor_cnt; i++) {
+                const xcb_rectangle_t *m = monitors + i;
+                if (m->y > row || row >= m->y + m->height) continue;
+                if (m->x <= col && col < m->x + m->width && m->x + m->width > next) next = m->x + m->width;
+            }
+            if (next > col) {
+                col = next;
+                continue;
+            }
+            // blank up to the nearest monitor on the right
+            int32_t gap_end = width;
+            for (int i = 0; i < ctx->monitor_cnt; i++) {
+                const xcb_rectangle_t *m = monitors + i;
+                if (m->y > row || row >= m->y + m->height) continue;
+                if (m->x > col && m->x < gap_end) gap_end = m->x;
+            }
+            memset(line + (size_t)col * bytes_per_pixel, 0, (size_t)(gap_end - col) * bytes_per_pixel);
+            col = gap_end;
+        }
+    }
+}
+
+/*
+ * Fetch the image of the given rectangle of the root window through the shared memory segment.
+ * img->data points to the shared memory segment, which is valid until the next capture with the same context.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _get_image_shm(capture_ctx *ctx, int16_t x, int16_t y, raw_image *img) {
+    const size_t size = (size_t)img->bytes_per_line * img->height;
+    if (_ensure_shm(ctx, size) != EXIT_SUCCESS) return EXIT_FAILURE;
+    xcb_shm_get_image_reply_t *reply = xcb_shm_get_image_reply(
+        ctx->conn,
+        xcb_shm_get_image(ctx->conn, ctx->root, x, y, (uint16_t)img->width, (uint16_t)img->height, ~0U,
+                          XCB_IMAGE_FORMAT_Z_PIXMAP, ctx->shm_seg, 0),
+        NULL);
+    if (!reply) return EXIT_FAILURE;
+    const uint32_t reply_size = reply->size;
+    free(reply);
+    if (reply_size < size) return EXIT_FAILURE;
+    img->data = ctx->shm_addr;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Fetch the image of the given rectangle of the root window through the X connection. This is used when shared
+ * memory is not available (ex: remote X server).
+ * Sets *reply_p to the reply holding the image data, which should be freed after using img.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _get_image_socket(const capture_ctx *ctx, int16_t x, int16_t y, raw_image *img,
+                             xcb_get_image_reply_t **reply_p) {
+    xcb_get_image_reply_t *reply = xcb_get_image_reply(
+        ctx->conn,
+        xcb_get_image(ctx->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, ctx->root, x, y, (uint16_t)img->width,
+                      (uint16_t)img->height, ~0U),
+        NULL);
+    if (!reply) return EXIT_FAILURE;
+    const int data_len = xcb_get_image_data_length(reply);
+    if (data_len < 0 || (size_t)data_len < (size_t)img->bytes_per_line * img->height) {
+        free(reply);
+        return EXIT_FAILURE;
+    }
+    img->data = xcb_get_image_data(reply);
+    *reply_p = reply;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Capture the rectangle of the root window at x, y with the size of img. Shared memory is used if the X server
+ * supports it.
+ * Sets *reply_p to the reply holding the image data if the image is fetched through the X connection. It should be
+ * freed after using img.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _capture(capture_ctx *ctx, int16_t x, int16_t y, raw_image *img, xcb_get_image_reply_t **reply_p) {
+    *reply_p = NULL;
+    int status = EXIT_FAILURE;
+    if (ctx->has_shm) {
+        status = _get_image_shm(ctx, x, y, img);
+        // do not try shared memory again on this connection if the X server cannot use it
+        if (status != EXIT_SUCCESS && !ctx->shm_addr) ctx->has_shm = 0;
+    }
+    if (status != EXIT_SUCCESS) {
+        status = _get_image_socket(ctx, x, y, img, reply_p);
+    }
+    if (status != EXIT_SUCCESS) {
+        _close_context(ctx);
+        return EXIT_FAILURE;
+    }
+    if (ctx->monitor_cnt > 0) {
+        _blank_uncovered(ctx, *reply_p ? xcb_get_image_data(*reply_p) : ctx->shm_addr, img);
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Downscale the image to width x height pixels with a box filter. The rows are converted to RGB and added to the
+ * scaler one by one. So the image is never converted as a whole.
+ * Fills the scaled image, whose pixels are 8-bit RGB, and its row converter. Allocates the pixels of the scaled image
+ * and sets the pointer to *data_p. It should be freed after using the scaled image.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _downscale(const raw_image *img, const row_converter *conv, uint32_t width, uint32_t height,
+                      raw_image *scaled, row_converter *scaled_conv, unsigned char **data_p) {
+    const size_t stride = (size_t)width * 3;
+    unsigned char *data = malloc(stride * height);
+    unsigned char *row = malloc((size_t)img->width * 3 + CONVERT_ROW_SLACK);
+    img_scaler scaler;
+    if (!data || !row ||
+        init_scaler(&scaler, img->width, img->height, width, height, 3, data, stride) != EXIT_SUCCESS) {
+        if (data) free(data);
+        if (row) free(row);
         return EXIT_FAILURE;
     }
+    for (uint32_t r = 0; r < img->height; r++) {
+        conv->convert(row, img->data + (size_t)r * img->bytes_per_line, img->width, conv);
+        scaler_add_row(&scaler, row);
+    }
+    free_scaler(&scaler);
+    free(row);
+
+    scaled->data = data;
+    scaled->width = width;
+    scaled->height = height;
+    scaled->bytes_per_line = (uint32_t)stride;
+    scaled->format.bits_per_pixel = 24;
+    scaled->format.byte_order = XCB_IMAGE_ORDER_LSB_FIRST;
+    scaled->format.red_mask = 0xFF;
+    scaled->format.green_mask = 0xFF00;
+    scaled->format.blue_mask = 0xFF0000;
+    scaled->format.palette = NULL;
+    if (init_row_converter(scaled_conv, &scaled->format) != EXIT_SUCCESS) {
+        free(data);
+        return EXIT_FAILURE;
+    }
+    *data_p = data;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * The write function of a streamed PNG with the number of bytes written and the time spent in writing them
+ */
+typedef struct _counted_write {
+    data_write_fn write;
+    void *arg;
+    size_t written;
+    uint64_t write_ns;
+} counted_write;
+
+static int _write_counted(void *arg, const char *data, size_t len) {
+    counted_write *counter = (counted_write *)arg;
+    const uint64_t start = get_time_ns();
+    const int status = counter->write(counter->arg, data, len);
+    counter->write_ns += get_time_ns() - start;
+    counter->written += len;
+    return status;
+}
+
+/*
+ * Capture the screen, downscale the image to width x height pixels if it is smaller than the captured image, and
+ * encode the image in the format opts->format. PNG images are written with opts->write while they are encoded if it
+ * is set, and opts->written is set.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _capture_and_encode(capture_ctx *ctx, int16_t x, int16_t y, raw_image *img, const row_converter *conv,
+                               uint32_t width, uint32_t height, img_options *opts, char **buf_p, size_t *len_p) {
+    xcb_get_image_reply_t *reply;
+    if (_capture(ctx, x, y, img, &reply) != EXIT_SUCCESS) return EXIT_FAILURE;
+    raw_image scaled;
+    row_converter scaled_conv;
+    unsigned char *scaled_data = NULL;
+    if (width < img->width || height < img->height) {
+        const int status = _downscale(img, conv, width, height, &scaled, &scaled_conv, &scaled_data);
+        if (reply) free(reply);
+        reply = NULL;
+        if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+        img = &scaled;
+        conv = &scaled_conv;
+    }
+    int status;
+    if (opts->format == IMG_FORMAT_QOI) {
+        status = encode_qoi(img, conv, buf_p, len_p);
+    } else if (opts->write) {
+        const png_params params = {.level = get_png_level(),
+                                   .strategy = configuration.png.strategy,
+                                   .filter = configuration.png.filter};
+        opts->written = 1;
+        counted_write counter = {.write = opts->write, .arg = opts->write_arg, .written = 0, .write_ns = 0};
+        const uint64_t start = get_time_ns();
+        status = stream_png(img, conv, &params, _write_counted, &counter);
+        if (status == EXIT_SUCCESS) {
+            // the time waiting for the client to receive the data is not part of the encoding time
+            const uint64_t elapsed = get_time_ns() - start - counter.write_ns;
+            record_png_encode(params.level, (size_t)img->width * img->height * 3, counter.written, elapsed);
+        }
+    } else {
+        const png_params params = {.level = get_png_level(),
+                                   .strategy = configuration.png.strategy,
+                                   .filter = configuration.png.filter};
+        const uint64_t start = get_time_ns();
+        status = encode_png(img, conv, &params, buf_p, len_p);
+        if (status == EXIT_SUCCESS) {
+            record_png_encode(params.level, (size_t)img->width * img->height * 3, *len_p, get_time_ns() - start);
+        }
+    }
+    if (reply) free(reply);
+    if (scaled_data) free(scaled_data);
+    return status;
+}
+
+/*
+ * Encode the screenshot of the display as a PNG with the strips from get_cached_png(). Only the strips that are damaged
+ * since they were cached are deflated again, and the screen is captured only if there are such strips. The strips are
+ * stored in the cache again if any of them was deflated.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _encode_png_cached(capture_ctx *ctx, int display, int16_t x, int16_t y, raw_image *img,
+                              const row_converter *conv, png_strip *strips, uint32_t strip_cnt, uint64_t seq,
+                              char **buf_p, size_t *len_p) {
+    uint32_t dirty_cnt = 0;
+    for (uint32_t i = 0; i < strip_cnt; i++) {
+        if (!strips[i].out) dirty_cnt++;
+    }
+    const int level = get_png_level();
+    png_strip *dirty = NULL;
+    if (dirty_cnt > 0) {
+        dirty = malloc(sizeof(png_strip) * dirty_cnt);
+        if (!dirty) return EXIT_FAILURE;
+        size_t raw_size = 0;
+        for (uint32_t i = 0, j = 0; i < strip_cnt; i++) {
+            if (strips[i].out) continue;
+            dirty[j++] = strips[i];
+            raw_size += (size_t)img->width * 3 * (strips[i].row_end - strips[i].row_start);
+        }
+
+        xcb_get_image_reply_t *reply;
+        if (_capture(ctx, x, y, img, &reply) != EXIT_SUCCESS) {
+            free(dirty);
+            return EXIT_FAILURE;
+        }
+        const png_params params = {.level = level,
+                                   .strategy = configuration.png.strategy,
+                                   .filter = configuration.png.filter};
+        const uint64_t start = get_time_ns();
+        const int status = deflate_png_strips(img, conv, &params, dirty, dirty_cnt);
+        if (reply) free(reply);
+        if (status != EXIT_SUCCESS) {
+            free(dirty);
+            return EXIT_FAILURE;
+        }
+        const uint64_t elapsed = get_time_ns() - start;
 
-    win = RootWindow(dpy, 0);
-    img = XGetImage(dpy, win, x, y, width, height, AllPlanes, ZPixmap);
+        size_t deflate_len = 0;
+        for (uint32_t i = 0, j = 0; i < strip_cnt; i++) {
+            if (strips[i].out) continue;
+            strips[i] = dirty[j++];
+            deflate_len += strips[i].out_len;
+        }
+        record_png_encode(level, raw_size, deflate_len, elapsed);
+        put_cached_png(display, x, y, (uint16_t)img->width, (uint16_t)img->height, strips, strip_cnt, seq);
+    }
 
-    XCloseDisplay(dpy);
+    const int status = write_png_strips(img->width, img->height, level, strips, strip_cnt, buf_p, len_p);
+    for (uint32_t j = 0; j < dirty_cnt; j++) {
+        free(dirty[j].out);
+    }
+    if (dirty) free(dirty);
+    return status;
+}
 
-    if (!img) {
+/*
+ * Find the rectangle of the root window to capture for the display number and the region in opts. When all monitors
+ * are captured, the rectangles of the monitors relative to the captured rectangle are stored in the context.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _get_geometry(capture_ctx *ctx, int display, const img_options *opts, int16_t *x_p, int16_t *y_p,
+                         uint16_t *width_p, uint16_t *height_p) {
+    ctx->monitor_cnt = 0;
+    if (display == DISPLAY_ALL) {
+        if (_get_all_monitors(ctx, x_p, y_p, width_p, height_p) != EXIT_SUCCESS) return EXIT_FAILURE;
+    } else if (_get_monitor(ctx, display, x_p, y_p, width_p, height_p) != EXIT_SUCCESS) {
         return EXIT_FAILURE;
     }
-    size_t len;
-    png_write_buf(img, buf_p, &len);
-    XDestroyImage(img);
+    if (opts->region_width > 0) {
+        if (!region_fits(opts, *width_p, *height_p)) return EXIT_FAILURE;
+        *x_p = (int16_t)(*x_p + opts->region_x);
+        *y_p = (int16_t)(*y_p + opts->region_y);
+        *width_p = opts->region_width;
+        *height_p = opts->region_height;
+        // monitors are relative to the captured rectangle
+        for (int i = 0; i < ctx->monitor_cnt; i++) {
+            ctx->monitors[i].x = (int16_t)(ctx->monitors[i].x - opts->region_x);
+            ctx->monitors[i].y = (int16_t)(ctx->monitors[i].y - opts->region_y);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Fill the size and the pixel format of an image of width x height pixels captured with the context, and prepare its
+ * row converter.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int _init_raw_image(capture_ctx *ctx, uint16_t width, uint16_t height, raw_image *img, row_converter *conv) {
+    if (_get_pixel_format(ctx, &(img->format)) != EXIT_SUCCESS ||
+        init_row_converter(conv, &(img->format)) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    img->data = NULL;
+    img->width = width;
+    img->height = height;
+    // scanlines are padded to a multiple of scanline_pad bits
+    img->bytes_per_line = ((width * (uint32_t)ctx->bits_per_pixel + ctx->scanline_pad - 1) / ctx->scanline_pad) *
+                          (ctx->scanline_pad / 8U);
+    return EXIT_SUCCESS;
+}
+
+int screenshot_util(int display, img_options *opts, uint32_t *len_p, char **buf_p) {
+    *len_p = 0;
+    *buf_p = NULL;
+    if (_open_context(&context) != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+
+    int16_t x = 0;
+    int16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    if (_get_geometry(&context, display, opts, &x, &y, &width, &height) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    raw_image img;
+    row_converter conv;
+    if (_init_raw_image(&context, width, height, &img, &conv) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    uint32_t scaled_width;
+    uint32_t scaled_height;
+    const int scaled = get_scaled_size(opts, width, height, &scaled_width, &scaled_height);
+    opts->format = select_image_format(opts, (uint64_t)scaled_width * scaled_height);
+    size_t len = 0;
+    int status;
+    png_strip *strips = NULL;
+    unsigned char *cached = NULL;
+    int use_cache = 0;
+    uint32_t strip_cnt = 0;
+    uint64_t seq = 0;
+    // colormaps of indexed visuals may change without damaging the screen. So those screenshots are not cached.
+    // Regions are not cached either, since they would evict the screenshots of whole monitors
+    if (opts->format == IMG_FORMAT_PNG && !img.format.palette && !scaled && opts->region_width == 0) {
+        strips = malloc(sizeof(png_strip) * (((size_t)height + CACHE_STRIP_ROWS - 1) / CACHE_STRIP_ROWS));
+        if (strips) {
+            use_cache = get_cached_png(display, x, y, width, height, strips, &strip_cnt, &seq, &cached) == EXIT_SUCCESS;
+        }
+    }
+    if (use_cache) {
+        status = _encode_png_cached(&context, display, x, y, &img, &conv, strips, strip_cnt, seq, buf_p, &len);
+        if (cached) free(cached);
+    } else {
+        status = _capture_and_encode(&context, x, y, &img, &conv, scaled_width, scaled_height, opts, buf_p, &len);
+    }
+    if (strips) free(strips);
 
-    if (len < 8 || len >= 0xFFFFFFFFUL) {
+    if (status != EXIT_SUCCESS || (!opts->written && (len < 8 || len >= 0xFFFFFFFFUL))) {
         if (*buf_p) free(*buf_p);
         *buf_p = NULL;
         return EXIT_FAILURE;
@@ -182,3 +709,210 @@ int screenshot_util(int display, uint32_t *len_p, char **buf_p) {
     *len_p = (uint32_t)len;
     return EXIT_SUCCESS;
 }
+
+/*
+ * Screen stream with the pixels of the previous frame. Frames are compared with the previous frame in tiles of
+ * STREAM_TILE_SIZE x STREAM_TILE_SIZE pixels.
+ */
+struct _screen_stream {
+    int16_t x;
+    int16_t y;
+    raw_image img; /* size and pixel format of the frames */
+    row_converter conv;
+    size_t bytes_per_pixel;
+    unsigned char *prev; /* pixels of the previous frame in the layout of a captured image */
+    int8_t has_prev;
+    int8_t tracked;        /* set if the damage tracker was running when the previous frame was captured */
+    uint64_t seq;          /* damage sequence number read before capturing the previous frame */
+    uint64_t interval_ns;  /* time between two frames */
+    uint64_t next_frame_ns; /* earliest time to capture the next frame */
+};
+
+screen_stream *open_screen_stream(const img_options *opts, uint32_t fps, uint16_t *width_p, uint16_t *height_p) {
+    if (fps == 0 || _open_context(&context) != EXIT_SUCCESS) return NULL;
+    uint16_t disp = opts->disp;
+    if (disp <= 0 || !configuration.client_selects_display) disp = configuration.display;
+    int16_t x = 0;
+    int16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    if (_get_geometry(&context, disp, opts, &x, &y, &width, &height) != EXIT_SUCCESS) return NULL;
+
+    screen_stream *stream = malloc(sizeof(screen_stream));
+    if (!stream) return NULL;
+    if (_init_raw_image(&context, width, height, &(stream->img), &(stream->conv)) != EXIT_SUCCESS) {
+        free(stream);
+        return NULL;
+    }
+    stream->prev = malloc((size_t)stream->img.bytes_per_line * height);
+    if (!stream->prev) {
+        free(stream);
+        return NULL;
+    }
+    stream->x = x;
+    stream->y = y;
+    stream->bytes_per_pixel = context.bits_per_pixel / 8U;
+    stream->has_prev = 0;
+    stream->tracked = 0;
+    stream->seq = 0;
+    stream->interval_ns = 1000000000ULL / fps;
+    stream->next_frame_ns = 0;
+    *width_p = width;
+    *height_p = height;
+    return stream;
+}
+
+/*
+ * Check if len bytes at cur differ from those at prev.
+ */
+static inline int _bytes_differ(const unsigned char *cur, const unsigned char *prev, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        const __m128i diff = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(const void *)(cur + i)),
+                                           _mm_loadu_si128((const __m128i *)(const void *)(prev + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xFFFF) return 1;
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint64x2_t diff = vreinterpretq_u64_u8(veorq_u8(vld1q_u8(cur + i), vld1q_u8(prev + i)));
+        if (vgetq_lane_u64(diff, 0) | vgetq_lane_u64(diff, 1)) return 1;
+    }
+#endif
+    return i < len && memcmp(cur + i, prev + i, len - i) != 0;
+}
+
+/*
+ * Check if the tile of rows rows of row_len bytes at offset bytes from the start of the frame differs from the
+ * previous frame. If it does, the tile is copied to the previous frame.
+ * returns 1 if the tile changed, or 0 otherwise.
+ */
+static int _update_tile(screen_stream *stream, size_t offset, size_t row_len, uint32_t rows) {
+    const size_t bytes_per_line = stream->img.bytes_per_line;
+    const unsigned char *cur = stream->img.data + offset;
+    unsigned char *prev = stream->prev + offset;
+    uint32_t r = 0;
+    while (r < rows && !_bytes_differ(cur + r * bytes_per_line, prev + r * bytes_per_line, row_len)) r++;
+    if (r == rows) return 0;
+    // the rows above r are the same
+    for (; r < rows; r++) {
+        memcpy(prev + r * bytes_per_line, cur + r * bytes_per_line, row_len);
+    }
+    return 1;
+}
+
+/*
+ * Compare the captured frame with the previous frame and fill the tiles that changed with their positions in
+ * frame_tiles. Tile rows that are not damaged since the previous frame are skipped if check_damage is set.
+ * returns the number of changed tiles.
+ */
+static uint32_t _find_changed_tiles(screen_stream *stream, int check_damage, png_tile *tiles,
+                                    frame_tile *frame_tiles) {
+    const raw_image *img = &(stream->img);
+    uint32_t cnt = 0;
+    for (uint32_t row = 0; row < img->height; row += STREAM_TILE_SIZE) {
+        const uint32_t rows = MIN(STREAM_TILE_SIZE, img->height - row);
+        if (check_damage &&
+            !rows_damaged_after(stream->y + (int32_t)row, stream->y + (int32_t)(row + rows), stream->seq)) {
+            continue;
+        }
+        for (uint32_t col = 0; col < img->width; col += STREAM_TILE_SIZE) {
+            const uint32_t cols = MIN(STREAM_TILE_SIZE, img->width - col);
+            const size_t offset = (size_t)row * img->bytes_per_line + col * stream->bytes_per_pixel;
+            if (stream->has_prev && !_update_tile(stream, offset, cols * stream->bytes_per_pixel, rows)) continue;
+            tiles[cnt].img = *img;
+            tiles[cnt].img.data = img->data + offset;
+            tiles[cnt].img.width = cols;
+            tiles[cnt].img.height = rows;
+            frame_tiles[cnt].x = (uint16_t)col;
+            frame_tiles[cnt].y = (uint16_t)row;
+            cnt++;
+        }
+    }
+    if (!stream->has_prev) memcpy(stream->prev, img->data, (size_t)img->bytes_per_line * img->height);
+    return cnt;
+}
+
+/*
+ * Wait until the time to capture the next frame of the stream and set the time of the frame after it. Frames are not
+ * captured faster to catch up after a delay.
+ */
+static void _wait_for_frame(screen_stream *stream) {
+    const uint64_t target = stream->next_frame_ns;
+    uint64_t now = get_time_ns();
+    if (now < target) {
+        struct timespec ts = {.tv_sec = (time_t)(target / 1000000000ULL), .tv_nsec = (long)(target % 1000000000ULL)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+        now = target;
+    }
+    stream->next_frame_ns = (target && now - target < stream->interval_ns) ? target + stream->interval_ns
+                                                                            : now + stream->interval_ns;
+}
+
+int next_screen_frame(screen_stream *stream, frame_tile **tiles_p, uint32_t *tile_cnt_p) {
+    *tiles_p = NULL;
+    *tile_cnt_p = 0;
+    _wait_for_frame(stream);
+
+    uint64_t seq = 0;
+    const int tracked = get_damage_seq(&seq) == EXIT_SUCCESS;
+    // colormaps of indexed visuals may change without damaging the screen
+    const int check_damage = stream->has_prev && stream->tracked && tracked && !stream->img.format.palette;
+    if (check_damage && !rows_damaged_after(stream->y, stream->y + (int32_t)stream->img.height, stream->seq)) {
+        stream->seq = seq;
+        return EXIT_SUCCESS;
+    }
+
+    const uint32_t max_cnt = ((stream->img.width + STREAM_TILE_SIZE - 1) / STREAM_TILE_SIZE) *
+                             ((stream->img.height + STREAM_TILE_SIZE - 1) / STREAM_TILE_SIZE);
+    png_tile *tiles = malloc(sizeof(png_tile) * max_cnt);
+    frame_tile *frame_tiles = malloc(sizeof(frame_tile) * max_cnt);
+    xcb_get_image_reply_t *reply;
+    if (!tiles || !frame_tiles || _capture(&context, stream->x, stream->y, &(stream->img), &reply) != EXIT_SUCCESS) {
+        if (tiles) free(tiles);
+        if (frame_tiles) free(frame_tiles);
+        return EXIT_FAILURE;
+    }
+    const uint32_t cnt = _find_changed_tiles(stream, check_damage, tiles, frame_tiles);
+    stream->has_prev = 1;
+    stream->tracked = (int8_t)tracked;
+    stream->seq = seq;
+
+    int status = EXIT_SUCCESS;
+    if (cnt > 0) {
+        const png_params params = {.level = get_png_level(),
+                                   .strategy = configuration.png.strategy,
+                                   .filter = configuration.png.filter};
+        const uint64_t start = get_time_ns();
+        status = encode_png_tiles(&(stream->conv), &params, tiles, cnt);
+        if (status == EXIT_SUCCESS) {
+            const uint64_t elapsed = get_time_ns() - start;
+            size_t raw_size = 0;
+            size_t png_size = 0;
+            for (uint32_t i = 0; i < cnt; i++) {
+                raw_size += (size_t)tiles[i].img.width * tiles[i].img.height * 3;
+                png_size += tiles[i].out_len;
+                frame_tiles[i].len = (uint32_t)tiles[i].out_len;
+                frame_tiles[i].data = tiles[i].out;
+            }
+            record_png_encode(params.level, raw_size, png_size, elapsed);
+        }
+    }
+    if (reply) free(reply);
+    free(tiles);
+    if (status != EXIT_SUCCESS || cnt == 0) {
+        free(frame_tiles);
+        return status;
+    }
+    *tiles_p = frame_tiles;
+    *tile_cnt_p = cnt;
+    return EXIT_SUCCESS;
+}
+
+void close_screen_stream(screen_stream *stream) {
+    if (!stream) return;
+    free(stream->prev);
+    free(stream);
+}
@@ -3,14 +3,17 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <utils/utils.h>
 
 /*
  * Get a screenshot and save it to a memory buffer
+ * The image is encoded in the format selected by select_image_format() for the options opts. Sets opts->format to the
+ * format of the image.
  * Allocates a memory buffer and set the pointer to *buf_p.
  * Sets the size of the buffer in bytes to *len_p.
  * Returns 0 on success.
  * Returns -1 if an error occured.
  */
-extern int screenshot_util(int display, uint32_t *len_p, char **buf_p);
+extern int screenshot_util(int display, img_options *opts, uint32_t *len_p, char **buf_p);
 
 #endif  // XSCREENSHOT_XSCREENSHOT_H_
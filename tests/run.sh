@@ -309,6 +309,9 @@ export METHOD_SEND_FILES=$(printf '\x04' | bin2hex)
 export METHOD_GET_IMAGE=$(printf '\x05' | bin2hex)
 export METHOD_GET_COPIED_IMAGE=$(printf '\x06' | bin2hex)
 export METHOD_GET_SCREENSHOT=$(printf '\x07' | bin2hex)
+export METHOD_GET_SCREENSHOT_REGION=$(printf '\x08' | bin2hex)
+export METHOD_STREAM_SCREENSHOTS=$(printf '\x09' | bin2hex)
+export METHOD_GET_TEXT_CHUNKED=$(printf '\x0a' | bin2hex)
 export METHOD_INFO=$(printf '\x7d' | bin2hex)
 
 # Proto ack
@@ -324,6 +327,10 @@ export METHOD_NOT_IMPLEMENTED="$(printf '\x04' | bin2hex)"
 
 export ACK_V4='01'
 
+# Image formats
+export IMG_FORMAT_PNG='01'
+export IMG_FORMAT_QOI='02'
+
 export imgSample="89504e470d0a1a0a0000000d4948445200000005000000050802000000020db1b20\
 00000264944415408d755cb2112002010804070fcff973168f0681bb042b99501f5ac8bbf9ad6c\
 dfc0f828c0e0522b1809c0000000049454e44ae426082"
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+
+. scripts/common/x.1.1_get_text.sh
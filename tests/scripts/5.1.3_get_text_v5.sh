@@ -0,0 +1,26 @@
+#!/bin/bash
+
+. init.sh
+
+sample=$'line one of get_text\r\nline two\rwith a lone CR\r\nline three of the text\nlast line\r\n'
+expectedText=$'line one of get_text\nline two\rwith a lone CR\nline three of the text\nlast line\n'
+
+copy_text "$sample"
+
+method="$METHOD_GET_TEXT"
+
+responseDump=$(echo -n "${PROTO_V5}${method}${ACK_V4}" | hex2bin | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+length=$(printf '%016x' "${#expectedText}")
+sampleDump=$(echo -n "$expectedText" | bin2hex | tr -d '\n')
+
+expected="${protoAck}${methodAck}${length}${sampleDump}"
+
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
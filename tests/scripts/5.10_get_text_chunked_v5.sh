@@ -0,0 +1,61 @@
+#!/bin/bash
+
+. init.sh
+
+sample="$(printf 'Sample text for get_text_chunked %04d\n' $(seq 1 400))"
+
+copy_text "$sample"
+
+responseDump=$(echo -n "${PROTO_V5}${METHOD_GET_TEXT_CHUNKED}${ACK_V4}" | hex2bin | client_tool)
+
+expected_header="${PROTO_SUPPORTED}${METHOD_OK}"
+if [ "${responseDump::${#expected_header}}" != "$expected_header" ]; then
+    showStatus info 'Incorrect response header.'
+    echo 'Expected:' "$expected_header"
+    echo 'Received:' "${responseDump::${#expected_header}}"
+    exit 1
+fi
+responseDump="${responseDump:${#expected_header}}"
+
+# join the chunks up to the empty chunk
+text=''
+while true; do
+    if [ "${#responseDump}" -lt 16 ]; then
+        showStatus info 'Text ended without the empty chunk.'
+        exit 1
+    fi
+    length="$((16#${responseDump::16}))"
+    responseDump="${responseDump:16}"
+    if [ "$length" = 0 ]; then
+        break
+    fi
+    if [ "$((length * 2))" -gt "${#responseDump}" ]; then
+        showStatus info 'Invalid chunk length.'
+        exit 1
+    fi
+    text+="${responseDump::$((length * 2))}"
+    responseDump="${responseDump:$((length * 2))}"
+done
+
+if [ -n "$responseDump" ]; then
+    showStatus info 'Unexpected data after the empty chunk.'
+    exit 1
+fi
+
+sampleDump=$(echo -n "$sample" | bin2hex | tr -d '\n')
+if [ "$text" != "$sampleDump" ]; then
+    showStatus info 'Incorrect text.'
+    exit 1
+fi
+
+clear_clipboard
+
+responseDump=$(echo -n "${PROTO_V5}${METHOD_GET_TEXT_CHUNKED}" | hex2bin | client_tool)
+
+expected="${PROTO_SUPPORTED}${METHOD_NO_DATA}"
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response for empty clipboard.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+. init.sh
+
+# valid text followed by an encoded surrogate, which is not valid UTF-8
+sampleDump="$(printf 'send_text 範例文字 with invalid UTF-8 at the end of a long text ' | bin2hex | tr -d '\n')eda080"
+length="$(printf '%016x' $((${#sampleDump} / 2)))"
+
+method="$METHOD_SEND_TEXT"
+
+previous='text copied before'
+copy_text "$previous"
+
+responseDump=$(echo -n "${PROTO_V5}${method}${length}${sampleDump}" | hex2bin | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+
+# the server rejects the text without sending the acknowledgement
+expected="${protoAck}${methodAck}"
+
+if [ "$responseDump" != "$expected" ]; then
+    showStatus info 'Incorrect server response.'
+    echo 'Expected:' "$expected"
+    echo 'Received:' "$responseDump"
+    exit 1
+fi
+
+clip="$(get_copied_text || echo fail)"
+
+previousDump=$(echo -n "$previous" | bin2hex)
+# the clipboard should still have the previous text as the invalid text is rejected by the server.
+if [ "$clip" != "$previousDump" ]; then
+    showStatus info 'Invalid text was copied to the clipboard.'
+    echo 'Expected:' "$previousDump"
+    echo 'Received:' "$clip"
+    exit 1
+fi
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+ack_v4="$ACK_V4"
+
+. scripts/common/x.2_send_text.sh
@@ -0,0 +1,5 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+
+. scripts/common/x.3.1_get_files.sh
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+files=(
+    'a/b/file 1.txt'
+    'a/c/file 2.txt'
+    'a/b/file 3.txt'
+    'a/b/d/e/f/file 4.txt'
+    'a/file 5.txt'
+    'a/c/empty/'
+    'a/b/d/e/file 6.txt'
+    'file 7.txt'
+    'g/h/file 8.txt'
+)
+
+proto="$PROTO_V5"
+ack_v4="$ACK_V4"
+
+. scripts/common/x.4.x_send_files.sh
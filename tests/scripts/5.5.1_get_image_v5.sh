@@ -0,0 +1,8 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_IMAGE"
+params=''
+ack_v4="$ACK_V4"
+
+. scripts/common/get_image_v5.sh
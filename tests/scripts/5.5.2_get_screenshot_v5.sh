@@ -0,0 +1,15 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_IMAGE"
+params='formats=qoi,png'
+IMAGE_ACK="$METHOD_OK"
+image_format="$IMG_FORMAT_PNG"
+if [ "$DETECTED_OS" = 'Linux' ]; then
+    image_format="$IMG_FORMAT_QOI"
+fi
+ack_v4="$ACK_V4"
+
+clear_clipboard
+
+. scripts/common/get_screenshot_v5.sh
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_COPIED_IMAGE"
+ack_v4="$ACK_V4"
+
+. scripts/common/get_image_v5.sh
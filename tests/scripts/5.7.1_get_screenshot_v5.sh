@@ -0,0 +1,10 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_SCREENSHOT"
+params='display=30000' # not existing display
+IMAGE_ACK="$METHOD_NO_DATA"
+
+copy_image "$imgSample"
+
+. scripts/common/get_screenshot_v5.sh
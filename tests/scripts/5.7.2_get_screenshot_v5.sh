@@ -0,0 +1,13 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_SCREENSHOT"
+params=$'display=1\nunknown_param=1\nformats=webp,qoi'
+IMAGE_ACK="$METHOD_OK"
+image_format="$IMG_FORMAT_PNG"
+if [ "$DETECTED_OS" = 'Linux' ]; then
+    image_format="$IMG_FORMAT_QOI"
+fi
+ack_v4="$ACK_V4"
+
+. scripts/common/get_screenshot_v5.sh
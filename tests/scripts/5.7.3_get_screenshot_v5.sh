@@ -0,0 +1,15 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_SCREENSHOT"
+params=$'display=all\nformats=png'
+IMAGE_ACK="$METHOD_OK"
+if [ "$DETECTED_OS" = 'macOS' ]; then
+    IMAGE_ACK="$METHOD_NO_DATA" # capturing all displays is not supported on macOS
+fi
+image_format="$IMG_FORMAT_PNG"
+ack_v4="$ACK_V4"
+
+copy_image "$imgSample"
+
+. scripts/common/get_screenshot_v5.sh
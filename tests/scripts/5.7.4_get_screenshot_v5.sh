@@ -0,0 +1,40 @@
+#!/bin/bash
+
+. init.sh
+
+max_width=64
+params="max_width=${max_width}"$'\nformats=png'
+paramsDump="$(printf '%016x' "${#params}")$(echo -n "$params" | bin2hex | tr -d '\n')"
+
+responseDump=$(echo -n "${PROTO_V5}${METHOD_GET_SCREENSHOT}${paramsDump}${ACK_V4}" | hex2bin | client_tool)
+
+expected_header="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}${IMG_FORMAT_PNG}"
+if [ "${responseDump::${#expected_header}}" != "$expected_header" ]; then
+    showStatus info 'Incorrect response header.'
+    echo 'Expected:' "$expected_header"
+    echo 'Received:' "${responseDump::${#expected_header}}"
+    exit 1
+fi
+responseDump="${responseDump:${#expected_header}}"
+
+length="$((16#${responseDump::16}))"
+responseDump="${responseDump:16}"
+if [ "$length" != "$((${#responseDump} / 2))" ]; then
+    echo "$length" does not match with "${#responseDump}"
+    showStatus info 'Invalid image length.'
+    exit 1
+fi
+
+expected_img_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+if [ "${responseDump::${#expected_img_header}}" != "$expected_img_header" ]; then
+    showStatus info 'Invalid image header.'
+    exit 1
+fi
+
+# the width is the first field of the IHDR chunk, which follows the signature and the chunk length and type
+width="$((16#${responseDump:32:8}))"
+if [ "$width" -le '0' ] || [ "$width" -gt "$max_width" ]; then
+    showStatus info 'Image is not downscaled.'
+    echo 'Width:' "$width"
+    exit 1
+fi
@@ -0,0 +1,55 @@
+#!/bin/bash
+
+. init.sh
+
+params=$'chunked=1\nformats=png'
+paramsDump="$(printf '%016x' "${#params}")$(echo -n "$params" | bin2hex | tr -d '\n')"
+
+responseDump=$(echo -n "${PROTO_V5}${METHOD_GET_SCREENSHOT}${paramsDump}${ACK_V4}" | hex2bin | client_tool)
+
+expected_header="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}${IMG_FORMAT_PNG}"
+if [ "${responseDump::${#expected_header}}" != "$expected_header" ]; then
+    showStatus info 'Incorrect response header.'
+    echo 'Expected:' "$expected_header"
+    echo 'Received:' "${responseDump::${#expected_header}}"
+    exit 1
+fi
+responseDump="${responseDump:${#expected_header}}"
+
+# join the chunks up to the empty chunk
+image=''
+while true; do
+    if [ "${#responseDump}" -lt 16 ]; then
+        showStatus info 'Image ended without the empty chunk.'
+        exit 1
+    fi
+    length="$((16#${responseDump::16}))"
+    responseDump="${responseDump:16}"
+    if [ "$length" = 0 ]; then
+        break
+    fi
+    if [ "$((length * 2))" -gt "${#responseDump}" ]; then
+        showStatus info 'Invalid chunk length.'
+        exit 1
+    fi
+    image+="${responseDump::$((length * 2))}"
+    responseDump="${responseDump:$((length * 2))}"
+done
+
+if [ -n "$responseDump" ]; then
+    showStatus info 'Unexpected data after the empty chunk.'
+    exit 1
+fi
+
+expected_img_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+if [ "${image::${#expected_img_header}}" != "$expected_img_header" ]; then
+    showStatus info 'Invalid image header.'
+    exit 1
+fi
+
+# the image ends with the IEND chunk
+expected_img_trailer="0000000049454e44ae426082"
+if [ "${image:$((${#image} - ${#expected_img_trailer}))}" != "$expected_img_trailer" ]; then
+    showStatus info 'Invalid image trailer.'
+    exit 1
+fi
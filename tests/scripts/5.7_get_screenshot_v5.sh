@@ -0,0 +1,12 @@
+#!/bin/bash
+
+proto="$PROTO_V5"
+method="$METHOD_GET_SCREENSHOT"
+params=$'display=1\nformats=png'
+IMAGE_ACK="$METHOD_OK"
+image_format="$IMG_FORMAT_PNG"
+ack_v4="$ACK_V4"
+
+copy_image "$imgSample"
+
+. scripts/common/get_screenshot_v5.sh
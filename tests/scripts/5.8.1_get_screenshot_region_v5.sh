@@ -0,0 +1,25 @@
+#!/bin/bash
+
+. init.sh
+
+check_no_data() {
+    local params="$1"
+    local paramsDump="$(printf '%016x' "${#params}")$(echo -n "$params" | bin2hex | tr -d '\n')"
+    local responseDump=$(echo -n "${PROTO_V5}${METHOD_GET_SCREENSHOT_REGION}${paramsDump}" | hex2bin | client_tool)
+    local expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Params:' "$params"
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$responseDump"
+        exit 1
+    fi
+}
+
+# the region does not fit inside the display
+check_no_data $'x=0\ny=0\nwidth=65535\nheight=65535'
+# the height is missing
+check_no_data $'width=16'
+# invalid values
+check_no_data $'x=-1\nwidth=16\nheight=16'
+check_no_data $'width=16\nheight=abc'
@@ -0,0 +1,68 @@
+#!/bin/bash
+
+. init.sh
+
+region_width=150
+region_height=100
+params=$'fps=30\nx=0\ny=0\nwidth='"${region_width}"$'\nheight='"${region_height}"
+paramsDump="$(printf '%016x' "${#params}")$(echo -n "$params" | bin2hex | tr -d '\n')"
+
+# get the next frame after the first one and stop the stream after the second frame
+responseDump=$(echo -n "${PROTO_V5}${METHOD_STREAM_SCREENSHOTS}${paramsDump}${METHOD_OK}00" | hex2bin | client_tool)
+
+if [ "$DETECTED_OS" != 'Linux' ]; then
+    # streaming the screen is supported only on Linux
+    expected="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_NO_DATA}"
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$expected"
+        echo 'Received:' "$responseDump"
+        exit 1
+    fi
+    exit 0
+fi
+
+frame_size="$(printf '%016x' "$region_width")$(printf '%016x' "$region_height")"
+expected_header="${PROTO_SUPPORTED}${METHOD_OK}${METHOD_OK}${frame_size}"
+if [ "${responseDump::${#expected_header}}" != "$expected_header" ]; then
+    showStatus info 'Incorrect response header.'
+    echo 'Expected:' "$expected_header"
+    echo 'Received:' "${responseDump::${#expected_header}}"
+    exit 1
+fi
+responseDump="${responseDump:${#expected_header}}"
+
+expected_img_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+for frame in 1 2; do
+    tile_cnt="$((16#${responseDump::16}))"
+    responseDump="${responseDump:16}"
+    # the first frame has all the tiles
+    if [ "$frame" = 1 ] && [ "$tile_cnt" != 6 ]; then
+        showStatus info 'Incorrect number of tiles in the first frame.'
+        echo 'Expected:' 6
+        echo 'Received:' "$tile_cnt"
+        exit 1
+    fi
+    for _ in $(seq 1 "$tile_cnt"); do
+        x="$((16#${responseDump::16}))"
+        y="$((16#${responseDump:16:16}))"
+        length="$((16#${responseDump:32:16}))"
+        responseDump="${responseDump:48}"
+        if [ "$((x % 64))" != 0 ] || [ "$((y % 64))" != 0 ] || [ "$x" -ge "$region_width" ] ||
+            [ "$y" -ge "$region_height" ]; then
+            showStatus info 'Invalid tile position.'
+            echo 'Received:' "${x},${y}"
+            exit 1
+        fi
+        if [ "${responseDump::${#expected_img_header}}" != "$expected_img_header" ]; then
+            showStatus info 'Invalid tile image header.'
+            exit 1
+        fi
+        responseDump="${responseDump:$((length * 2))}"
+    done
+done
+
+if [ -n "$responseDump" ]; then
+    showStatus info 'Unexpected data after the stream was stopped.'
+    exit 1
+fi
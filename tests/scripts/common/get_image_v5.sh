@@ -0,0 +1,58 @@
+#!/bin/bash
+
+. init.sh
+
+copy_image "$imgSample"
+
+paramsDump=''
+if [ -n "${params+x}" ]; then
+    paramsDump="$(printf '%016x' "${#params}")$(echo -n "$params" | bin2hex | tr -d '\n')"
+fi
+
+responseDump=$(echo -n "${proto}${method}${paramsDump}${ack_v4}" | hex2bin | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+if [ -n "${params+x}" ]; then
+    methodAck="${METHOD_OK}${METHOD_OK}"
+fi
+length=$(printf '%016x' "$((${#imgSample} / 2))")
+
+header="${protoAck}${methodAck}${IMG_FORMAT_PNG}"
+expected="${header}${length}${imgSample}"
+header_len="${#header}"
+
+if [ "$DETECTED_OS" = 'Linux' ]; then
+    if [ "$responseDump" != "$expected" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "${expected::20} ..."
+        echo 'Received:' "${responseDump::20} ..."
+        exit 1
+    fi
+elif [ "$DETECTED_OS" = 'Windows' ]; then
+    if [ "${responseDump::header_len+32}" != "${expected::header_len+32}" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "${expected::20} ..."
+        echo 'Received:' "${responseDump::20} ..."
+        exit 1
+    fi
+elif [ "$DETECTED_OS" = 'macOS' ]; then
+    if [ "${responseDump::header_len}" != "$header" ]; then
+        showStatus info 'Incorrect server response.'
+        echo 'Expected:' "$header"
+        echo 'Received:' "${responseDump::header_len}"
+        exit 1
+    fi
+    imgSize="$((0x${responseDump:header_len:16}))"
+    if [ "$imgSize" -gt 512 ]; then
+        showStatus info "Image is too large. size=${imgSize}."
+        exit 1
+    fi
+    if [ "${responseDump:header_len+16:16}" != "${imgSample::16}" ]; then
+        showStatus info 'Invalid image header.'
+        exit 1
+    fi
+else
+    showStatus info 'Unknown OS.'
+    exit 1
+fi
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+. init.sh
+
+paramsDump="$(printf '%016x' "${#params}")$(echo -n "$params" | bin2hex | tr -d '\n')"
+
+responseDump=$(echo -n "${proto}${method}${paramsDump}${ack_v4}" | hex2bin | client_tool)
+
+protoAck="$PROTO_SUPPORTED"
+methodAck="$METHOD_OK"
+
+expected_proto_method_ack="${protoAck}${methodAck}"
+len_expected_header="${#expected_proto_method_ack}"
+
+if [ "${responseDump::len_expected_header}" != "$expected_proto_method_ack" ]; then
+    showStatus info 'Incorrect protocol:method ack.'
+    echo 'Expected:' "$expected_proto_method_ack"
+    echo 'Received:' "${responseDump::len_expected_header}"
+    exit 1
+fi
+
+responseDump="${responseDump:len_expected_header}"
+
+if [ "${responseDump::2}" != "$IMAGE_ACK" ]; then
+    showStatus info 'Incorrect image ack.'
+    echo 'Expected:' "$IMAGE_ACK"
+    echo 'Received:' "${responseDump::2}"
+    exit 1
+fi
+if [ "$IMAGE_ACK" = "$METHOD_NO_DATA" ]; then
+    exit 0
+fi
+responseDump="${responseDump:2}"
+
+if [ "${responseDump::2}" != "$image_format" ]; then
+    showStatus info 'Incorrect image format.'
+    echo 'Expected:' "$image_format"
+    echo 'Received:' "${responseDump::2}"
+    exit 1
+fi
+responseDump="${responseDump:2}"
+
+length="$((16#${responseDump::16}))"
+responseDump="${responseDump:16}"
+
+if [ "$length" -le '512' ] || [ "$length" != "$((${#responseDump} / 2))" ]; then
+    echo "$length" does not match with "${#responseDump}"
+    showStatus info 'Invalid image length.'
+    exit 1
+fi
+
+if [ "$image_format" = "$IMG_FORMAT_QOI" ]; then
+    expected_img_header="$(printf 'qoif' | bin2hex)"
+else
+    expected_img_header="$(printf '\x89PNG\r\n\x1a\n' | bin2hex)"
+fi
+img_header="${responseDump::${#expected_img_header}}"
+
+if [ "$img_header" != "$expected_img_header" ]; then
+    showStatus info 'Invalid image header.'
+    exit 1
+fi
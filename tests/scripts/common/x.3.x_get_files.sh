@@ -34,7 +34,12 @@ responseDump=$(echo -n "${proto}${method}${ack_v4}" | hex2bin | client_tool)
 
 protoAck="$PROTO_SUPPORTED"
 methodAck="$METHOD_OK"
-fileCountHex=$(printf '%016x' "$fileCount")
+if [ "$proto" -gt "$PROTO_V4" ]; then
+    # the server does not know the number of files when it starts sending them
+    fileCountHex='ffffffffffffffff'
+else
+    fileCountHex=$(printf '%016x' "$fileCount")
+fi
 
 expectedHead="${protoAck}${methodAck}${fileCountHex}"
 responseHead="${responseDump::${#expectedHead}}"
@@ -75,6 +80,14 @@ for _ in $(seq "$fileCount"); do
     body="${body:$((16 + fileSize * 2))}"
 done
 
+if [ "$proto" -gt "$PROTO_V4" ]; then
+    if [ "${body::16}" != '0000000000000000' ]; then
+        showStatus info 'End of files is not marked'
+        exit 1
+    fi
+    body="${body:16}"
+fi
+
 if [ "$body" != '' ]; then
     showStatus info 'Incorrect response body'
     exit 1
@@ -50,7 +50,14 @@ check working_dir ./ server.pfx
 check bind_address 127.0.0.1 127.0.0.256
 check bind_address_udp 0.0.0.0 127.0.0.a
 check client_selects_display false F
+check png_compression_level auto 10
+check png_compression_strategy RLE zlib
+check png_filter paeth best
 check cut_sent_files False T
+check file_sync Per-File always
+check clipboard_timeout None -1
+check clipboard_timeout 5000 0
+check serve_stale_text False yes
 check min_proto_version 1 1K
 check max_proto_version "$PROTO_MAX_VERSION" 10000000000000
 check method_get_text_enabled 1 TRUE1